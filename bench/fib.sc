@@ -0,0 +1,18 @@
+// Naive recursive Fibonacci, all calls and returns
+extern int printf(char *fmt, int x);
+
+int fib(int n) {
+    if (n < 2)
+        return n;
+
+    int a = n - 1;
+    int b = n - 2;
+
+    return fib(a) + fib(b);
+}
+
+void main() {
+    int result = fib(32);
+
+    printf("%d\n", result);
+}
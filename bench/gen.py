@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Generates a large Steel C program to measure how fast steelc compiles.
+
+    bench/gen.py -o /tmp/big --functions 2000 --depth 4 --terms 32 --includes 20
+
+The program is written to <dir>/main.sc, with --includes more files beside
+it that main.sc includes. Each file defines its share of the --functions,
+and each function has --statements statements: long expressions of --terms
+terms, calls to functions defined before it and ifs, whiles and fors nested
+--depth deep. The same options and --seed always give the same program."""
+
+import argparse
+import os
+import random
+import sys
+
+
+class Gen:
+    def __init__(self, args):
+        self.args = args
+        self.rand = random.Random(args.seed)
+        self.funcs = []
+
+    def expr(self, names):
+        terms = [self.rand.choice(names)]
+
+        for _ in range(self.args.terms - 1):
+            term = self.rand.choice(names) if self.rand.random() < 0.6 else str(self.rand.randint(1, 99))
+            terms.append(self.rand.choice(("+", "-", "*")) + " " + term)
+
+        return " ".join(terms)
+
+    def stmts(self, out, indent, depth, names, count):
+        pad = "    " * indent
+
+        for _ in range(count):
+            kind = self.rand.randrange(4)
+
+            if kind == 0 and depth < self.args.depth:
+                out.append(f"{pad}if ({self.rand.choice(names)} < {self.rand.choice(names)}) {{")
+                self.stmts(out, indent + 1, depth + 1, names, 2)
+                out.append(f"{pad}}} else {{")
+                self.stmts(out, indent + 1, depth + 1, names, 1)
+                out.append(f"{pad}}}")
+            elif kind == 1 and depth < self.args.depth:
+                i = f"i{depth}"
+                out.append(f"{pad}for (mut int {i} = 0; {i} < 4; {i} += 1) {{")
+                self.stmts(out, indent + 1, depth + 1, names + [i], 2)
+                out.append(f"{pad}}}")
+            elif kind == 2 and self.funcs:
+                out.append(f"{pad}{self.rand.choice(('x', 'y'))} = {self.rand.choice(self.funcs)}({self.rand.choice(names)}, {self.rand.choice(names)});")
+            else:
+                out.append(f"{pad}{self.rand.choice(('x', 'y'))} = {self.expr(names)};")
+
+    def func(self, out):
+        name = f"f{len(self.funcs)}"
+        out.append(f"int {name}(int a, int b) {{")
+        out.append("    mut int x = a;")
+        out.append("    mut int y = b;")
+        self.stmts(out, 1, 0, ["a", "b", "x", "y"], self.args.statements)
+        out.append("    return x + y;")
+        out.append("}")
+        out.append("")
+        self.funcs.append(name)
+
+    def file(self, path, count, header):
+        out = header
+
+        for _ in range(count):
+            self.func(out)
+
+        with open(path, "w") as f:
+            f.write("\n".join(out))
+
+        return len(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a large Steel C program")
+    parser.add_argument("-o", "--output", required=True, help="directory to write the program to")
+    parser.add_argument("--functions", type=int, default=200, help="functions in the whole program")
+    parser.add_argument("--statements", type=int, default=10, help="statements at the top of each function")
+    parser.add_argument("--depth", type=int, default=2, help="how deep statements nest")
+    parser.add_argument("--terms", type=int, default=8, help="terms in each expression")
+    parser.add_argument("--includes", type=int, default=0, help="files main.sc includes")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    if args.functions < 1 or args.statements < 1 or args.depth < 0 or args.terms < 1 or args.includes < 0:
+        print("gen.py: error: sizes can't be negative, and there has to be a function, statement and term", file=sys.stderr)
+        sys.exit(1)
+
+    os.makedirs(args.output, exist_ok=True)
+    gen = Gen(args)
+    lines = 0
+    header = []
+
+    # The functions are shared out between the includes and main.sc
+    share = args.functions // (args.includes + 1)
+
+    for i in range(args.includes):
+        lines += gen.file(os.path.join(args.output, f"inc{i}.sc"), share, [])
+        header.append(f'#include "inc{i}.sc"')
+
+    header.append("")
+    main_funcs = args.functions - share * args.includes
+    out = header
+
+    for _ in range(main_funcs):
+        gen.func(out)
+
+    out.append("void main() {")
+    out.append(f"    int r = {gen.funcs[-1]}(1, 2);")
+    out.append("}")
+    out.append("")
+
+    with open(os.path.join(args.output, "main.sc"), "w") as f:
+        f.write("\n".join(out))
+
+    print(lines + len(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,34 @@
+// Multiplies two 48x48 integer matrices, prints the trace of the product
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut int a[2304];
+    mut int b[2304];
+    mut int c[2304];
+    mut int trace = 0;
+
+    for (mut int i = 0; i < 2304; i += 1) {
+        a[i] = i % 7 - 3;
+        b[i] = i % 5 + 1;
+    }
+
+    for (mut int round = 0; round < 100; round += 1) {
+        for (mut int i = 0; i < 48; i += 1) {
+            for (mut int j = 0; j < 48; j += 1) {
+                mut int sum = 0;
+
+                for (mut int k = 0; k < 48; k += 1) {
+                    int col = k * 48 + j;
+                    sum += a[i * 48 + k] * b[col];
+                }
+
+                c[i * 48 + j] = sum;
+            }
+        }
+    }
+
+    for (mut int i = 0; i < 48; i += 1)
+        trace += c[i * 48 + i];
+
+    printf("%d\n", trace);
+}
@@ -0,0 +1,91 @@
+#include "parser.h"
+#include "lexer.h"
+#include "ast.h"
+#include "emit.h"
+#include "opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Compiles one file to assembly like steelc -S, but prints how long each
+ * phase took and the peak resident size during it, one line each:
+ *   <phase> <seconds> <peak kB>
+ * for bench/throughput.py to read. Lexing happens as the parser asks for
+ * tokens, so it's counted with parsing. */
+
+extern THREAD_LOCAL Const **constants;
+extern THREAD_LOCAL Alias **aliases;
+
+double start;
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lowers the peak resident size to the current one, so the next phase measures its own
+void peak_reset(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    // Without it, the peaks are of everything so far
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+// The peak resident size in kB, unlike ru_maxrss it doesn't carry over from the parent
+long peak_rss(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+        return 0;
+
+    char line[256];
+    long kb = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0)
+            kb = atol(line + 6);
+    }
+
+    fclose(f);
+    return kb;
+}
+
+void phase_end(const char *name) {
+    double end = now();
+    printf("%s %.6f %ld\n", name, end - start, peak_rss());
+    peak_reset();
+    start = now();
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2 && !(argc == 3 && strcmp(argv[1], "-O0") == 0)) {
+        fprintf(stderr, "usage: %s [-O0] <input file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    optimize = argc == 2;
+    char *file = argv[argc - 1];
+
+    peak_reset();
+    start = now();
+    AST *root = prs_lex(file, lex_init(file));
+    phase_end("parse");
+
+    if (optimize)
+        opt_ast(root);
+
+    phase_end("optimize");
+
+    char *code = emit_ast(root);
+    phase_end("emit");
+
+    ast_del(root);
+    free(code);
+    free(constants);
+    free(aliases);
+    return EXIT_SUCCESS;
+}
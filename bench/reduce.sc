@@ -0,0 +1,42 @@
+// Float sum, dot product and sum of squares over the same arrays
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut float x[4096];
+    mut float y[4096];
+    mut float sum = 0.0;
+    mut float dot = 0.0;
+    mut float squares = 0.0;
+
+    for (mut int i = 0; i < 4096; i += 1) {
+        float a = i % 17;
+        float b = i % 13;
+
+        x[i] = a * 0.25;
+        y[i] = b * 0.5 - 2.0;
+    }
+
+    for (mut int round = 0; round < 20000; round += 1) {
+        sum = 0.0;
+        dot = 0.0;
+        squares = 0.0;
+
+        for (mut int i = 0; i < 4096; i += 1)
+            sum = sum + x[i];
+
+        for (mut int i = 0; i < 4096; i += 1)
+            dot = dot + x[i] * y[i];
+
+        for (mut int i = 0; i < 4096; i += 1)
+            squares = squares + y[i] * y[i];
+    }
+
+    // Printed as integers, the sums are exact in single precision
+    int total = sum;
+    int product = dot;
+    int square = squares;
+
+    printf("%d\n", total);
+    printf("%d\n", product);
+    printf("%d\n", square);
+}
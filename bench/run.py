@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""Builds every kernel in bench/ at each optimization level, runs it a number
+of times and records the median runtime and instruction counts as JSON.
+
+    bench/run.py                       write bench/baseline.json
+    bench/run.py -o new.json --compare bench/baseline.json
+
+Each kernel prints a checksum, which has to be the same at every level.
+Instructions retired are counted with `perf stat` where it can be run,
+otherwise they're null. The instructions in the generated assembly are always
+counted. With --compare, the change against an earlier run is printed and the
+exit code is 1 if any kernel got slower than --threshold percent."""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(BENCH)
+
+# Level name and the options it's compiled with
+LEVELS = {
+    "O0": ["-O0"],
+    "O": [],
+}
+
+# Lines of the generated assembly that aren't instructions
+DIRECTIVES = ("section", "extern", "global", "align", "db", "dw", "dd", "dq", "resb", "resd", "resq")
+
+
+def fail(msg):
+    print(f"run.py: error: {msg}", file=sys.stderr)
+    sys.exit(1)
+
+
+def asm_instructions(path):
+    count = 0
+
+    with open(path) as f:
+        for line in f:
+            words = line.split()
+
+            if line.startswith(" ") and words and words[0] not in DIRECTIVES and not words[0].endswith(":"):
+                count += 1
+
+    return count
+
+
+def build(steelc, kernel, opts, tmp):
+    src = os.path.join(BENCH, kernel + ".sc")
+    exe = os.path.join(tmp, kernel)
+    asm_count = None
+
+    # -S writes <kernel>.asm in the working directory, which linking replaces
+    for cmd in ([steelc, *opts, "-S", src], [steelc, *opts, "-lc", src, "-o", exe]):
+        res = subprocess.run(cmd, cwd=tmp, capture_output=True, text=True)
+
+        if res.returncode != 0:
+            fail(f"failed to build {kernel} with '{' '.join(cmd)}':\n{res.stderr}")
+
+        if asm_count is None:
+            asm_count = asm_instructions(exe + ".asm")
+
+    return exe, asm_count
+
+
+def have_perf():
+    if shutil.which("perf") is None:
+        return False
+
+    res = subprocess.run(["perf", "stat", "-x,", "-e", "instructions:u", "true"], capture_output=True, text=True)
+    return res.returncode == 0 and "<not" not in res.stderr
+
+
+def instructions(exe):
+    res = subprocess.run(["perf", "stat", "-x,", "-e", "instructions:u", exe], capture_output=True, text=True)
+
+    for line in res.stderr.splitlines():
+        fields = line.split(",")
+
+        if len(fields) > 2 and fields[2].startswith("instructions") and fields[0].isdigit():
+            return int(fields[0])
+
+    return None
+
+
+def run(exe, runs):
+    times = []
+    out = None
+
+    for _ in range(runs):
+        start = time.perf_counter()
+        res = subprocess.run([exe], capture_output=True, text=True)
+        times.append(time.perf_counter() - start)
+
+        if res.returncode != 0:
+            fail(f"{exe} exited with {res.returncode}")
+
+        if out is not None and res.stdout != out:
+            fail(f"{exe} printed something different between runs")
+
+        out = res.stdout
+
+    return statistics.median(times), out
+
+
+def compare(results, baseline, threshold):
+    slower = 0
+    print(f"{'kernel':<10} {'level':<6} {'median':>10} {'change':>8} {'instrs change':>14}")
+
+    for kernel, levels in results["kernels"].items():
+        for level, now in levels.items():
+            old = baseline.get("kernels", {}).get(kernel, {}).get(level)
+
+            if old is None:
+                print(f"{kernel:<10} {level:<6} {now['median']:>9.4f}s {'new':>8}")
+                continue
+
+            change = (now["median"] - old["median"]) / old["median"] * 100
+            instrs = "-"
+
+            if now["instructions"] is not None and old.get("instructions"):
+                instrs = f"{(now['instructions'] - old['instructions']) / old['instructions'] * 100:+.1f}%"
+
+            mark = ""
+
+            if change > threshold:
+                slower += 1
+                mark = "  slower"
+
+            print(f"{kernel:<10} {level:<6} {now['median']:>9.4f}s {change:>+7.1f}% {instrs:>14}{mark}")
+
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark steelc on the kernels in bench/")
+    parser.add_argument("--steelc", default=os.path.join(ROOT, "steelc"), help="compiler to benchmark")
+    parser.add_argument("--runs", type=int, default=5, help="times each kernel is run")
+    parser.add_argument("--march", action="append", default=[], help="also benchmark the optimized build for this arch")
+    parser.add_argument("-o", "--output", default=os.path.join(BENCH, "baseline.json"), help="where to write the results")
+    parser.add_argument("--compare", help="earlier results to compare against")
+    parser.add_argument("--threshold", type=float, default=10.0, help="percent slower that counts as a regression")
+    parser.add_argument("kernels", nargs="*", help="kernels to run, all of them if none are given")
+    args = parser.parse_args()
+
+    if args.runs < 1:
+        fail("--runs must be at least 1")
+
+    steelc = os.path.abspath(args.steelc)
+    kernels = args.kernels or sorted(f[:-3] for f in os.listdir(BENCH) if f.endswith(".sc"))
+    levels = dict(LEVELS)
+
+    for arch in args.march:
+        levels["O-" + arch] = ["-march=" + arch]
+
+    baseline = None
+
+    # Read first, it may be the file being written
+    if args.compare is not None:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+
+    perf = have_perf()
+    results = {"runs": args.runs, "perf": perf, "kernels": {}}
+
+    with tempfile.TemporaryDirectory(prefix="steelc-bench-") as tmp:
+        for kernel in kernels:
+            if not os.path.exists(os.path.join(BENCH, kernel + ".sc")):
+                fail(f"no such kernel '{kernel}'")
+
+            results["kernels"][kernel] = {}
+            checksum = None
+
+            for level, opts in levels.items():
+                exe, asm_count = build(steelc, kernel, opts, tmp)
+                median, out = run(exe, args.runs)
+
+                if checksum is not None and out != checksum:
+                    fail(f"{kernel} printed {out.split()} at {level} but {checksum.split()} before")
+
+                checksum = out
+                results["kernels"][kernel][level] = {
+                    "median": round(median, 6),
+                    "instructions": instructions(exe) if perf else None,
+                    "asm_instructions": asm_count,
+                    "checksum": out.split(),
+                }
+
+                print(f"{kernel:<10} {level:<6} {median:.4f}s", file=sys.stderr)
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+        f.write("\n")
+
+    if baseline is not None:
+        if compare(results, baseline, args.threshold) > 0:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,49 @@
+// Scans a generated text for words, vowels and a running hash, the way a tokenizer would
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut char text[16384];
+    mut int seed = 7;
+
+    for (mut int i = 0; i < 16384; i += 1) {
+        seed = seed * 75 % 65537;
+
+        if (seed % 6 == 0)
+            text[i] = ' ';
+        else
+            text[i] = 'a' + seed % 26;
+    }
+
+    mut int words = 0;
+    mut int vowels = 0;
+    mut int hash = 0;
+
+    for (mut int round = 0; round < 1000; round += 1) {
+        words = 0;
+        vowels = 0;
+        hash = 0;
+        mut int in_word = 0;
+
+        for (mut int i = 0; i < 16384; i += 1) {
+            char c = text[i];
+
+            if (c == ' ')
+                in_word = 0;
+            else {
+                if (in_word == 0)
+                    words += 1;
+
+                in_word = 1;
+
+                if (c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u')
+                    vowels += 1;
+            }
+
+            hash = (hash * 31 + c) % 1000003;
+        }
+    }
+
+    printf("%d\n", words);
+    printf("%d\n", vowels);
+    printf("%d\n", hash);
+}
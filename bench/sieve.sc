@@ -0,0 +1,25 @@
+// Sieve of Eratosthenes, prints how many primes are below 8192, many times over
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut int composite[8192];
+    mut int count = 0;
+
+    for (mut int round = 0; round < 2000; round += 1) {
+        for (mut int i = 0; i < 8192; i += 1)
+            composite[i] = 0;
+
+        count = 0;
+
+        for (mut int i = 2; i < 8192; i += 1) {
+            if (composite[i] == 0) {
+                count += 1;
+
+                for (mut int j = i * i; j < 8192; j += i)
+                    composite[j] = 1;
+            }
+        }
+    }
+
+    printf("%d\n", count);
+}
@@ -0,0 +1,43 @@
+// Insertion sorts the same 3000 pseudo-random integers ten times, prints the median and how many are in order
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut int data[3000];
+
+    for (mut int round = 0; round < 10; round += 1) {
+        mut int seed = 1;
+
+        for (mut int i = 0; i < 3000; i += 1) {
+            seed = seed * 75 % 65537;
+            data[i] = seed;
+        }
+
+        for (mut int i = 1; i < 3000; i += 1) {
+            int key = data[i];
+            mut int j = i;
+            mut int prev = j - 1;
+
+            while (j > 0 && data[prev] > key) {
+                data[j] = data[prev];
+                j -= 1;
+                prev -= 1;
+            }
+
+            data[j] = key;
+        }
+    }
+
+    mut int ordered = 0;
+
+    for (mut int i = 1; i < 3000; i += 1) {
+        int prev = i - 1;
+
+        if (data[prev] <= data[i])
+            ordered += 1;
+    }
+
+    int median = data[1500];
+
+    printf("%d\n", median);
+    printf("%d\n", ordered);
+}
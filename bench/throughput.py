@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Measures how fast steelc compiles programs from bench/gen.py as they grow.
+
+    bench/throughput.py                write bench/throughput.json
+    bench/throughput.py -o new.json --compare bench/throughput.json
+    bench/throughput.py --scales 1,4,16 --max-exponent 1.3 functions nesting
+
+Each shape of program is generated at every scale and compiled to assembly
+by bench/phases, which reports the seconds and peak resident size of each
+phase. Lines per second are printed for every phase, and how
+fast its time grows with the lines: an exponent of 1 is linear, 2 is
+quadratic. With --compare, the exponents are compared with an earlier run
+and the exit code is 1 if any grew by more than --threshold, which is how
+scaling regressions are caught. With --max-exponent, it's also 1 if any
+phase grows faster than that."""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+BENCH = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(BENCH)
+PHASES = os.path.join(BENCH, "phases")
+
+# The options each shape is generated with at scale k
+SHAPES = {
+    "functions": lambda k: ["--functions", str(100 * k), "--statements", "4", "--depth", "1", "--terms", "4"],
+    "nesting": lambda k: ["--functions", str(4 * k), "--statements", "4", "--depth", "6"],
+    "expressions": lambda k: ["--functions", str(10 * k), "--statements", "10", "--depth", "0", "--terms", "64"],
+    "includes": lambda k: ["--functions", str(40 * k), "--includes", str(10 * k), "--statements", "4", "--depth", "1"],
+}
+
+# Phases taking less than this at the largest scale are too quick to judge
+MIN_SECONDS = 0.05
+
+
+def fail(msg):
+    print(f"throughput.py: error: {msg}", file=sys.stderr)
+    sys.exit(1)
+
+
+def measure(shape, k, optimize, tmp):
+    out = os.path.join(tmp, f"{shape}-{k}")
+    res = subprocess.run([sys.executable, os.path.join(BENCH, "gen.py"), "-o", out, *SHAPES[shape](k)],
+                         capture_output=True, text=True)
+
+    if res.returncode != 0:
+        fail(f"failed to generate {shape} at scale {k}:\n{res.stderr}")
+
+    lines = int(res.stdout)
+    cmd = [PHASES, "main.sc"] if optimize else [PHASES, "-O0", "main.sc"]
+    res = subprocess.run(cmd, cwd=out, capture_output=True, text=True)
+
+    if res.returncode != 0:
+        fail(f"failed to compile {shape} at scale {k}:\n{res.stderr}")
+
+    phases = {}
+
+    for line in res.stdout.splitlines():
+        name, seconds, rss = line.split()
+        phases[name] = {"seconds": float(seconds), "peak_kb": int(rss)}
+
+    return {"scale": k, "lines": lines, "phases": phases}
+
+
+def exponent(small, large, phase):
+    t0 = small["phases"][phase]["seconds"]
+    t1 = large["phases"][phase]["seconds"]
+
+    if t1 < MIN_SECONDS or t0 <= 0:
+        return None
+
+    return math.log(t1 / t0) / math.log(large["lines"] / small["lines"])
+
+
+def compare(results, baseline, threshold):
+    worse = 0
+    print(f"{'shape':<12} {'phase':<9} {'exponent':>8} {'before':>8}")
+
+    for shape, result in results.items():
+        for phase, e in result["exponents"].items():
+            old = baseline.get(shape, {}).get("exponents", {}).get(phase)
+
+            # Too quick to judge in one of the runs
+            if e is None or old is None:
+                continue
+
+            mark = ""
+
+            if e - old > threshold:
+                worse += 1
+                mark = "  grows faster"
+
+            print(f"{shape:<12} {phase:<9} {e:>8.2f} {old:>8.2f}{mark}")
+
+    return worse
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure steelc's compile throughput as programs grow")
+    parser.add_argument("--scales", default="1,2,4", help="comma separated sizes to generate each shape at")
+    parser.add_argument("--max-exponent", type=float, help="fastest growth a phase may have")
+    parser.add_argument("-O0", dest="optimize", action="store_false", help="compile without optimizations")
+    parser.add_argument("-o", "--output", default=os.path.join(BENCH, "throughput.json"), help="where to write the measurements")
+    parser.add_argument("--compare", help="earlier measurements to compare against")
+    parser.add_argument("--threshold", type=float, default=0.3, help="growth in an exponent that counts as a regression")
+    parser.add_argument("shapes", nargs="*", help=f"shapes to measure ({', '.join(SHAPES)}), all if none are given")
+    args = parser.parse_args()
+
+    try:
+        scales = sorted(set(int(k) for k in args.scales.split(",")))
+    except ValueError:
+        fail(f"invalid scales '{args.scales}'")
+
+    if len(scales) < 2 or scales[0] < 1:
+        fail("there have to be at least two scales, all of them positive")
+
+    for shape in args.shapes:
+        if shape not in SHAPES:
+            fail(f"no such shape '{shape}'")
+
+    baseline = None
+
+    # Read first, it may be the file being written
+    if args.compare is not None:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+
+    res = subprocess.run(["make", "-s", "bench/phases"], cwd=ROOT)
+
+    if res.returncode != 0:
+        fail("failed to build bench/phases")
+
+    results = {}
+    too_fast = 0
+
+    with tempfile.TemporaryDirectory(prefix="steelc-throughput-") as tmp:
+        for shape in args.shapes or SHAPES:
+            runs = [measure(shape, k, args.optimize, tmp) for k in scales]
+            results[shape] = {"runs": runs, "exponents": {}}
+
+            print(f"{shape}:")
+            print(f"  {'lines':>8} {'phase':<9} {'lines/s':>12} {'peak kB':>9}")
+
+            for run in runs:
+                for phase, m in run["phases"].items():
+                    rate = run["lines"] / m["seconds"] if m["seconds"] > 0 else math.inf
+                    print(f"  {run['lines']:>8} {phase:<9} {rate:>12.0f} {m['peak_kb']:>9}")
+
+            for phase in runs[0]["phases"]:
+                e = exponent(runs[0], runs[-1], phase)
+                results[shape]["exponents"][phase] = e
+
+                if e is None:
+                    continue
+
+                mark = ""
+
+                if args.max_exponent is not None and e > args.max_exponent:
+                    too_fast += 1
+                    mark = f"  grows faster than {args.max_exponent}"
+
+                print(f"  {phase} grows with exponent {e:.2f}{mark}")
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+        f.write("\n")
+
+    if baseline is not None and compare(results, baseline, args.threshold) > 0:
+        too_fast += 1
+
+    if too_fast > 0:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,41 @@
+#include "report.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* steelc is linked with --wrap for these, so the allocations the compiler
+ * makes go through here first to be counted for -fmem-report. Those libc
+ * makes for itself, like the buffers of fopen or getcwd(NULL, 0), don't
+ * and aren't counted. The library isn't wrapped, as the programs using it
+ * may not want that. */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *str);
+char *__real_strndup(const char *str, size_t n);
+
+void *__wrap_malloc(size_t size) {
+    phase_alloc(size);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    phase_alloc(n * size);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    phase_alloc(size);
+    return __real_realloc(ptr, size);
+}
+
+// libc allocates these copies itself, without calling malloc through the wrapper
+char *__wrap_strdup(const char *str) {
+    phase_alloc(strlen(str) + 1);
+    return __real_strdup(str);
+}
+
+char *__wrap_strndup(const char *str, size_t n) {
+    phase_alloc(strnlen(str, n) + 1);
+    return __real_strndup(str, n);
+}
@@ -1,4 +1,5 @@
 #include "ast.h"
+#include "state.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,17 +26,31 @@ const char *ast_types[] = {
     [AST_DEREF] = "dereference",
     [AST_REF] = "reference",
     [AST_INC] = "include",
-    [AST_EXPR] = "expression"
+    [AST_EXPR] = "expression",
+    [AST_HREDUCE] = "horizontal reduction"
 };
 
+// The nodes made while tracking, so the ones a failed parse never attached can be freed
+THREAD_LOCAL AST **tracked = NULL;
+THREAD_LOCAL size_t tracked_cnt = 0;
+THREAD_LOCAL bool tracking = false;
+
 AST *ast_init(ASTType type, char *scope_def, char *func_def, size_t ln, size_t col) {
-    AST *ast = malloc(sizeof(AST));
+    // Zeroed, so a node left half built by an error can still be freed
+    AST *ast = calloc(1, sizeof(AST));
     ast->type = type;
     ast->scope_def = strdup(scope_def);
     ast->func_def = strdup(func_def);
     ast->ln = ln;
     ast->col = col;
     ast->active = true;
+
+    if (tracking) {
+        tracked = realloc(tracked, (tracked_cnt + 1) * sizeof(AST *));
+        tracked[tracked_cnt++] = ast;
+        ast->tracked = tracked_cnt;
+    }
+
     return ast;
 }
 
@@ -160,13 +175,76 @@ void ast_fields_del(AST *ast) {
         case AST_EXPR:
             ast_del(ast->expr.value);
             break;
+        case AST_HREDUCE:
+            free(ast->hreduce.name);
+            ast_del(ast->hreduce.value);
+            break;
         default: break;
     }
 }
 
 void ast_del(AST *ast) {
+    if (ast == NULL)
+        return;
+
+    if (ast->tracked > 0) {
+        // The last one takes its place
+        AST *last = tracked[--tracked_cnt];
+        tracked[ast->tracked - 1] = last;
+        last->tracked = ast->tracked;
+    }
+
     ast_fields_del(ast);
     free(ast->scope_def);
     free(ast->func_def);
     free(ast);
-}
\ No newline at end of file
+}
+
+void ast_track(void) {
+    tracking = true;
+}
+
+// The tracked nodes are all held by the tree parsed now
+void ast_untrack(void) {
+    for (size_t i = 0; i < tracked_cnt; i++)
+        tracked[i]->tracked = 0;
+
+    free(tracked);
+    tracked = NULL;
+    tracked_cnt = 0;
+    tracking = false;
+}
+
+// Frees the tracked nodes still left once whatever held the rest freed them
+void ast_tracked_del(void) {
+    // Each is freed on its own, so none may free its children
+    for (size_t i = 0; i < tracked_cnt; i++) {
+        AST *ast = tracked[i];
+
+        switch (ast->type) {
+            case AST_ROOT: ast->root.asts_cnt = 0; break;
+            case AST_FUNC: ast->func.params_cnt = ast->func.body_cnt = 0; break;
+            case AST_CALL: ast->call.args_cnt = 0; break;
+            case AST_ASSIGN: ast->assign.value = NULL; break;
+            case AST_RET: ast->ret.value = NULL; break;
+            case AST_MATH: ast->math.expr_cnt = 0; break;
+            case AST_IF_ELSE: ast->if_else.exprs_cnt = ast->if_else.body_cnt = ast->if_else.else_body_cnt = 0; break;
+            case AST_WHILE: ast->while_.exprs_cnt = ast->while_.body_cnt = 0; break;
+            case AST_FOR:
+                ast->for_.init = ast->for_.math = NULL;
+                ast->for_.cond_cnt = ast->for_.body_cnt = 0;
+                break;
+            case AST_SUBSCR: ast->subscr.index = ast->subscr.value = NULL; break;
+            case AST_ARR_LST: ast->arr_lst.items_cnt = 0; break;
+            case AST_DEREF: ast->deref.value = NULL; break;
+            case AST_EXPR: ast->expr.value = NULL; break;
+            case AST_HREDUCE: ast->hreduce.value = NULL; break;
+            default: break;
+        }
+    }
+
+    while (tracked_cnt > 0)
+        ast_del(tracked[tracked_cnt - 1]);
+
+    ast_untrack();
+}
@@ -26,7 +26,8 @@ typedef enum {
     AST_DEREF,
     AST_REF,
     AST_INC,
-    AST_EXPR
+    AST_EXPR,
+    AST_HREDUCE
 } ASTType;
 
 typedef struct AST AST;
@@ -38,6 +39,8 @@ typedef struct AST {
     size_t ln;
     size_t col;
     bool active;
+    // Its place in the tracked nodes plus one, or 0 when it isn't tracked
+    size_t tracked;
 
     union {
         struct {
@@ -62,6 +65,8 @@ typedef struct AST {
             AST *ret;
             size_t params_cnt;
             size_t body_cnt;
+            bool ext;
+            bool exported;
         } func;
 
         struct {
@@ -151,11 +156,19 @@ typedef struct AST {
         struct {
             AST *value;
         } expr;
+
+        struct {
+            char *name;
+            AST *value;
+        } hreduce;
     };
 } AST;
 
 AST *ast_init(ASTType type, char *scope_def, char *func_def, size_t ln, size_t col);
 void ast_fields_del(AST *ast);
 void ast_del(AST *ast);
+void ast_track(void);
+void ast_untrack(void);
+void ast_tracked_del(void);
 
 #endif
\ No newline at end of file
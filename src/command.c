@@ -0,0 +1,23 @@
+#include "command.h"
+#include <spawn.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// Runs argv[0], looked up in PATH, without a shell and waits for it, true if it exited with 0
+bool command_run(char **argv) {
+    pid_t pid;
+
+    if (posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+        return false;
+
+    int status;
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
@@ -0,0 +1,8 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdbool.h>
+
+bool command_run(char **argv);
+
+#endif
@@ -1,22 +1,29 @@
 #include "emit.h"
 #include "ast.h"
 #include "parser.h"
+#include "opt.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <assert.h>
 #include <errno.h>
 
-#define SUB_RSP_SIZE (size_t)32
+#define RED_ZONE_SIZE (size_t)128
+#define INT_PARAMS (size_t)6
+#define FLOAT_PARAMS (size_t)8
+#define FAST_INT_PARAMS (size_t)11
+#define FAST_FLOAT_PARAMS (size_t)16
+#define BLOCK_COPY_SIZE (size_t)64
 
 extern const char *ast_types[];
-extern AST **sym_tab;
-extern size_t sym_cnt;
-extern Const **constants;
-extern size_t constants_cnt;
-extern Alias **aliases;
-extern size_t aliases_cnt;
+extern THREAD_LOCAL AST **sym_tab;
+extern THREAD_LOCAL size_t sym_cnt;
+extern THREAD_LOCAL Const **constants;
+extern THREAD_LOCAL size_t constants_cnt;
+extern THREAD_LOCAL Alias **aliases;
+extern THREAD_LOCAL size_t aliases_cnt;
 
 enum {
     RAX,
@@ -29,7 +36,13 @@ enum {
     RBP,
     R8,
     R9,
-    XMM
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
+    XMM,
+    YMM
 };
 
 enum {
@@ -57,39 +70,110 @@ const char *regs[][16] = {
     [RBP] = { "rbp", "ebp", "bp", "bpl" },
     [R8] = { "r8", "r8d", "r8w", "r8b" },
     [R9] = { "r9", "r9d", "r9w", "r9b" },
-    [XMM] = { "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15" }
+    [R11] = { "r11", "r11d", "r11w", "r11b" },
+    [R12] = { "r12", "r12d", "r12w", "r12b" },
+    [R13] = { "r13", "r13d", "r13w", "r13b" },
+    [R14] = { "r14", "r14d", "r14w", "r14b" },
+    [R15] = { "r15", "r15d", "r15w", "r15b" },
+    [XMM] = { "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15" },
+    [YMM] = { "ymm0", "ymm1", "ymm2", "ymm3", "ymm4", "ymm5", "ymm6", "ymm7", "ymm8", "ymm9", "ymm10", "ymm11", "ymm12", "ymm13", "ymm14", "ymm15" }
 };
 
 const size_t int_params[] = { RDI, RSI, RDX, RCX, R8, R9 };
+const size_t fast_int_params[] = { RDI, RSI, RDX, RCX, R8, R9, R11, R12, R13, R14, R15 };
+const size_t callee_saved[] = { RBX, R12, R13, R14, R15 };
+
+THREAD_LOCAL Arch march = ARCH_SSE4_1;
+
+// Float math may be reassociated, which changes how it rounds
+THREAD_LOCAL bool fast_math = false;
+
+THREAD_LOCAL bool link_libc = false;
+THREAD_LOCAL size_t rsp = 0;
+THREAD_LOCAL bool calls_fast = false;
+THREAD_LOCAL size_t float_cnt = 0;
+THREAD_LOCAL char **float_pool;
+THREAD_LOCAL size_t label_cnt = 0;
+THREAD_LOCAL size_t str_cnt = 0;
+THREAD_LOCAL char **str_pool;
+THREAD_LOCAL size_t arr_cnt = 0;
+THREAD_LOCAL char *sect_data;
+THREAD_LOCAL char *rodata;
+THREAD_LOCAL bool float_math_result = false;
+THREAD_LOCAL char *stack_usage = NULL;
+
+typedef struct {
+    AST *sym;
+    size_t size;
+    size_t align;
+    size_t start;
+    size_t end;
+    size_t depth;
+} Slot;
 
-size_t rsp = 0;
-size_t rsp_cap = 0;
-size_t float_cnt = 0;
-size_t label_cnt = 0;
-size_t str_cnt = 0;
-char *func_data;
-char *sect_data;
-bool float_math_result = false;
+THREAD_LOCAL Slot *slots = NULL;
+THREAD_LOCAL size_t slots_cnt = 0;
+THREAD_LOCAL size_t live_pos = 0;
 
 void globs_reset() {
-    rsp = rsp_cap = float_cnt = label_cnt = str_cnt = 0;
-    func_data = realloc(func_data, 1 * sizeof(char));
-    func_data[0] = '\0';
+    rsp = label_cnt = 0;
+    calls_fast = false;
+    free(slots);
+    slots = NULL;
+    slots_cnt = 0;
+}
+
+void append(char **code, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t len = strlen(*code);
+    size_t add = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    *code = realloc(*code, (len + add + 1) * sizeof(char));
+    va_start(args, fmt);
+    vsprintf(*code + len, fmt, args);
+    va_end(args);
+}
+
+/* Float and string literals are pooled per module in .rodata, so each
+ * distinct value is emitted once. Floats are emitted as their exact bit
+ * pattern rather than printed and parsed back by nasm.
+ */
+size_t pool_find(char **pool, size_t cnt, char *data) {
+    for (size_t i = 0; i < cnt; i++) {
+        if (strcmp(pool[i], data) == 0)
+            return i;
+    }
+
+    return cnt;
 }
 
 size_t float_init(size_t bits, long double value) {
-    char *data = calloc(128, sizeof(char));
+    char data[32];
 
-    if (bits == 32)
-        sprintf(data, ".f%zu:\n"
-                      "    dd %f\n", float_cnt, (float)value);
-    else
-        sprintf(data, ".f%zu:\n"
-                      "    dq %Lf\n", float_cnt, value);
+    if (bits == 32) {
+        float digit = (float)value;
+        unsigned int pattern;
+        memcpy(&pattern, &digit, sizeof(pattern));
+        sprintf(data, "dd 0x%08x", pattern);
+    } else {
+        double digit = (double)value;
+        unsigned long long pattern;
+        memcpy(&pattern, &digit, sizeof(pattern));
+        sprintf(data, "dq 0x%016llx", pattern);
+    }
 
-    func_data = realloc(func_data, (strlen(func_data) + strlen(data) + 1) * sizeof(char));
-    strcat(func_data, data);
-    free(data);
+    size_t label = pool_find(float_pool, float_cnt, data);
+    if (label < float_cnt)
+        return label;
+
+    float_pool = realloc(float_pool, (float_cnt + 1) * sizeof(char *));
+    float_pool[float_cnt] = strdup(data);
+
+    append(&rodata, "    align %zu\n"
+                    "__f%zu:\n"
+                    "    %s\n", bits / 8, float_cnt, data);
     return float_cnt++;
 }
 
@@ -99,9 +183,11 @@ char *label_init() {
     return label;
 }
 
-size_t str_init(char *value) {
+// Bytes of a string literal as a list for db, each followed by a comma
+char *str_bytes(char *value, size_t *len) {
     char *data = calloc(1, sizeof(char));
     char *next;
+    *len = 0;
 
     for (size_t i = 0; i < strlen(value); i++) {
         next = calloc(16, sizeof(char));
@@ -137,16 +223,27 @@ size_t str_init(char *value) {
         data = realloc(data, (strlen(data) + strlen(next) + 1) * sizeof(char));
         strcat(data, next);
         free(next);
+        (*len)++;
     }
 
-    char *str = calloc(strlen(data) + 64, sizeof(char));
-    sprintf(str, ".s%zu:\n"
-                 "    db %s0\n", str_cnt, data);
-    free(data);
+    return data;
+}
+
+size_t str_init(char *value) {
+    size_t len;
+    char *data = str_bytes(value, &len);
 
-    func_data = realloc(func_data, (strlen(func_data) + strlen(str) + 1) * sizeof(char));
-    strcat(func_data, str);
-    free(str);
+    size_t label = pool_find(str_pool, str_cnt, data);
+    if (label < str_cnt) {
+        free(data);
+        return label;
+    }
+
+    str_pool = realloc(str_pool, (str_cnt + 1) * sizeof(char *));
+    str_pool[str_cnt] = data;
+
+    append(&rodata, "__s%zu:\n"
+                    "    db %s0\n", str_cnt, data);
     return str_cnt++;
 }
 
@@ -171,7 +268,6 @@ char *emit_arr(AST **arr, size_t cnt, bool fix_rbp) {
     char *code = calloc(1, sizeof(char));
     char *next;
     size_t beg_rsp = rsp;
-    size_t beg_cap = rsp_cap;
 
     for (size_t i = 0; i < cnt; i++) {
         next = emit_ast(arr[i]);
@@ -180,26 +276,41 @@ char *emit_arr(AST **arr, size_t cnt, bool fix_rbp) {
         free(next);
     }
 
-    if (rsp != beg_rsp && fix_rbp) {
-        char *temp = calloc(strlen(code) + 128, sizeof(char));
-        sprintf(temp, "%s    add rsp, %zu\n", code, rsp - beg_rsp);
-        free(code);
-        code = temp;
-
+    // Slots of a finished block are reused by the next one, the frame
+    // itself is sized once in emit_func()
+    if (fix_rbp)
         rsp = beg_rsp;
-        rsp_cap = beg_cap;
-    }
 
     return code;
 }
 
+// Frees the pools of the emitter and starts its counts over
+void emit_reset(void) {
+    for (size_t i = 0; i < float_cnt; i++)
+        free(float_pool[i]);
+
+    for (size_t i = 0; i < str_cnt; i++)
+        free(str_pool[i]);
+
+    free(sect_data);
+    free(rodata);
+    free(float_pool);
+    free(str_pool);
+    sect_data = rodata = NULL;
+    float_pool = str_pool = NULL;
+    float_cnt = str_cnt = arr_cnt = live_pos = 0;
+    float_math_result = false;
+    globs_reset();
+}
+
 char *emit_root(AST *ast) {
-    char *code = strdup("    section .text\n"
-                        "    global main_\n");
+    char *code = strdup("    section .text\n");
     char *next;
 
-    func_data = calloc(1, sizeof(char));
     sect_data = calloc(1, sizeof(char));
+    rodata = calloc(1, sizeof(char));
+    float_pool = calloc(1, sizeof(char *));
+    str_pool = calloc(1, sizeof(char *));
 
     for (size_t i = 0; i < ast->root.asts_cnt; i++) {
         next = emit_ast(ast->root.asts[i]);
@@ -208,15 +319,21 @@ char *emit_root(AST *ast) {
         free(next);
     }
 
+    if (strlen(rodata) > 0) {
+        code = realloc(code, (strlen(code) + strlen(rodata) + 32) * sizeof(char));
+        strcat(code, "    section .rodata\n");
+        strcat(code, rodata);
+    }
+
     if (strlen(sect_data) > 1) {
         code = realloc(code, (strlen(code) + strlen(sect_data) + 32) * sizeof(char));
         strcat(code, "    section .data\n");
         strcat(code, sect_data);
     }
 
-    free(func_data);
-    free(sect_data);
+    emit_reset();
     free(sym_tab);
+    sym_tab = NULL;
     sym_cnt = 0;
 
     for (size_t i = 0; i < constants_cnt; i++) {
@@ -236,63 +353,352 @@ char *emit_root(AST *ast) {
     return code;
 }
 
+// Lowest rbp offset used by the emitted code
+size_t frame_size(const char *code) {
+    size_t size = 0;
+    size_t offset;
+
+    while ((code = strstr(code, "[rbp-")) != NULL) {
+        code += 5;
+        offset = strtoul(code, NULL, 10);
+
+        if (offset > size)
+            size = offset;
+    }
+
+    return size;
+}
+
+char *str_replace(char *code, const char *old, const char *new) {
+    size_t cnt = 0;
+
+    for (char *pos = strstr(code, old); pos != NULL; pos = strstr(pos + strlen(old), old))
+        cnt++;
+
+    if (cnt == 0)
+        return code;
+
+    char *out = calloc(strlen(code) + cnt * strlen(new) + 1, sizeof(char));
+    char *src = code;
+    char *pos;
+
+    while ((pos = strstr(src, old)) != NULL) {
+        strncat(out, src, pos - src);
+        strcat(out, new);
+        src = pos + strlen(old);
+    }
+
+    strcat(out, src);
+    free(code);
+    return out;
+}
+
+size_t var_size(AST *sym) {
+    char *type = strdup(sym->assign.type);
+    size_t cnt = 1;
+    size_t size;
+
+    if (sym->assign.arr_cap > 0) {
+        type[strlen(type) - 1] = '\0';
+        cnt = sym->assign.arr_cap;
+    }
+
+    if (strcmp(type, "char") == 0)
+        size = cnt * 1;
+    else if (strcmp(type, "int") == 0 || strcmp(type, "float") == 0)
+        size = cnt * 4;
+    else if (is_vec_type(type))
+        size = cnt * vec_lanes(type) * 4;
+    else
+        size = cnt * 8;
+
+    free(type);
+    return size;
+}
+
+/* Stack slots are assigned per function from the live ranges of its
+ * variables. Every node of the body gets a position in source order, a
+ * variable lives from its declaration to its last use, and a variable
+ * used inside a loop lives until the end of that loop. Variables whose
+ * ranges don't overlap may share the same bytes of the frame. */
+Slot *slot_find(AST *sym) {
+    for (size_t i = 0; i < slots_cnt; i++) {
+        if (slots[i].sym == sym)
+            return &slots[i];
+    }
+
+    return NULL;
+}
+
+void live_use(AST *ast, char *name, bool escapes) {
+    AST *sym = sym_find(AST_ASSIGN, ast->scope_def, name);
+    Slot *slot;
+
+    if (sym == NULL || (slot = slot_find(sym)) == NULL)
+        return;
+
+    // Anything that may hold the address keeps the slot alive for good
+    if (escapes)
+        slot->end = (size_t)-1;
+    else if (live_pos > slot->end)
+        slot->end = live_pos;
+}
+
+void live_walk(AST **arr, size_t cnt);
+
+void live_node(AST *ast) {
+    if (ast == NULL)
+        return;
+
+    live_pos++;
+
+    switch (ast->type) {
+        case AST_VAR: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
+            live_use(ast, ast->var.name, sym != NULL && sym->assign.arr_cap > 0);
+            break;
+        }
+        case AST_CALL: live_walk(ast->call.args, ast->call.args_cnt); break;
+        case AST_ASSIGN:
+            if (ast->assign.type != NULL) {
+                slots = realloc(slots, (slots_cnt + 1) * sizeof(Slot));
+                Slot *slot = &slots[slots_cnt++];
+                slot->sym = ast;
+                slot->size = var_size(ast);
+                slot->start = slot->end = live_pos;
+                slot->depth = 0;
+
+                if (slot->size >= 16)
+                    slot->align = 16;
+                else if (ast->assign.arr_cap > 0)
+                    slot->align = slot->size / ast->assign.arr_cap;
+                else
+                    slot->align = slot->size;
+            } else
+                live_use(ast, ast->assign.name, false);
+
+            live_node(ast->assign.value);
+            break;
+        case AST_RET: live_node(ast->ret.value); break;
+        case AST_MATH: live_walk(ast->math.expr, ast->math.expr_cnt); break;
+        case AST_IF_ELSE:
+            live_walk(ast->if_else.exprs, ast->if_else.exprs_cnt);
+            live_walk(ast->if_else.body, ast->if_else.body_cnt);
+
+            if (ast->if_else.else_body != NULL)
+                live_walk(ast->if_else.else_body, ast->if_else.else_body_cnt);
+            break;
+        case AST_WHILE:
+        case AST_FOR: {
+            if (ast->type == AST_FOR)
+                live_node(ast->for_.init);
+
+            size_t beg = live_pos;
+
+            if (ast->type == AST_FOR) {
+                live_walk(ast->for_.cond, ast->for_.cond_cnt);
+                live_walk(ast->for_.body, ast->for_.body_cnt);
+                live_node(ast->for_.math);
+            } else {
+                live_walk(ast->while_.exprs, ast->while_.exprs_cnt);
+                live_walk(ast->while_.body, ast->while_.body_cnt);
+            }
+
+            // The next iteration reads again what the loop used from outside
+            for (size_t i = 0; i < slots_cnt; i++) {
+                if (slots[i].start <= beg && slots[i].end > beg && slots[i].end < live_pos)
+                    slots[i].end = live_pos;
+            }
+            break;
+        }
+        case AST_SUBSCR:
+            live_use(ast, ast->subscr.name, false);
+            live_node(ast->subscr.index);
+            live_node(ast->subscr.value);
+            break;
+        case AST_ARR_LST: live_walk(ast->arr_lst.items, ast->arr_lst.items_cnt); break;
+        case AST_DEREF:
+            live_use(ast, ast->deref.name, false);
+            live_node(ast->deref.value);
+            break;
+        case AST_REF: live_use(ast, ast->ref.name, true); break;
+        case AST_EXPR: live_node(ast->expr.value); break;
+        case AST_HREDUCE:
+            live_use(ast, ast->hreduce.name, false);
+            live_node(ast->hreduce.value);
+            break;
+        default: break;
+    }
+}
+
+void live_walk(AST **arr, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++)
+        live_node(arr[i]);
+}
+
+// Packs the slots first-fit by declaration order, returns the frame size they need
+size_t slots_assign(AST *func) {
+    size_t size = 0;
+
+    live_pos = 0;
+    live_walk(func->func.params, func->func.params_cnt);
+    live_walk(func->func.body, func->func.body_cnt);
+
+    for (size_t i = 0; i < slots_cnt; i++) {
+        Slot *slot = &slots[i];
+        size_t depth = (slot->size + slot->align - 1) / slot->align * slot->align;
+        bool moved = true;
+
+        while (moved) {
+            moved = false;
+
+            for (size_t j = 0; j < i; j++) {
+                Slot *other = &slots[j];
+
+                if (other->start > slot->end || slot->start > other->end)
+                    continue;
+                else if (depth - slot->size >= other->depth || other->depth - other->size >= depth)
+                    continue;
+
+                depth = (other->depth + slot->size + slot->align - 1) / slot->align * slot->align;
+                moved = true;
+            }
+        }
+
+        slot->depth = depth;
+
+        if (depth > size)
+            size = depth;
+    }
+
+    return size;
+}
+
+char *slot_rbp(AST *sym) {
+    Slot *slot = slot_find(sym);
+    char *rbp = calloc(32, sizeof(char));
+
+    if (slot != NULL)
+        sprintf(rbp, "[rbp-%zu]", slot->depth);
+    else {
+        rsp += var_size(sym);
+        sprintf(rbp, "[rbp-%zu]", rsp);
+    }
+
+    return rbp;
+}
+
+/* Every caller of a function that isn't extern, exported or main is
+ * compiled together with it, so those use a faster convention than System
+ * V: 11 integer and 16 float argument registers and no callee-saved
+ * registers, as callers never keep values in registers across a call. */
+bool is_fast_func(AST *func) {
+    return !func->func.ext && !func->func.exported && strcmp(func->func.name, "main") != 0;
+}
+
+size_t int_params_cnt(AST *func) {
+    return is_fast_func(func) ? FAST_INT_PARAMS : INT_PARAMS;
+}
+
+size_t float_params_cnt(AST *func) {
+    return is_fast_func(func) ? FAST_FLOAT_PARAMS : FLOAT_PARAMS;
+}
+
+size_t int_param(AST *func, size_t i) {
+    return is_fast_func(func) ? fast_int_params[i] : int_params[i];
+}
+
+// Turns rbp based addresses into rsp based ones for a function that
+// allocated frame bytes without pushing rbp
+char *rebase_rsp(char *code, size_t frame) {
+    char *out = calloc(1, sizeof(char));
+    char *src = code;
+    char *pos;
+
+    while ((pos = strstr(src, "[rbp")) != NULL && (pos[4] == '-' || pos[4] == '+')) {
+        char *end;
+        long offset = strtol(pos + 5, &end, 10);
+        offset = pos[4] == '-' ? (long)frame - offset : (long)frame + offset - 8;
+
+        append(&out, "%.*s[rsp", (int)(pos - src), src);
+
+        if (offset != 0)
+            append(&out, "%c%ld", offset < 0 ? '-' : '+', offset < 0 ? -offset : offset);
+
+        src = end;
+    }
+
+    append(&out, "%s", src);
+    free(code);
+    return out;
+}
+
+const char *func_exit(char *name) {
+    if (strcmp(name, "main") != 0)
+        return "    ret\n";
+    else if (link_libc)
+        return "    xor eax, eax\n"
+               "    ret\n";
+
+    return "    mov rax, 60\n"
+           "    xor rdi, rdi\n"
+           "    syscall\n";
+}
+
 char *emit_func(AST *ast) {
-    const char template[] = "%s_:\n"
-                            "    push rbp\n"
-                            "    mov rbp, rsp\n"
+    const char template[] = "%s%s_:\n"
                             "%s"
                             "%s"
                             "%s";
 
+    if (ast->func.ext) {
+        char *code = calloc(strlen(ast->func.name) + 32, sizeof(char));
+        sprintf(code, "    extern %s\n", ast->func.name);
+        return code;
+    }
+
     char *params = calloc(1, sizeof(char));
 
+    // Spills and other scratch slots go below the variables
+    rsp = slots_assign(ast);
+
     if (ast->func.params_cnt > 0) {
         AST *param;
         char *next;
         char *rbp;
         size_t ints = 0;
         size_t floats = 0;
+        size_t stack = 16;
 
         for (size_t i = 0; i < ast->func.params_cnt; i++) {
             param = ast->func.params[i];
-            rbp = calloc(32, sizeof(char));
+            rbp = slot_rbp(param);
             next = calloc(128, sizeof(char));
-
-            if (strcmp(param->assign.type, "char") == 0) {
-                sprintf(rbp, "[rbp-%zu]", ++rsp);
-
-                if (ints > 5)
+            char *reg = NULL;
+
+            if (strcmp(param->assign.type, "float") == 0) {
+                if (floats < float_params_cnt(ast))
+                    reg = (char *)regs[XMM][floats++];
+            } else if (ints < int_params_cnt(ast))
+                reg = (char *)regs[int_param(ast, ints++)][strcmp(param->assign.type, "char") == 0 ? BYTE : strcmp(param->assign.type, "int") == 0 ? DWORD : QWORD];
+
+            if (reg != NULL && strcmp(param->assign.type, "float") == 0)
+                sprintf(next, "    movss dword %s, %s\n", rbp, reg);
+            else if (reg != NULL)
+                sprintf(next, "    mov %s %s, %s\n", strcmp(param->assign.type, "char") == 0 ? "byte" : strcmp(param->assign.type, "int") == 0 ? "dword" : "qword", rbp, reg);
+            else {
+                // Passed on the stack above the return address, 8 bytes each
+                if (strcmp(param->assign.type, "char") == 0)
                     sprintf(next, "    mov al, byte [rbp+%zu]\n"
-                                  "    mov byte %s, al\n", (ints - 4) * 8, rbp);
-                else
-                    sprintf(next, "    mov byte %s, %s\n", rbp, regs[int_params[ints++]][BYTE]);
-            } else if (strcmp(param->assign.type, "int") == 0) {
-                rsp += 4;
-                sprintf(rbp, "[rbp-%zu]", rsp);
-
-                if (ints > 5)
-                    sprintf(next, "    mov eax, dword [rbp+%zu]\n"
-                                  "    mov dword %s, eax\n", (ints - 4) * 8, rbp);
-                else
-                    sprintf(next, "    mov dword %s, %s\n", rbp, regs[int_params[ints++]][DWORD]);
-            } else if (strcmp(param->assign.type, "float") == 0) {
-                rsp += 4;
-                sprintf(rbp, "[rbp-%zu]", rsp);
-
-                if (floats > 14)
+                                  "    mov byte %s, al\n", stack, rbp);
+                else if (strcmp(param->assign.type, "int") == 0 || strcmp(param->assign.type, "float") == 0)
                     sprintf(next, "    mov eax, dword [rbp+%zu]\n"
-                                  "    mov dword %s, eax\n", (ints - 4) * 8, rbp);
+                                  "    mov dword %s, eax\n", stack, rbp);
                 else
-                    sprintf(next, "    movss dword %s, %s\n", rbp, regs[XMM][++floats]);
-            } else {
-                rsp += 8;
-                sprintf(rbp, "[rbp-%zu]", rsp);
-
-                if (ints > 5)
                     sprintf(next, "    mov rax, qword [rbp+%zu]\n"
-                                  "    mov qword %s, rax\n", (ints - 4) * 8, rbp);
-                else
-                    sprintf(next, "    mov qword %s, %s\n", rbp, regs[int_params[ints++]][QWORD]);
+                                  "    mov qword %s, rax\n", stack, rbp);
+
+                stack += 8;
             }
 
             param->assign.rbp = rbp;
@@ -302,35 +708,104 @@ char *emit_func(AST *ast) {
             free(next);
         }
 
-        while (rsp > rsp_cap)
-            rsp_cap += SUB_RSP_SIZE;
-
-        char *temp = calloc(strlen(params) + 64, sizeof(char));
-        sprintf(temp, "    sub rsp, %zu\n%s", rsp_cap, params);
-        free(params);
-        params = temp;
     }
 
     char *body = emit_arr(ast->func.body, ast->func.body_cnt, false);
 
-    if (ast->func.ret == NULL) {
-        body = realloc(body, (strlen(body) + 64) * sizeof(char));
+    if (ast->func.ret == NULL)
+        append(&body, "    leave\n%s", func_exit(ast->func.name));
 
-        if (rsp > 0)
-            strcat(body, "    leave\n");
-        else
-            strcat(body, "    pop rbp\n");
+    size_t frame = frame_size(params);
+
+    if (frame_size(body) > frame)
+        frame = frame_size(body);
+
+    // Only System V functions that return have to preserve the callee-saved
+    // registers; calling a fast function may clobber any of them
+    if (!is_fast_func(ast) && (strcmp(ast->func.name, "main") != 0 || link_libc)) {
+        for (size_t i = 0; i < sizeof(callee_saved) / sizeof(callee_saved[0]); i++) {
+            const char *reg = regs[callee_saved[i]][QWORD];
+
+            if (!calls_fast && strstr(body, callee_saved[i] == RBX ? "bx" : reg) == NULL && strstr(params, reg) == NULL)
+                continue;
+
+            frame = (frame + 15) & ~(size_t)7;
+
+            char *save = calloc(strlen(params) + 64, sizeof(char));
+            sprintf(save, "    mov qword [rbp-%zu], %s\n%s", frame, reg, params);
+            free(params);
+            params = save;
+
+            char restore[64];
+            sprintf(restore, "    mov %s, qword [rbp-%zu]\n    leave\n", reg, frame);
+            body = str_replace(body, "    leave\n", restore);
+        }
+    }
+
+    char *prologue = calloc(128, sizeof(char));
+    bool leaf = strstr(body, "call ") == NULL && strstr(body, "push ") == NULL && strstr(body, "pop ") == NULL && strstr(body, "rsp") == NULL;
+    size_t alloc;
+
+    if (leaf && frame <= RED_ZONE_SIZE) {
+        // Leaf functions address their locals through the red zone below rsp,
+        // so they need neither a frame pointer nor a sub rsp
+        alloc = 0;
+        params = rebase_rsp(params, 0);
+        body = rebase_rsp(body, 0);
+        body = str_replace(body, "    leave\n", "");
+    } else if (is_fast_func(ast) && strstr(body, "rsp") == NULL) {
+        // Nothing moves rsp inside the body, so locals can be addressed from
+        // rsp and rbp is never set up. The return address leaves rsp at 8
+        // modulo 16, so the frame is too to keep calls aligned.
+        alloc = ((frame + 7) & ~(size_t)15) + 8;
+        sprintf(prologue, "    sub rsp, %zu\n", alloc);
+        params = rebase_rsp(params, alloc);
+        body = rebase_rsp(body, alloc);
+
+        char epilogue[64];
+        sprintf(epilogue, "    add rsp, %zu\n", alloc);
+        body = str_replace(body, "    leave\n", epilogue);
+    } else {
+        // Keep rsp 16-byte aligned at every call made from this frame
+        frame = (frame + 15) & ~(size_t)15;
+        alloc = frame + 8;
 
-        if (strcmp(ast->func.name, "main") == 0)
-            strcat(body, "    mov rax, 60\n"
-                         "    xor rdi, rdi\n"
-                         "    syscall\n");
+        strcpy(prologue, "    push rbp\n"
+                         "    mov rbp, rsp\n");
+
+        // The kernel enters main_ with an aligned rsp instead of a call
+        if (strcmp(ast->func.name, "main") == 0 && !link_libc)
+            strcat(prologue, "    and rsp, -16\n");
+
+        if (frame > 0)
+            sprintf(prologue + strlen(prologue), "    sub rsp, %zu\n", frame);
         else
-            strcat(body, "    ret\n");
+            body = str_replace(body, "    leave\n", "    pop rbp\n");
+    }
+
+    if (stack_usage != NULL) {
+        // Same layout as gcc's -fstack-usage, the file name is added by main()
+        size_t usage = alloc + 8;
+        bool dynamic = strstr(body, "push ") != NULL || strstr(body, "sub rsp") != NULL;
+
+        append(&stack_usage, "%zu:%zu:%s\t%zu\t%s\n", ast->ln, ast->col, ast->func.name, usage, dynamic ? "dynamic,bounded" : "static");
     }
 
-    char *code = calloc(strlen(template) + strlen(ast->func.name) + strlen(params) + strlen(body) + strlen(func_data) + 1, sizeof(char));
-    sprintf(code, template, ast->func.name, params, body, func_data);
+    // The C runtime calls main, the rest of the program calls main_
+    char label[256] = "";
+
+    if (strcmp(ast->func.name, "main") == 0 && link_libc)
+        strcpy(label, "    global main\n"
+                      "    global main_\n"
+                      "main:\n");
+    else if (strcmp(ast->func.name, "main") == 0)
+        strcpy(label, "    global main_\n");
+    else if (ast->func.exported)
+        sprintf(label, "    global %s\n%s:\n", ast->func.name, ast->func.name);
+
+    char *code = calloc(strlen(template) + strlen(label) + strlen(ast->func.name) + strlen(prologue) + strlen(params) + strlen(body) + 1, sizeof(char));
+    sprintf(code, template, label, ast->func.name, prologue, params, body);
+    free(prologue);
     free(params);
     free(body);
 
@@ -366,10 +841,10 @@ char *emit_call_arg(AST *ast, char *param_type, char *loc, bool on_stack) {
             code = calloc(strlen(loc) + 64, sizeof(char));
 
             if (on_stack)
-                sprintf(code, "    movss xmm0, dword [.f%zu]\n"
+                sprintf(code, "    movss xmm0, dword [__f%zu]\n"
                               "    movss dword %s, xmm0\n", float_init(32, ast->data.digit), loc);
             else
-                sprintf(code, "    movss %s, dword [.f%zu]\n", loc, float_init(32, ast->data.digit));
+                sprintf(code, "    movss %s, dword [__f%zu]\n", loc, float_init(32, ast->data.digit));
             break;
         case AST_VAR: {
             AST *var = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
@@ -389,7 +864,11 @@ char *emit_call_arg(AST *ast, char *param_type, char *loc, bool on_stack) {
                     else
                         sprintf(code, "    mov %s, dword %s\n", loc, var->assign.rbp);
                 } else {
-                    sprintf(code, "    cvttss2si %s, dword %s\n", loc, var->assign.rbp);
+                    if (on_stack)
+                        sprintf(code, "    cvttss2si eax, dword %s\n"
+                                      "    mov dword %s, eax\n", var->assign.rbp, loc);
+                    else
+                        sprintf(code, "    cvttss2si %s, dword %s\n", loc, var->assign.rbp);
                 }
             } else if (strcmp(param_type, "float") == 0) {
                 if (strcmp(var->assign.type, "char") == 0) {
@@ -502,18 +981,28 @@ char *emit_call_arg(AST *ast, char *param_type, char *loc, bool on_stack) {
             free(store);
             break;
         }
+        case AST_STR:
+            code = calloc(strlen(loc) + 128, sizeof(char));
+
+            if (on_stack)
+                sprintf(code, "    lea rax, [__s%zu]\n"
+                              "    mov qword %s, rax\n", str_init(ast->data.str), loc);
+            else
+                sprintf(code, "    lea %s, [__s%zu]\n", loc, str_init(ast->data.str));
+            break;
         case AST_REF: {
             AST *ref_sym = sym_find(AST_ASSIGN, ast->scope_def, ast->ref.name);
             code = calloc(strlen(ref_sym->assign.rbp) + strlen(loc) + 128, sizeof(char));
 
             if (on_stack)
                 sprintf(code, "    lea rax, %s\n"
-                              "    mov qword %s, rax\n", loc, ref_sym->assign.rbp);
+                              "    mov qword %s, rax\n", ref_sym->assign.rbp, loc);
             else
                 sprintf(code, "    lea %s, %s\n", loc, ref_sym->assign.rbp);
             break;
         }
-        default: assert(false);
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported argument '%s'\n", ast->ln, ast->col, ast_types[ast->type]);
     }
 
     return code;
@@ -521,169 +1010,582 @@ char *emit_call_arg(AST *ast, char *param_type, char *loc, bool on_stack) {
 
 char *emit_math(AST *ast);
 
+// Arguments that need registers of their own to be evaluated
+bool is_complex_arg(AST *ast) {
+    return ast->type == AST_CALL || ast->type == AST_MATH;
+}
+
+char *emit_call_load(char *param_type, char *loc, char *temp) {
+    char *code = calloc(strlen(loc) + strlen(temp) + 64, sizeof(char));
+    bool on_stack = loc[0] == '[';
+
+    if (strcmp(param_type, "char") != 0 && strcmp(param_type, "int") != 0 && strcmp(param_type, "float") != 0) {
+        if (on_stack)
+            sprintf(code, "    mov rax, qword %s\n"
+                          "    mov qword %s, rax\n", temp, loc);
+        else
+            sprintf(code, "    mov %s, qword %s\n", loc, temp);
+    } else if (on_stack)
+        sprintf(code, "    mov eax, dword %s\n"
+                      "    mov dword %s, eax\n", temp, loc);
+    else if (strcmp(param_type, "float") == 0)
+        sprintf(code, "    movss %s, dword %s\n", loc, temp);
+    else
+        sprintf(code, "    mov %s, dword %s\n", loc, temp);
+
+    return code;
+}
+
 char *emit_call(AST *ast) {
     char *code = calloc(1, sizeof(char));
     char *next;
-    char *loc;
     AST *sym = sym_find(AST_FUNC, "<global>", ast->call.name);
     AST *param;
     AST *arg;
     size_t ints = 0;
     size_t floats = 0;
+    size_t stack = 0;
     size_t beg_rsp = rsp;
+    size_t params_cnt = sym->func.params_cnt;
+    size_t last_complex = params_cnt;
+    char **locs = calloc(params_cnt, sizeof(char *));
+    char **temps = calloc(params_cnt, sizeof(char *));
+
+    // System V: the first 6 integers and pointers in rdi, rsi, rdx, rcx, r8,
+    // r9, the first 8 floats in xmm0-xmm7, everything else on the stack.
+    // Fast functions continue with r11-r15 and xmm8-xmm15.
+    for (size_t i = 0; i < params_cnt; i++) {
+        param = sym->func.params[i];
+        locs[i] = calloc(64, sizeof(char));
+
+        if (strcmp(param->assign.type, "float") == 0 && floats < float_params_cnt(sym))
+            strcpy(locs[i], regs[XMM][floats++]);
+        else if (strcmp(param->assign.type, "float") != 0 && ints < int_params_cnt(sym))
+            strcpy(locs[i], regs[int_param(sym, ints++)][strcmp(param->assign.type, "char") == 0 || strcmp(param->assign.type, "int") == 0 ? DWORD : QWORD]);
+        else {
+            sprintf(locs[i], "[rsp+%zu]", stack);
+            stack += 8;
+        }
+
+        if (is_complex_arg(ast->call.args[i]))
+            last_complex = i;
+    }
 
-    for (size_t i = 0; i < sym->func.params_cnt; i++) {
+    // Stack arguments are stored with xmm0 and eax, so then nothing can be
+    // evaluated straight into a register
+    if (stack > 0)
+        last_complex = params_cnt;
+
+    // Calls and math go first while no argument register is live yet. Each
+    // one but the last is parked in a scratch slot, so nothing has to be
+    // saved and restored around a nested call.
+    for (size_t i = 0; i < params_cnt; i++) {
         param = sym->func.params[i];
         arg = ast->call.args[i];
-        loc = calloc(64, sizeof(char));
 
-        if (strcmp(param->assign.type, "char") == 0 || strcmp(param->assign.type, "int") == 0) {
-            if (ints < 6)
-                strcpy(loc, regs[int_params[ints++]][DWORD]);
-            else {
-                rsp += 8;
-                sprintf(loc, "[rbp-%zu]", rsp);
-            }
-        } else if (strcmp(param->assign.type, "float") == 0)
-            if (floats < 15)
-                strcpy(loc, regs[XMM][++floats]);
-            else {
-                rsp += 8;
-                sprintf(loc, "[rbp-%zu]", rsp);
-            }
+        if (!is_complex_arg(arg))
+            continue;
+        else if (i == last_complex)
+            next = emit_call_arg(arg, param->assign.type, locs[i], false);
         else {
-            if (ints < 6)
-                strcpy(loc, regs[int_params[ints++]][QWORD]);
-            else {
-                rsp += 8;
-                sprintf(loc, "[rbp-%zu]", rsp);
-            }
+            rsp += 8;
+            temps[i] = calloc(32, sizeof(char));
+            sprintf(temps[i], "[rbp-%zu]", rsp);
+            next = emit_call_arg(arg, param->assign.type, temps[i], true);
         }
 
-        if (arg->type == AST_CALL && i > 0) {
-            char *temp;
-            char *store_ints = calloc(1, sizeof(char));
-            char *load_ints = calloc(1, sizeof(char));
-            char *load;
-            AST *temp_param;
+        append(&code, "%s", next);
+        free(next);
+    }
 
-            size_t beg_rsp = rsp;
+    // rsp stays 16-byte aligned at the call
+    stack = (stack + 15) & ~(size_t)15;
 
-            for (size_t j = 0; j < i; j++) {
-                temp_param = sym->func.params[j];
-                if (strcmp(temp_param->assign.type, "char") != 0 && strcmp(temp_param->assign.type, "int") != 0)
-                    continue;
+    if (stack > 0)
+        append(&code, "    sub rsp, %zu\n", stack);
 
-                temp = calloc(64, sizeof(char));
-                sprintf(temp, "    push %s\n", regs[int_params[j]][QWORD]);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < params_cnt; i++) {
+            param = sym->func.params[i];
+            arg = ast->call.args[i];
 
-                store_ints = realloc(store_ints, (strlen(store_ints) + strlen(temp) + 1) * sizeof(char));
-                strcat(store_ints, temp);
+            if ((locs[i][0] == '[') != (pass == 0))
+                continue;
+            else if (temps[i] != NULL)
+                next = emit_call_load(param->assign.type, locs[i], temps[i]);
+            else if (!is_complex_arg(arg))
+                next = emit_call_arg(arg, param->assign.type, locs[i], locs[i][0] == '[');
+            else
+                continue;
 
-                sprintf(temp, "    pop %s\n", regs[int_params[j]][QWORD]);
+            append(&code, "%s", next);
+            free(next);
+        }
+    }
 
-                load = calloc(strlen(load_ints) + strlen(temp) + 1, sizeof(char));
-                strcpy(load, temp);
-                strcat(load, load_ints);
-                free(load_ints);
-                load_ints = load;
-                free(temp);
-            }
+    for (size_t i = 0; i < params_cnt; i++) {
+        free(locs[i]);
+        free(temps[i]);
+    }
 
-            char *store_floats = calloc(1, sizeof(char));
-            char *load_floats = calloc(1, sizeof(char));
+    free(locs);
+    free(temps);
 
-            size_t rsp_before_floats = rsp;
-            size_t float_rsp_cap = 0;
+    // Variadic C functions read the number of vector registers used from al
+    if (sym->func.ext)
+        append(&code, "    mov eax, %zu\n"
+                      "    call %s\n", floats, ast->call.name);
+    else
+        append(&code, "    call %s_\n", ast->call.name);
 
-            while (rsp > rsp_cap + float_rsp_cap)
-                float_rsp_cap += SUB_RSP_SIZE;
+    if (is_fast_func(sym))
+        calls_fast = true;
 
-            for (size_t j = 0; j < i; j++) {
-                temp_param = sym->func.params[j];
-                if (strcmp(temp_param->assign.type, "float") != 0)
-                    continue;
+    if (stack > 0)
+        append(&code, "    add rsp, %zu\n", stack);
 
-                temp = calloc(64, sizeof(char));
-                rsp += 8;
-                sprintf(temp, "    movss dword [rbp-%zu], %s\n", rsp, regs[XMM][j + 1]);
+    rsp = beg_rsp;
+    return code;
+}
+
+char *emit_subscr(AST *ast);
 
-                store_ints = realloc(store_ints, (strlen(store_ints) + strlen(temp) + 1) * sizeof(char));
-                strcat(store_ints, temp);
+const char *vec_instr(TokType op, bool is_float, bool scalar) {
+    switch (op) {
+        case TOK_PLUS: return is_float ? (scalar ? "addss" : "addps") : (scalar ? "add" : "paddd");
+        case TOK_MINUS: return is_float ? (scalar ? "subss" : "subps") : (scalar ? "sub" : "psubd");
+        case TOK_STAR: return is_float ? (scalar ? "mulss" : "mulps") : (scalar ? "imul" : "pmulld");
+        default: return scalar ? "divss" : "divps";
+    }
+}
 
-                sprintf(temp, "    movss %s, dword [rbp-%zu]\n", regs[XMM][j + 1], rsp);
+/* Vector values live in 16 or 32 byte stack slots and are computed in xmm or
+ * ymm registers. 8 lane vectors use the VEX encoded instructions so that no
+ * legacy SSE instruction runs with the upper halves dirty.
+ */
+
+// Load a scalar of 'src_type' into the first lane of 'reg', converted to the element type of 'type'
+char *emit_vec_lane0(char *type, char *src_type, char *mem, size_t reg) {
+    const char *v = vec_lanes(type) == 8 ? "v" : "";
+    const char *x = regs[XMM][reg];
+    char dup[16] = "";
+    char *code = calloc(strlen(mem) + 128, sizeof(char));
+
+    if (vec_lanes(type) == 8)
+        sprintf(dup, "%s, ", x);
+
+    if (type[0] == 'f') {
+        if (strcmp(src_type, "char") == 0)
+            sprintf(code, "    movsx eax, byte %s\n"
+                          "    %scvtsi2ss %s, %seax\n", mem, v, x, dup);
+        else if (strcmp(src_type, "int") == 0)
+            sprintf(code, "    %scvtsi2ss %s, %sdword %s\n", v, x, dup, mem);
+        else
+            sprintf(code, "    %smovss %s, dword %s\n", v, x, mem);
+    } else {
+        if (strcmp(src_type, "char") == 0)
+            sprintf(code, "    movsx eax, byte %s\n"
+                          "    %smovd %s, eax\n", mem, v, x);
+        else if (strcmp(src_type, "int") == 0)
+            sprintf(code, "    %smovd %s, dword %s\n", v, x, mem);
+        else
+            sprintf(code, "    %scvttss2si eax, dword %s\n"
+                          "    %smovd %s, eax\n", v, mem, v, x);
+    }
+
+    return code;
+}
+
+void emit_vec_broadcast(char **code, char *type, size_t reg) {
+    if (vec_lanes(type) == 8)
+        append(code, "    %s %s, %s\n", type[0] == 'f' ? "vbroadcastss" : "vpbroadcastd", regs[YMM][reg], regs[XMM][reg]);
+    else
+        append(code, "    %s %s, %s, 0\n", type[0] == 'f' ? "shufps" : "pshufd", regs[XMM][reg], regs[XMM][reg]);
+}
 
-                load = calloc(strlen(load_ints) + strlen(temp) + 1, sizeof(char));
-                strcpy(load, temp);
-                strcat(load, load_ints);
-                free(load_ints);
-                load_ints = load;
-                free(temp);
+void emit_vec_binop(char **code, char *type, TokType op, size_t dst, size_t src) {
+    const char *instr = vec_instr(op, type[0] == 'f', false);
+
+    if (vec_lanes(type) == 8)
+        append(code, "    v%s %s, %s, %s\n", instr, regs[YMM][dst], regs[YMM][dst], regs[YMM][src]);
+    else
+        append(code, "    %s %s, %s\n", instr, regs[XMM][dst], regs[XMM][src]);
+}
+
+// Elementwise vector expression of 'type' into 'reg', using the registers from 'reg' up
+char *emit_vec_expr(AST *ast, char *type, size_t reg) {
+    bool avx = vec_lanes(type) == 8;
+    const char *v = avx ? "v" : "";
+    const char *mov = type[0] == 'f' ? "movups" : "movdqu";
+    const char *vreg = avx ? regs[YMM][reg] : regs[XMM][reg];
+    char *code = calloc(1, sizeof(char));
+    char *next;
+    AST *sym;
+
+    switch (ast->type) {
+        case AST_INT:
+        case AST_FLOAT:
+            if (type[0] == 'f')
+                append(&code, "    %smovss %s, dword [__f%zu]\n", v, regs[XMM][reg], float_init(32, ast->data.digit));
+            else
+                append(&code, "    mov eax, %d\n"
+                              "    %smovd %s, eax\n", (int)ast->data.digit, v, regs[XMM][reg]);
+
+            emit_vec_broadcast(&code, type, reg);
+            break;
+        case AST_VAR:
+            sym = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
+
+            if (is_vec_type(sym->assign.type))
+                append(&code, "    %s%s %s, %s\n", v, mov, vreg, sym->assign.rbp);
+            else {
+                next = emit_vec_lane0(type, sym->assign.type, sym->assign.rbp, reg);
+                append(&code, "%s", next);
+                free(next);
+                emit_vec_broadcast(&code, type, reg);
             }
+            break;
+        case AST_SUBSCR: {
+            sym = sym_find(AST_ASSIGN, ast->scope_def, ast->subscr.name);
 
-            next = emit_call_arg(arg, param->assign.type, loc, strstr(loc, "[rbp-") != NULL ? true : false);
+            char *elem = calloc(strlen(sym->assign.rbp) + 32, sizeof(char));
+            strcpy(elem, sym->assign.rbp);
+            strcpy(elem + strlen(elem) - 1, "+r10*4]");
 
-            temp = calloc(strlen(store_ints) + strlen(store_floats) + strlen(next) + strlen(load_floats) + strlen(load_ints) + 128, sizeof(char));
-            
-            if (rsp_before_floats > 0)
-                sprintf(temp, "%s"
-                              "    sub rsp, %zu\n"
-                              "%s"
-                              "%s"
-                              "%s"
-                              "    add rsp, %zu\n"
-                              "%s", store_ints, rsp_before_floats, store_floats, next, load_floats, rsp_before_floats, load_ints);
+            next = emit_subscr(ast);
+            append(&code, "%s", next);
+            free(next);
+
+            // Subscripting a vector broadcasts one of its lanes, subscripting an array loads a vector from it
+            if (is_vec_type(sym->assign.type)) {
+                char *base_type = strdup(sym->assign.type);
+                base_type[strlen(base_type) - 1] = '\0';
+
+                next = emit_vec_lane0(type, base_type, elem, reg);
+                append(&code, "%s", next);
+                free(next);
+                free(base_type);
+                emit_vec_broadcast(&code, type, reg);
+            } else
+                append(&code, "    %s%s %s, %s\n", v, mov, vreg, elem);
+
+            free(elem);
+            break;
+        }
+        case AST_EXPR:
+            free(code);
+            return emit_vec_expr(ast->expr.value, type, reg);
+        case AST_MATH: {
+            // Terms of * and / are built in reg + 1 and summed into reg
+            AST **expr = ast->math.expr;
+            size_t term = reg + 1;
+            size_t opnd = reg + 2;
+            TokType add = TOK_EOF;
+
+            if (opnd > 15) {
+                fatal("steelc: error: vector expression is too complex\n");
+            }
+
+            next = emit_vec_expr(expr[0], type, term);
+            append(&code, "%s", next);
+            free(next);
+
+            for (size_t i = 1; i < ast->math.expr_cnt; i += 2) {
+                TokType op = expr[i]->oper.kind;
+
+                if (op == TOK_STAR || op == TOK_SLASH) {
+                    next = emit_vec_expr(expr[i + 1], type, opnd);
+                    append(&code, "%s", next);
+                    free(next);
+                    emit_vec_binop(&code, type, op, term, opnd);
+                    continue;
+                }
+
+                if (add == TOK_EOF)
+                    append(&code, "    %smovaps %s, %s\n", v, vreg, avx ? regs[YMM][term] : regs[XMM][term]);
+                else
+                    emit_vec_binop(&code, type, add, reg, term);
+
+                add = op;
+                next = emit_vec_expr(expr[i + 1], type, term);
+                append(&code, "%s", next);
+                free(next);
+            }
+
+            if (add == TOK_EOF)
+                append(&code, "    %smovaps %s, %s\n", v, vreg, avx ? regs[YMM][term] : regs[XMM][term]);
             else
-                sprintf(temp, "%s"
-                              "%s"
-                              "%s"
-                              "%s"
-                              "%s", store_ints, store_floats, next, load_floats, load_ints);
+                emit_vec_binop(&code, type, add, reg, term);
+            break;
+        }
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported operand '%s' in vector expression\n", ast->ln, ast->col, ast_types[ast->type]);
+    }
+
+    return code;
+}
 
-            free(store_ints);
-            free(store_floats);
-            free(load_ints);
-            free(load_floats);
+// Fill a vector from a list of scalars, one lane at a time
+char *emit_vec_lst(AST *ast, char *type, char *rbp) {
+    const char *v = vec_lanes(type) == 8 ? "v" : "";
+    char *code = calloc(1, sizeof(char));
+    char *lane = calloc(strlen(rbp) + 32, sizeof(char));
+    AST *item;
 
-            code = realloc(code, (strlen(code) + strlen(temp) + 1) * sizeof(char));
-            strcat(code, temp);
-            free(temp);
+    for (size_t i = 0; i < ast->arr_lst.items_cnt; i++) {
+        item = ast->arr_lst.items[i];
+        strcpy(lane, rbp);
+
+        if (i > 0)
+            sprintf(lane + strlen(lane) - 1, "+%zu]", i * 4);
+
+        if (item->type == AST_VAR) {
+            AST *var = sym_find(AST_ASSIGN, item->scope_def, item->var.name);
+            char *next = emit_vec_lane0(type, var->assign.type, var->assign.rbp, 0);
+            append(&code, "%s", next);
+            append(&code, "    %s%s dword %s, xmm0\n", v, type[0] == 'f' ? "movss" : "movd", lane);
             free(next);
-            rsp = beg_rsp;
-            free(loc);
-            continue;
+        } else if (type[0] == 'f')
+            append(&code, "    %smovss xmm0, dword [__f%zu]\n"
+                          "    %smovss dword %s, xmm0\n", v, float_init(32, item->data.digit), v, lane);
+        else
+            append(&code, "    mov dword %s, %d\n", lane, (int)item->data.digit);
+    }
+
+    free(lane);
+    return code;
+}
+
+// Reduce a vector to a scalar in xmm0 or eax
+char *emit_vec_reduce(AST *ast) {
+    char *type = ast_vec_type(ast->hreduce.value);
+    bool is_float = type[0] == 'f';
+    char *code = emit_vec_expr(ast->hreduce.value, type, 0);
+    const char *op;
+
+    if (strcmp(ast->hreduce.name, "hsum") == 0)
+        op = is_float ? "addps" : "paddd";
+    else if (strcmp(ast->hreduce.name, "hmin") == 0)
+        op = is_float ? "minps" : "pminsd";
+    else
+        op = is_float ? "maxps" : "pmaxsd";
+
+    if (vec_lanes(type) == 8)
+        append(&code, "    %s xmm1, ymm0, 1\n"
+                      "    v%s xmm0, xmm0, xmm1\n"
+                      "    vzeroupper\n", is_float ? "vextractf128" : "vextracti128", op);
+
+    if (is_float)
+        append(&code, "    movhlps xmm1, xmm0\n"
+                      "    %s xmm0, xmm1\n"
+                      "    movaps xmm1, xmm0\n"
+                      "    shufps xmm1, xmm1, 0x55\n"
+                      "    %s xmm0, xmm1\n", op, op);
+    else
+        append(&code, "    pshufd xmm1, xmm0, 0x4e\n"
+                      "    %s xmm0, xmm1\n"
+                      "    pshufd xmm1, xmm0, 0xb1\n"
+                      "    %s xmm0, xmm1\n"
+                      "    movd eax, xmm0\n", op, op);
+
+    return code;
+}
+
+char *emit_assign(AST *ast);
+
+char *mem_offset(char *mem, size_t offset) {
+    char *addr = calloc(strlen(mem) + 32, sizeof(char));
+    strcpy(addr, mem);
+
+    if (offset > 0)
+        sprintf(addr + strlen(addr) - 1, "+%zu]", offset);
+
+    return addr;
+}
+
+// Copy 'size' bytes from a .rodata blob to the stack
+void emit_block_copy(char **code, char *blob, char *dst, size_t size) {
+    if (size > BLOCK_COPY_SIZE) {
+        append(code, "    lea rdi, %s\n"
+                     "    lea rsi, %s\n"
+                     "    mov ecx, %zu\n"
+                     "    rep movsb\n", dst, blob, size);
+        return;
+    }
+
+    const char *pieces[][2] = { { "rax", "qword" }, { "eax", "dword" }, { "ax", "word" }, { "al", "byte" } };
+    size_t offset = 0;
+    char *addr;
+    char *src;
+
+    for (; size - offset >= 16; offset += 16) {
+        addr = mem_offset(dst, offset);
+        src = mem_offset(blob, offset);
+        append(code, "    movdqu xmm0, %s\n"
+                     "    movdqu %s, xmm0\n", src, addr);
+        free(addr);
+        free(src);
+    }
+
+    // Finish with an overlapping move rather than up to four smaller ones
+    if (offset < size && size > 16) {
+        addr = mem_offset(dst, size - 16);
+        src = mem_offset(blob, size - 16);
+        append(code, "    movdqu xmm0, %s\n"
+                     "    movdqu %s, xmm0\n", src, addr);
+        free(addr);
+        free(src);
+        offset = size;
+    }
+
+    for (size_t i = 0, piece = 8; i < 4; i++, piece /= 2) {
+        for (; size - offset >= piece; offset += piece) {
+            addr = mem_offset(dst, offset);
+            src = mem_offset(blob, offset);
+            append(code, "    mov %s, %s %s\n"
+                         "    mov %s %s, %s\n", pieces[i][0], pieces[i][1], src, pieces[i][1], addr, pieces[i][0]);
+            free(addr);
+            free(src);
         }
-        
-        next = emit_call_arg(arg, param->assign.type, loc, strstr(loc, "[rbp-") != NULL ? true : false);
-        code = realloc(code, (strlen(code) + strlen(next) + 1) * sizeof(char));
-        strcat(code, next);
-        free(next);
-        free(loc);
     }
+}
 
-    code = realloc(code, (strlen(code) + strlen(ast->call.name) + 32) * sizeof(char));
-    strcat(code, "    call ");
-    strcat(code, ast->call.name);
-    strcat(code, "_\n");
+/* Array initializers are emitted as a blob in .rodata and block copied into
+ * the array. Short zero tails are part of the blob, long ones are cleared
+ * with rep stosq. Items that aren't constants are left zero in the blob and
+ * stored one by one afterwards.
+ */
+char *emit_arr_init(AST *sym, AST *value) {
+    char *base_type = strdup(sym->assign.type);
+    base_type[strlen(base_type) - 1] = '\0';
+
+    size_t size;
+    const char *directive;
+
+    if (strcmp(base_type, "char") == 0) {
+        size = 1;
+        directive = "db";
+    } else if (strcmp(base_type, "int") == 0 || strcmp(base_type, "float") == 0) {
+        size = 4;
+        directive = "dd";
+    } else {
+        size = 8;
+        directive = "dq";
+    }
 
-    if (rsp != beg_rsp) {
-        char *temp = calloc(strlen(code) + 128, sizeof(char));
-        sprintf(temp, "    sub rsp, %zu\n"
-                      "%s"
-                      "    add rsp, %zu\n", rsp - beg_rsp, code, rsp - beg_rsp);
-        free(code);
-        code = temp;
-        rsp = beg_rsp;
+    char *data;
+    size_t init_size;
+
+    if (value->type == AST_STR) {
+        data = str_bytes(value->data.str, &init_size);
+        data = realloc(data, (strlen(data) + 2) * sizeof(char));
+        strcat(data, "0");
+        init_size++;
+    } else {
+        data = calloc(1, sizeof(char));
+        init_size = value->arr_lst.items_cnt * size;
+
+        for (size_t i = 0; i < value->arr_lst.items_cnt; i++) {
+            AST *item = value->arr_lst.items[i];
+            char next[32];
+
+            if (item->type != AST_INT && item->type != AST_FLOAT)
+                strcpy(next, "0");
+            else if (strcmp(base_type, "float") == 0) {
+                float digit = (float)item->data.digit;
+                unsigned int bits;
+                memcpy(&bits, &digit, sizeof(bits));
+                sprintf(next, "0x%08x", bits);
+            } else
+                sprintf(next, "%d", (int)item->data.digit);
+
+            data = realloc(data, (strlen(data) + strlen(next) + 2) * sizeof(char));
+
+            if (i > 0)
+                strcat(data, ",");
+
+            strcat(data, next);
+        }
+    }
+
+    size_t arr_size = sym->assign.arr_cap * size;
+    size_t tail = arr_size - init_size;
+    char name[32];
+    sprintf(name, "[__a%zu]", arr_cnt);
+
+    append(&rodata, "    align 16\n"
+                    "__a%zu:\n"
+                    "    %s %s\n", arr_cnt++, directive, data);
+
+    if (tail <= BLOCK_COPY_SIZE) {
+        if (tail > 0)
+            append(&rodata, "    times %zu db 0\n", tail);
+
+        init_size = arr_size;
+        tail = 0;
     }
 
+    char *code = calloc(1, sizeof(char));
+    emit_block_copy(&code, name, sym->assign.rbp, init_size);
+
+    if (tail > 0) {
+        char *addr = mem_offset(sym->assign.rbp, init_size);
+        append(&code, "    lea rdi, %s\n"
+                      "    xor eax, eax\n"
+                      "    mov ecx, %zu\n"
+                      "    rep stosq\n", addr, tail / 8);
+
+        if (tail % 8 > 0)
+            append(&code, "    mov ecx, %zu\n"
+                          "    rep stosb\n", tail % 8);
+
+        free(addr);
+    }
+
+    if (value->type == AST_ARR_LST) {
+        for (size_t i = 0; i < value->arr_lst.items_cnt; i++) {
+            AST *item = value->arr_lst.items[i];
+
+            if (item->type == AST_INT || item->type == AST_FLOAT)
+                continue;
+
+            AST *subscr = ast_init(AST_SUBSCR, item->scope_def, item->func_def, item->ln, item->col);
+            subscr->subscr.name = sym->assign.name;
+            subscr->subscr.value = item;
+            subscr->subscr.index = ast_init(AST_INT, item->scope_def, item->func_def, item->ln, item->col);
+            subscr->subscr.index->data.digit = i;
+
+            char *next = emit_assign(subscr);
+            append(&code, "%s", next);
+            free(next);
+
+            ast_del(subscr->subscr.index);
+            free(subscr->scope_def);
+            free(subscr->func_def);
+            free(subscr);
+        }
+    }
+
+    free(data);
+    free(base_type);
     return code;
 }
 
-char *emit_subscr(AST *ast);
+// r10 holds the element index while the value of a subscript store is computed
+char *save_r10(char *code, size_t slot) {
+    char *temp = calloc(strlen(code) + 96, sizeof(char));
+    sprintf(temp, "    mov qword [rbp-%zu], r10\n"
+                  "%s"
+                  "    mov r10, qword [rbp-%zu]\n", slot, code, slot);
+    free(code);
+    return temp;
+}
 
 char *emit_assign(AST *ast) {
     char *code;
     char *sub_rsp = NULL;
+    size_t beg_rsp = rsp;
+    size_t r10_slot = 0;
     AST *value;
     AST *sym;
     char *type;
@@ -695,6 +1597,7 @@ char *emit_assign(AST *ast) {
         type[strlen(type) - 1] = '\0';
 
         sub_rsp = emit_subscr(ast);
+        r10_slot = rsp += 8;
         rbp = calloc(128, sizeof(char));
         strcpy(rbp, sym->assign.rbp);
         rbp[strlen(rbp) - 1] = '\0';
@@ -722,47 +1625,34 @@ char *emit_assign(AST *ast) {
     }
 
     if (ast->type == AST_ASSIGN && ast->assign.type != NULL) {
-        size_t size;
-        size_t cnt;
-        char *var_type;
+        rbp = slot_rbp(sym);
+        sym->assign.rbp = rbp;
+    }
 
-        if (ast->assign.arr_cap > 0) {
-            var_type = strdup(type);
-            var_type[strlen(var_type) - 1] = '\0';
-            cnt = ast->assign.arr_cap;
-        } else {
-            var_type = strdup(type);
-            cnt = 1;
-        }
+    if (value == NULL)
+        return sub_rsp != NULL ? sub_rsp : calloc(1, sizeof(char));
 
-        if (strcmp(var_type, "char") == 0)
-            size = cnt * 1;
-        else if (strcmp(var_type, "int") == 0 || strcmp(var_type, "float") == 0)
-            size = cnt * 4;
-        else
-            size = cnt * 8;
+    if (is_vec_type(type) || ast_vec_type(value) != NULL) {
+        char *vec_type = is_vec_type(type) ? type : ast_vec_type(value);
+        bool avx = vec_lanes(vec_type) == 8;
 
-        free(var_type);
+        if (value->type == AST_ARR_LST)
+            code = emit_vec_lst(value, vec_type, rbp);
+        else {
+            code = emit_vec_expr(value, vec_type, 0);
 
-        rsp += size;
-        rbp = calloc(32, sizeof(char));
-        sprintf(rbp, "[rbp-%zu]", rsp);
-        sym->assign.rbp = rbp;
+            if (ast->type == AST_SUBSCR)
+                code = save_r10(code, r10_slot);
 
-        if (rsp > rsp_cap) {
-            size_t before = rsp_cap;
+            append(&code, "    %s%s %s, %s\n", avx ? "v" : "", vec_type[0] == 'f' ? "movups" : "movdqu", rbp, avx ? "ymm0" : "xmm0");
+        }
 
-            while (rsp > rsp_cap)
-                rsp_cap += SUB_RSP_SIZE;
+        if (avx)
+            append(&code, "    vzeroupper\n");
 
-            sub_rsp = calloc(64, sizeof(char));
-            sprintf(sub_rsp, "    sub rsp, %zu\n", rsp_cap - before);
-        }
+        goto emit_assign_end;
     }
 
-    if (value == NULL)
-        return sub_rsp != NULL ? sub_rsp : calloc(1, sizeof(char));
-
     switch (value->type) {
         case AST_INT:
             code = calloc(strlen(rbp) + 128, sizeof(char));
@@ -778,7 +1668,7 @@ char *emit_assign(AST *ast) {
             break;
         case AST_FLOAT:
             code = calloc(strlen(rbp) + 128, sizeof(char));
-            sprintf(code, "    movss xmm0, dword [.f%zu]\n"
+            sprintf(code, "    movss xmm0, dword [__f%zu]\n"
                           "    movss dword %s, xmm0\n", float_init(32, value->data.digit), rbp);
             break;
         case AST_VAR: {
@@ -847,14 +1737,8 @@ char *emit_assign(AST *ast) {
             } else
                 sprintf(temp, "    mov qword %s, rax\n", rbp);
 
-            if (ast->type == AST_SUBSCR) {
-                char *temp2 = calloc(strlen(code) + 64, sizeof(char));
-                sprintf(temp2, "    push r10\n"
-                               "%s"
-                               "    pop r10\n", code);
-                free(code);
-                code = temp2;
-            }
+            if (ast->type == AST_SUBSCR)
+                code = save_r10(code, r10_slot);
 
             code = realloc(code, (strlen(code) + strlen(temp) + 1) * sizeof(char));
             strcat(code, temp);
@@ -885,45 +1769,105 @@ char *emit_assign(AST *ast) {
                                  "    movss dword %s, xmm0\n", rbp);
             }
 
-            if (ast->type == AST_SUBSCR) {
-                char *temp = calloc(strlen(code) + 64, sizeof(char));
-                sprintf(temp, "    push r10\n"
+            if (ast->type == AST_SUBSCR)
+                code = save_r10(code, r10_slot);
+
+            code = realloc(code, (strlen(code) + strlen(fix) + 1) * sizeof(char));
+            strcat(code, fix);
+            free(fix);
+            break;
+        }
+        case AST_SUBSCR: {
+            AST *arr = sym_find(AST_ASSIGN, value->scope_def, value->subscr.name);
+            char *arr_type = strdup(arr->assign.type);
+            arr_type[strlen(arr_type) - 1] = '\0';
+
+            size_t arr_size;
+            if (strcmp(arr_type, "char") == 0)
+                arr_size = 1;
+            else if (strcmp(arr_type, "int") == 0 || strcmp(arr_type, "float") == 0)
+                arr_size = 4;
+            else
+                arr_size = 8;
+
+            char *elem = calloc(strlen(arr->assign.rbp) + 32, sizeof(char));
+            strcpy(elem, arr->assign.rbp);
+            sprintf(elem + strlen(elem) - 1, "+r10*%zu]", arr_size);
+
+            char *index = emit_subscr(value);
+            char *load = calloc(strlen(elem) + strlen(rbp) + 128, sizeof(char));
+
+            if (strcmp(type, "char") == 0 || strcmp(type, "int") == 0) {
+                if (strcmp(arr_type, "char") == 0)
+                    sprintf(load, "    movsx eax, byte %s\n", elem);
+                else if (strcmp(arr_type, "int") == 0)
+                    sprintf(load, "    mov eax, dword %s\n", elem);
+                else
+                    sprintf(load, "    cvttss2si eax, dword %s\n", elem);
+            } else if (strcmp(type, "float") == 0) {
+                if (strcmp(arr_type, "char") == 0)
+                    sprintf(load, "    movsx eax, byte %s\n"
+                                  "    cvtsi2ss xmm0, eax\n", elem);
+                else if (strcmp(arr_type, "int") == 0)
+                    sprintf(load, "    cvtsi2ss xmm0, dword %s\n", elem);
+                else
+                    sprintf(load, "    movss xmm0, dword %s\n", elem);
+            } else
+                sprintf(load, "    mov rax, qword %s\n", elem);
+
+            code = calloc(strlen(index) + strlen(load) + strlen(rbp) + 128, sizeof(char));
+
+            if (ast->type == AST_SUBSCR)
+                sprintf(code, "    mov qword [rbp-%zu], r10\n"
                               "%s"
-                              "    pop r10\n", code);
-                free(code);
-                code = temp;
-            }
+                              "%s"
+                              "    mov r10, qword [rbp-%zu]\n", r10_slot, index, load, r10_slot);
+            else
+                sprintf(code, "%s%s", index, load);
 
-            code = realloc(code, (strlen(code) + strlen(fix) + 1) * sizeof(char));
-            strcat(code, fix);
-            free(fix);
+            if (strcmp(type, "char") == 0)
+                sprintf(code + strlen(code), "    mov byte %s, al\n", rbp);
+            else if (strcmp(type, "int") == 0)
+                sprintf(code + strlen(code), "    mov dword %s, eax\n", rbp);
+            else if (strcmp(type, "float") == 0)
+                sprintf(code + strlen(code), "    movss dword %s, xmm0\n", rbp);
+            else
+                sprintf(code + strlen(code), "    mov qword %s, rax\n", rbp);
+
+            free(arr_type);
+            free(elem);
+            free(index);
+            free(load);
+            break;
+        }
+        case AST_HREDUCE: {
+            code = emit_vec_reduce(value);
+            bool is_float = ast_vec_type(value->hreduce.value)[0] == 'f';
+
+            if (ast->type == AST_SUBSCR)
+                code = save_r10(code, r10_slot);
+
+            if (strcmp(type, "char") == 0)
+                append(&code, "%s    mov byte %s, al\n", is_float ? "    cvttss2si eax, xmm0\n" : "", rbp);
+            else if (strcmp(type, "int") == 0)
+                append(&code, "%s    mov dword %s, eax\n", is_float ? "    cvttss2si eax, xmm0\n" : "", rbp);
+            else
+                append(&code, "%s    movss dword %s, xmm0\n", is_float ? "" : "    cvtsi2ss xmm0, eax\n", rbp);
             break;
         }
         case AST_STR:
+            if (ast->type == AST_ASSIGN && sym->assign.arr_cap > 0) {
+                code = emit_arr_init(sym, value);
+                break;
+            }
+
             code = calloc(strlen(rbp) + 64, sizeof(char));
-            sprintf(code, "    mov rax, qword [.s%zu]\n"
+            sprintf(code, "    lea rax, [__s%zu]\n"
                           "    mov qword %s, rax\n", str_init(value->data.str), rbp);
             break;
-            /*
-        case AST_ARR_LST: {
-            char *base_type = strdup(sym->assign.type);
-            base_type[strlen(base_type) - 1] = '\0';
-
-            size_t size_each;
-            if (strcmp(base_type, "char") == 0)
-                size_each = 1;
-            else if (strcmp(base_type, "int") == 0 || strcmp(base_type, "float") == 0)
-                size_each = 4;
-            else
-                size_each = 8;
-
-            AST *at;
-            char *next;
-
-            free(base_type);
+        case AST_ARR_LST:
+            code = emit_arr_init(sym, value);
             break;
-        }
-        */
         case AST_REF: {
             AST *ref = sym_find(AST_ASSIGN, value->scope_def, value->ref.name);
             code = calloc(strlen(ref->assign.rbp) + strlen(rbp) + 128, sizeof(char));
@@ -931,9 +1875,13 @@ char *emit_assign(AST *ast) {
                           "    mov qword %s, rax\n", ref->assign.rbp, rbp);
             break;
         }
-        default: assert(false);
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported value '%s' in assignment\n", value->ln, value->col, ast_types[value->type]);
     }
 
+emit_assign_end:
+    rsp = beg_rsp;
+
     if (sub_rsp != NULL) {
         sub_rsp = realloc(sub_rsp, (strlen(sub_rsp) + strlen(code) + 1) * sizeof(char));
         strcat(sub_rsp, code);
@@ -956,17 +1904,9 @@ char *emit_ret(AST *ast) {
     AST *value = ast->ret.value;
     char ret[80];
 
-    if (rsp > 0)
-        strcpy(ret, "    leave\n");
-    else
-        strcpy(ret, "    pop rbp\n");
-
-    if (strcmp(ast->func.name, "main") == 0)
-        strcat(ret, "    mov rax, 60\n"
-                    "    xor rdi, rdi\n"
-                    "    syscall\n");
-    else
-        strcat(ret, "    ret\n");
+    // Rewritten by emit_func() once the frame size is known
+    strcpy(ret, "    leave\n");
+    strcat(ret, func_exit(ast->func_def));
 
     if (value == NULL)
         return strdup(ret);
@@ -981,7 +1921,7 @@ char *emit_ret(AST *ast) {
             break;
         case AST_FLOAT:
             code = calloc(64, sizeof(char));
-            sprintf(code, "    movss xmm0, dword [.f%zu]\n", float_init(32, value->data.digit));
+            sprintf(code, "    movss xmm0, dword [__f%zu]\n", float_init(32, value->data.digit));
             break;
         case AST_VAR: {
             AST *var = sym_find(AST_ASSIGN, value->scope_def, value->var.name);
@@ -1073,7 +2013,18 @@ char *emit_ret(AST *ast) {
             sprintf(code, "    lea rax, %s\n", sym->assign.rbp);
             break;
         }
-        default: assert(false);
+        case AST_HREDUCE: {
+            code = emit_vec_reduce(value);
+            bool is_float = ast_vec_type(value->hreduce.value)[0] == 'f';
+
+            if (strcmp(type, "float") == 0 && !is_float)
+                append(&code, "    cvtsi2ss xmm0, eax\n");
+            else if (strcmp(type, "float") != 0 && is_float)
+                append(&code, "    cvttss2si eax, xmm0\n");
+            break;
+        }
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported return value '%s'\n", value->ln, value->col, ast_types[value->type]);
     }
 
     code = realloc(code, (strlen(code) + strlen(ret) + 1) * sizeof(char));
@@ -1095,7 +2046,7 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             break;
         case AST_FLOAT:
             code = calloc(64, sizeof(char));
-            sprintf(code, "    movss xmm0, dword [.f%zu]\n", float_init(32, left->data.digit));
+            sprintf(code, "    movss xmm0, dword [__f%zu]\n", float_init(32, left->data.digit));
             is_float = true;
             break;
         case AST_VAR: {
@@ -1136,9 +2087,10 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             code = calloc(1, sizeof(char));
             break;
         }
+        case AST_SUBSCR:
         case AST_DEREF: {
             code = emit_ast(left);
-            AST *sym = sym_find(AST_ASSIGN, left->scope_def, left->deref.name);
+            AST *sym = sym_find(AST_ASSIGN, left->scope_def, left->type == AST_SUBSCR ? left->subscr.name : left->deref.name);
             char *base_type = strdup(sym->assign.type);
             base_type[strlen(base_type) - 1] = '\0';
 
@@ -1167,7 +2119,8 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             code = emit_math(left);
             is_float = float_math_result;
             break;
-        default: assert(false);
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported operand '%s' in math expression\n", left->ln, left->col, ast_types[left->type]);
     }
 
     if (is_float)
@@ -1193,7 +2146,7 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
                 is_float = true;
             }
 
-            sprintf(right_value, "dword [.f%zu]", float_init(32, right->data.digit));
+            sprintf(right_value, "dword [__f%zu]", float_init(32, right->data.digit));
             break;
         case AST_VAR: {
             AST *var = sym_find(AST_ASSIGN, right->scope_def, right->var.name);
@@ -1235,62 +2188,39 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
 
             // Please forgive me for this awful looking code
             if (is_float) {
-                if (rsp + 8 > rsp_cap) {
-                    rsp_cap += 8;
-                    save = calloc(strlen(setup) + 128, sizeof(char));
-                    rsp_cap -= 8;
-
-                    if (strcmp(sym->func.type, "float") == 0)
-                        sprintf(save, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm1, xmm0\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-                    else
-                        sprintf(save, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    cvtsi2ss xmm1, eax\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-                } else {
-                    save = calloc(strlen(setup) + 128, sizeof(char));
+                save = calloc(strlen(setup) + 128, sizeof(char));
 
-                    if (strcmp(sym->func.type, "float") == 0)
-                        sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm1, xmm0\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rsp + 8);
-                    else
-                        sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    cvtsi2ss xmm1, eax\n", rsp + 8, setup, rsp + 8);
-                }
+                if (strcmp(sym->func.type, "float") == 0)
+                    sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    movss xmm1, xmm0\n"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
+                else
+                    sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    movss xmm0, dword [rbp-%zu]\n"
+                                  "    cvtsi2ss xmm1, eax\n", rsp, setup, rsp);
 
                 strcpy(left_value, "xmm0");
                 strcpy(right_value, "xmm1");
             } else {
-                rsp_cap += 8;
                 save = calloc(strlen(setup) + 128, sizeof(char));
-                rsp_cap -= 8;
 
                 if (strcmp(sym->func.type, "float") == 0) {
-                    sprintf(save, "    push rax\n"
+                    sprintf(save, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
                                   "    movss xmm1, xmm0\n"
-                                  "    pop rax\n"
-                                  "    cvtsi2ss xmm0, eax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n"
+                                  "    cvtsi2ss xmm0, eax\n", rsp, setup, rsp);
 
                     strcpy(left_value, "xmm0");
                     strcpy(right_value, "xmm1");
                     is_float = true;
                 } else {
-                    sprintf(save, "    push rax\n"
+                    sprintf(save, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
                                   "    mov ebx, eax\n"
-                                  "    pop rax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n", rsp, setup, rsp);
                     strcpy(right_value, "ebx");
                 }
             }
@@ -1342,6 +2272,7 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
 
                     strcpy(left_value, "xmm0");
                     strcpy(right_value, "xmm1");
+                    is_float = true;
                 } else {
                     sprintf(temp, "    mov ebx, eax\n");
                     strcpy(right_value, "ebx");
@@ -1353,8 +2284,9 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             code = temp;
             break;
         }
+        case AST_SUBSCR:
         case AST_DEREF: {
-            AST *sym = sym_find(AST_ASSIGN, right->scope_def, right->deref.name);
+            AST *sym = sym_find(AST_ASSIGN, right->scope_def, right->type == AST_SUBSCR ? right->subscr.name : right->deref.name);
             char *base_type = strdup(sym->assign.type);
             base_type[strlen(base_type) - 1] = '\0';
 
@@ -1367,111 +2299,66 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
 
             if (strcmp(base_type, "char") == 0) {
                 if (is_float) {
-                    if (rsp + 8 > rsp_cap) {
-                        rsp_cap += 8;
-                        setup = emit_ast(right);
-                        rsp_cap -= 8;
-                        temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                        sprintf(temp, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movsx eax, byte %s+r10*1]\n"
-                                      "    cvtsi2ss xmm1, eax\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rbp, rsp + 8);
-
-                    } else {
-                        setup = emit_ast(right);
-                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+                    setup = emit_ast(right);
+                    temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
 
-                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movsx eax, byte %s+r10*1]\n"
-                                      "    cvtsi2ss xmm1, eax\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rbp, rsp + 8);
-                    }
+                    sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    movsx eax, byte %s+r10*1]\n"
+                                  "    cvtsi2ss xmm1, eax\n"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                     strcpy(right_value, "xmm1");
                 } else {
                     setup = emit_ast(right);
                     temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                    sprintf(temp, "    push rax\n"
+                    sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
                                   "    movsx ebx, byte %s+r10*1]\n"
-                                  "    pop rax\n", setup, rbp);
+                                  "    mov rax, qword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                     strcpy(right_value, "ebx");
                 }
             } else if (strcmp(base_type, "int") == 0) {
                 if (is_float) {
-                    if (rsp + 8 > rsp_cap) {
-                        rsp_cap += 8;
-                        setup = emit_ast(right);
-                        rsp_cap -= 8;
-                        temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                        sprintf(temp, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    cvtsi2ss xmm1, dword %s+r10*4]\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rbp, rsp + 8);
-
-                    } else {
-                        setup = emit_ast(right);
-                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+                    setup = emit_ast(right);
+                    temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
 
-                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    cvtsi2ss xmm1, dword %s+r10*4]\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rbp, rsp + 8);
-                    }
+                    sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    cvtsi2ss xmm1, dword %s+r10*4]\n"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                     strcpy(right_value, "xmm1");
                 } else {
                     setup = emit_ast(right);
                     temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                    sprintf(temp, "    push rax\n"
+                    sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
-                                  "    pop rax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n", rsp, setup, rsp);
 
                     sprintf(right_value, "dword %s+r10*4]", rbp);
                 }
             } else {
                 if (is_float) {
-                    if (rsp + 8 > rsp_cap) {
-                        rsp_cap += 8;
-                        setup = emit_ast(right);
-                        rsp_cap -= 8;
-                        temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                        sprintf(temp, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-
-                    } else {
-                        setup = emit_ast(right);
-                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+                    setup = emit_ast(right);
+                    temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
 
-                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rsp + 8);
-                    }
+                    sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
 
                     strcpy(right_value, "xmm1");
                 } else {
                     setup = emit_ast(right);
                     temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                    sprintf(temp, "    push rax\n"
+                    sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
-                                  "    pop rax\n"
-                                  "    cvtsi2ss xmm0, eax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n"
+                                  "    cvtsi2ss xmm0, eax\n", rsp, setup, rsp);
                     strcpy(left_value, "xmm0");
                     is_float = true;
 
@@ -1494,64 +2381,40 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             rsp += 8;
 
             if (is_float) {
-                if (rsp + 8 > rsp_cap) {
-                    rsp_cap += 8;
-                    setup = emit_ast(right);
-                    rsp_cap -= 8;
-                    temp = calloc(strlen(setup) + 256, sizeof(char));
-
-                    if (float_math_result)
-                        sprintf(temp, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm1, xmm0\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-                    else
-                        sprintf(temp, "    sub rsp, 8\n"
-                                      "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    cvtsi2ss xmm1, eax\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n"
-                                      "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-                } else {
-                    setup = emit_ast(right);
-                    temp = calloc(strlen(setup) + 256, sizeof(char));
+                setup = emit_ast(right);
+                temp = calloc(strlen(setup) + 256, sizeof(char));
 
-                    if (float_math_result)
-                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    movss xmm1, xmm0\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rsp + 8);
-                    else
-                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                      "%s"
-                                      "    cvtsi2ss xmm1, eax\n"
-                                      "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rsp + 8);
-                }
+                if (float_math_result)
+                    sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    movss xmm1, xmm0\n"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
+                else
+                    sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                  "%s"
+                                  "    cvtsi2ss xmm1, eax\n"
+                                  "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
 
                 strcpy(right_value, "xmm1");
             } else {
-                rsp_cap += 8;
                 setup = emit_ast(right);
-                rsp_cap -= 8;
                 temp = calloc(strlen(setup) + 256, sizeof(char));
 
                 if (float_math_result) {
-                    sprintf(temp, "    push rax\n"
+                    sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
                                   "    movss xmm1, xmm0\n"
-                                  "    pop rax\n"
-                                  "    cvtsi2ss xmm0, eax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n"
+                                  "    cvtsi2ss xmm0, eax\n", rsp, setup, rsp);
 
                     strcpy(left_value, "xmm0");
                     strcpy(right_value, "xmm1");
                     is_float = true;
                 } else {
-                    sprintf(temp, "    push rax\n"
+                    sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                   "%s"
                                   "    mov ebx, eax\n"
-                                  "    pop rax\n", setup);
+                                  "    mov rax, qword [rbp-%zu]\n", rsp, setup, rsp);
                     strcpy(right_value, "ebx");
                 }
             }
@@ -1560,7 +2423,8 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             free(setup);
             setup = temp;
             break;
-        default: assert(false);
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported operand '%s' in math expression\n", right->ln, right->col, ast_types[right->type]);
     }
 
     if (setup != NULL) {
@@ -1588,7 +2452,7 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
             if (is_float)
                 sprintf(math, "    mulss %s, %s\n", left_value, right_value);
             else {
-                if (right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
+                if (right->type == AST_INT && right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
                     sprintf(math, "    sal %s, %u\n", left_value, power_of_two((unsigned int)right->data.digit));
                 else
                     sprintf(math, "    imul %s, %s\n", left_value, right_value);
@@ -1600,24 +2464,29 @@ char *emit_math_expr(AST *left, AST *right, TokType type) {
                 break;
             }
 
-            if (right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
+            if (right->type == AST_INT && right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
                 sprintf(math, "    sar %s, %u\n", left_value, power_of_two((unsigned int)right->data.digit));
             else
                 if (strcmp(right_value, "ebx") == 0)
-                    sprintf(math, "    cqo\n"
+                    sprintf(math, "    cdq\n"
                                   "    idiv %s\n", right_value);
                 else
                     sprintf(math, "    mov ebx, %s\n"
-                                  "    cqo\n"
+                                  "    cdq\n"
                                   "    idiv ebx\n", right_value);
             break;
         default:
-            if (right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
+            if (right->type == AST_INT && right->data.digit >= 0 && is_power_of_two((unsigned int)right->data.digit))
                 sprintf(math, "    and %s, %u\n", left_value, (unsigned int)right->data.digit - 1);
-            else
-                sprintf(math, "    xor rdi, rdi\n"
+            else if (strcmp(right_value, "ebx") == 0)
+                sprintf(math, "    cdq\n"
                               "    idiv %s\n"
                               "    mov eax, edx\n", right_value);
+            else
+                sprintf(math, "    mov ebx, %s\n"
+                              "    cdq\n"
+                              "    idiv ebx\n"
+                              "    mov eax, edx\n", right_value);
             break;
     }
 
@@ -1660,7 +2529,6 @@ char *emit_math(AST *ast) {
     int j;
     
     size_t beg_rsp = rsp;
-    size_t beg_cap = rsp_cap;
 
     for (size_t i = 0; i < oper_cnt; i++) {
         oper_pos = order[i];
@@ -1685,8 +2553,11 @@ char *emit_math(AST *ast) {
         strcat(code, next);
         free(next);
 
+        // The result of this operation alone, earlier ones may be in other registers
+        bool res_float = float_math_result;
+
         if (!is_float)
-            is_float = float_math_result;
+            is_float = res_float;
 
         right->active = false;
 
@@ -1695,7 +2566,7 @@ char *emit_math(AST *ast) {
 
         ast_fields_del(left);
         left->type = AST_MATH_VAR;
-        left->math_var.is_float = is_float;
+        left->math_var.is_float = res_float;
         next_oper_pos = order[i + 1];
 
         if (abs((int)oper_pos - (int)next_oper_pos) > 2 && i != oper_cnt - 2) {
@@ -1703,9 +2574,8 @@ save_math_result:
             // Not used in the next expression, needs to be saved to the stack
             char *save = calloc(128, sizeof(char));
             rsp += 8;
-            rsp_cap += 8;
 
-            if (is_float)
+            if (res_float)
                 sprintf(save, "    movss dword [rbp-%zu], xmm0\n", rsp);
             else
                 sprintf(save, "    mov dword [rbp-%zu], eax\n", rsp);
@@ -1716,9 +2586,10 @@ save_math_result:
 
             left->math_var.stack_rbp = calloc(64, sizeof(char));
             sprintf(left->math_var.stack_rbp, "[rbp-%zu]", rsp);
-            break;
+            continue;
         }
 
+        j = 0;
         next_left = expr[order[i + 1] - 1];
         while (!next_left->active)
             next_left = expr[order[i + 1] + --j];
@@ -1727,12 +2598,11 @@ save_math_result:
             goto save_math_result;
 
         // Used in the next expression, no need to save to the stack
-        left->math_var.reg_name = is_float ? "xmm0" : "eax";
+        left->math_var.reg_name = res_float ? "xmm0" : "eax";
         left->math_var.stack_rbp = NULL;
     }
 
     rsp = beg_rsp;
-    rsp_cap = beg_cap;
 
     float_math_result = is_float;
     return code;
@@ -1768,7 +2638,7 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 break;
             case AST_FLOAT:
                 setup = calloc(64, sizeof(char));
-                sprintf(setup, "    mov eax, %d\n", (int)left->data.digit);
+                sprintf(setup, "    movss xmm0, dword [__f%zu]\n", float_init(32, left->data.digit));
                 is_float = true;
                 break;
             case AST_VAR: {
@@ -1798,9 +2668,10 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 is_float = float_math_result;
                 break;
             }
+            case AST_SUBSCR:
             case AST_DEREF: {
                 setup = emit_ast(left);
-                AST *sym = sym_find(AST_ASSIGN, left->scope_def, left->deref.name);
+                AST *sym = sym_find(AST_ASSIGN, left->scope_def, left->type == AST_SUBSCR ? left->subscr.name : left->deref.name);
                 char *base_type = strdup(sym->assign.type);
                 base_type[strlen(base_type) - 1] = '\0';
 
@@ -1824,7 +2695,8 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 setup = temp;
                 break;
             }
-            default: assert(false);
+            default:
+                fatal("steelc: error: %zu:%zu: unsupported operand '%s' in condition\n", left->ln, left->col, ast_types[left->type]);
         }
 
         if (is_float)
@@ -1855,7 +2727,7 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                     is_float = true;
                 }
 
-                sprintf(right_value, "dword [.f%zu]", float_init(32, right->data.digit));
+                sprintf(right_value, "dword [__f%zu]", float_init(32, right->data.digit));
                 break;
             case AST_VAR: {
                 AST *var = sym_find(AST_ASSIGN, right->scope_def, right->var.name);
@@ -1910,68 +2782,41 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 rsp += 8;
 
                 if (is_float) {
-                    if (rsp + 8 > rsp_cap) {
-                        rsp_cap += 8;
-                        setup = emit_ast(right);
-                        rsp_cap -= 8;
-
-                        save = calloc(strlen(setup) + 256, sizeof(char));
-
-                        if (strcmp(result_reg, "xmm0") == 0)
-                            sprintf(save, "    sub rsp, 8\n"
-                                          "    movss dword [rbp-%zu], xmm0\n"
-                                          "%s"
-                                          "    movss xmm1, xmm0\n"
-                                          "    movss xmm0, dword [rbp-%zu]\n"
-                                          "    add rsp, 8\n", rsp, setup, rsp);
-                        else
-                            sprintf(save, "    sub rsp, 8\n"
-                                          "    movss dword [rbp-%zu], xmm0\n"
-                                          "%s"
-                                          "    cvtsi2ss xmm1, eax\n"
-                                          "    movss xmm0, dword [rbp-%zu]\n"
-                                          "    add rsp, 8\n", rsp, setup, rsp);
-                    } else {
-                        setup = emit_ast(right);
-                        save = calloc(strlen(setup) + 256, sizeof(char));
-
-                        if (strcmp(result_reg, "xmm0") == 0)
-                            sprintf(save, "    sub rsp, 8\n"
-                                          "    movss dword [rbp-%zu], xmm0\n"
-                                          "%s"
-                                          "    movss xmm1, xmm0\n"
-                                          "    movss xmm0, dword [rbp-%zu]\n"
-                                          "    add rsp, 8\n", rsp, setup, rsp);
-                        else
-                            sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
-                                          "%s"
-                                          "    cvtsi2ss xmm1, eax\n"
-                                          "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
-                    }
+                    setup = emit_ast(right);
+                    save = calloc(strlen(setup) + 256, sizeof(char));
+
+                    if (strcmp(result_reg, "xmm0") == 0)
+                        sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
+                                      "%s"
+                                      "    movss xmm1, xmm0\n"
+                                      "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
+                    else
+                        sprintf(save, "    movss dword [rbp-%zu], xmm0\n"
+                                      "%s"
+                                      "    cvtsi2ss xmm1, eax\n"
+                                      "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
 
                     strcpy(right_value, "xmm1");
                 } else {
-                    rsp_cap += 8;
                     setup = emit_ast(right);
-                    rsp_cap -= 8;
 
                     save = calloc(strlen(setup) + 256, sizeof(char));
 
                     if (strcmp(result_reg, "xmm0") == 0) {
-                        sprintf(save, "    push rax\n"
+                        sprintf(save, "    mov qword [rbp-%zu], rax\n"
                                       "%s"
                                       "    movss xmm1, xmm0\n"
-                                      "    pop rax\n"
-                                      "    cvtsi2ss xmm0, eax\n", setup);
+                                      "    mov rax, qword [rbp-%zu]\n"
+                                      "    cvtsi2ss xmm0, eax\n", rsp, setup, rsp);
 
                         strcpy(left_value, "xmm0");
                         strcpy(right_value, "xmm1");
                         is_float = true;
                     } else {
-                        sprintf(save, "    push rax\n"
+                        sprintf(save, "    mov qword [rbp-%zu], rax\n"
                                       "%s"
                                       "    mov ebx, eax\n"
-                                      "    pop rax\n", setup);
+                                      "    mov rax, qword [rbp-%zu]\n", rsp, setup, rsp);
                         strcpy(right_value, "ebx");
                     }
                 }
@@ -1981,8 +2826,9 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 setup = save;
                 break;
             }
+            case AST_SUBSCR:
             case AST_DEREF: {
-                AST *sym = sym_find(AST_ASSIGN, right->scope_def, right->deref.name);
+                AST *sym = sym_find(AST_ASSIGN, right->scope_def, right->type == AST_SUBSCR ? right->subscr.name : right->deref.name);
                 char *base_type = strdup(sym->assign.type);
                 base_type[strlen(base_type) - 1] = '\0';
 
@@ -1995,111 +2841,66 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
 
                 if (strcmp(base_type, "char") == 0) {
                     if (is_float) {
-                        if (rsp + 8 > rsp_cap) {
-                            rsp_cap += 8;
-                            setup = emit_ast(right);
-                            rsp_cap -= 8;
-                            temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                            sprintf(temp, "    sub rsp, 8\n"
-                                        "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    movsx eax, byte %s+r10*1]\n"
-                                        "    cvtsi2ss xmm1, eax\n"
-                                        "    movss xmm0, dword [rbp-%zu]\n"
-                                        "    add rsp, 8\n", rsp + 8, setup, rbp, rsp + 8);
-
-                        } else {
-                            setup = emit_ast(right);
-                            temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
-
-                            sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    movsx eax, byte %s+r10*1]\n"
-                                        "    cvtsi2ss xmm1, eax\n"
-                                        "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rbp, rsp + 8);
-                        }
+                        setup = emit_ast(right);
+                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+
+                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                    "%s"
+                                    "    movsx eax, byte %s+r10*1]\n"
+                                    "    cvtsi2ss xmm1, eax\n"
+                                    "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                         strcpy(right_value, "xmm1");
                     } else {
                         setup = emit_ast(right);
                         temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                        sprintf(temp, "    push rax\n"
+                        sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                     "%s"
                                     "    movsx ebx, byte %s+r10*1]\n"
-                                    "    pop rax\n", setup, rbp);
+                                    "    mov rax, qword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                         strcpy(right_value, "ebx");
                     }
                 } else if (strcmp(base_type, "int") == 0) {
                     if (is_float) {
-                        if (rsp + 8 > rsp_cap) {
-                            rsp_cap += 8;
-                            setup = emit_ast(right);
-                            rsp_cap -= 8;
-                            temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                            sprintf(temp, "    sub rsp, 8\n"
-                                        "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    cvtsi2ss xmm1, dword %s+r10*4]\n"
-                                        "    movss xmm0, dword [rbp-%zu]\n"
-                                        "    add rsp, 8\n", rsp + 8, setup, rbp, rsp + 8);
-
-                        } else {
-                            setup = emit_ast(right);
-                            temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
-
-                            sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    cvtsi2ss xmm1, dword %s+r10*4]\n"
-                                        "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rbp, rsp + 8);
-                        }
+                        setup = emit_ast(right);
+                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+
+                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                    "%s"
+                                    "    cvtsi2ss xmm1, dword %s+r10*4]\n"
+                                    "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rbp, rsp);
 
                         strcpy(right_value, "xmm1");
                     } else {
                         setup = emit_ast(right);
                         temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                        sprintf(temp, "    push rax\n"
+                        sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                     "%s"
-                                    "    pop rax\n", setup);
+                                    "    mov rax, qword [rbp-%zu]\n", rsp, setup, rsp);
 
                         sprintf(right_value, "dword %s+r10*4]", rbp);
                     }
                 } else {
                     if (is_float) {
-                        if (rsp + 8 > rsp_cap) {
-                            rsp_cap += 8;
-                            setup = emit_ast(right);
-                            rsp_cap -= 8;
-                            temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
-
-                            sprintf(temp, "    sub rsp, 8\n"
-                                        "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    movss xmm0, dword [rbp-%zu]\n"
-                                        "    add rsp, 8\n", rsp + 8, setup, rsp + 8);
-
-                        } else {
-                            setup = emit_ast(right);
-                            temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
-
-                            sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
-                                        "%s"
-                                        "    movss xmm0, dword [rbp-%zu]\n", rsp + 8, setup, rsp + 8);
-                        }
+                        setup = emit_ast(right);
+                        temp = calloc(strlen(setup) + strlen(rbp) + 128, sizeof(char));
+
+                        sprintf(temp, "    movss dword [rbp-%zu], xmm0\n"
+                                    "%s"
+                                    "    movss xmm0, dword [rbp-%zu]\n", rsp, setup, rsp);
 
                         strcpy(right_value, "xmm1");
                     } else {
                         setup = emit_ast(right);
                         temp = calloc(strlen(setup) + strlen(rbp) + 256, sizeof(char));
 
-                        sprintf(temp, "    push rax\n"
+                        sprintf(temp, "    mov qword [rbp-%zu], rax\n"
                                     "%s"
-                                    "    pop rax\n"
-                                    "    cvtsi2ss xmm0, eax\n", setup);
+                                    "    mov rax, qword [rbp-%zu]\n"
+                                    "    cvtsi2ss xmm0, eax\n", rsp, setup, rsp);
                         is_float = true;
 
                     }
@@ -2113,7 +2914,8 @@ char *emit_cond(AST **expr, size_t expr_cnt, char *true_label, char *false_label
                 setup = temp;
                 break;
             }
-            default: assert(false);
+            default:
+                fatal("steelc: error: %zu:%zu: unsupported operand '%s' in condition\n", right->ln, right->col, ast_types[right->type]);
         }
 
         if (setup != NULL) {
@@ -2278,7 +3080,356 @@ char *emit_while(AST *ast) {
     return code;
 }
 
+/* Vectorizer for counted loops over int and float arrays:
+ *
+ * for (mut int i = <int>; i < <int>; i += 1)
+ *     dst[i] = <elem>;     fill, copy or elementwise math
+ *     acc += <elem>;       reduction
+ *
+ * <elem> is an operand or 'operand op operand', where an operand is an array
+ * subscripted by i or a loop invariant constant or variable. The trip count
+ * is known, so the vector loop runs a whole number of times and the remainder
+ * is unrolled as scalar code. Loops are only vectorized when optimizing,
+ * and float reductions only with -ffast-math, as summing in lanes rounds
+ * differently from summing in order.
+ */
+bool vec_is_elem(AST *op, AST *ivar, char *type) {
+    if (op->type != AST_SUBSCR || op->subscr.value != NULL || op->subscr.index->type != AST_VAR)
+        return false;
+    else if (sym_find(AST_ASSIGN, op->scope_def, op->subscr.index->var.name) != ivar)
+        return false;
+
+    AST *arr = sym_find(AST_ASSIGN, op->scope_def, op->subscr.name);
+    return arr->assign.arr_cap > 0 && strncmp(arr->assign.type, type, strlen(type)) == 0 && strcmp(arr->assign.type + strlen(type), "*") == 0;
+}
+
+// A loop invariant operand, which the loop itself can't write: not i, the accumulator or the destination
+bool vec_is_splat(AST *op, AST *ivar, AST *acc, AST *dst, char *type) {
+    if (op->type == AST_INT)
+        return true;
+    else if (op->type == AST_FLOAT)
+        return strcmp(type, "float") == 0;
+    else if (op->type != AST_VAR)
+        return false;
+
+    AST *var = sym_find(AST_ASSIGN, op->scope_def, op->var.name);
+    return var != ivar && var != acc && var != dst && var->assign.arr_cap == 0 && strcmp(var->assign.type, type) == 0;
+}
+
+bool vec_expr_ok(AST **e, size_t e_cnt, AST *ivar, AST *acc, AST *dst, char *type) {
+    if (e_cnt != 1 && e_cnt != 3)
+        return false;
+
+    for (size_t i = 0; i < e_cnt; i += 2) {
+        if (!vec_is_elem(e[i], ivar, type) && !vec_is_splat(e[i], ivar, acc, dst, type))
+            return false;
+    }
+
+    if (e_cnt == 1)
+        return true;
+
+    switch (e[1]->oper.kind) {
+        case TOK_PLUS:
+        case TOK_MINUS: return true;
+        case TOK_STAR: return strcmp(type, "float") == 0 || march >= ARCH_SSE4_1;
+        case TOK_SLASH: return strcmp(type, "float") == 0;
+        default: return false;
+    }
+}
+
+char *vec_addr(AST *arr, size_t offset) {
+    char *addr = calloc(strlen(arr->assign.rbp) + 32, sizeof(char));
+    strcpy(addr, arr->assign.rbp);
+
+    if (offset > 0)
+        sprintf(addr + strlen(addr) - 1, "+r10*4+%zu]", offset);
+    else
+        sprintf(addr + strlen(addr) - 1, "+r10*4]");
+
+    return addr;
+}
+
+// Scalar source of a loop invariant operand, shared by the broadcast and the scalar epilogue
+char *vec_src(AST *op, char *type) {
+    char *src = calloc(64, sizeof(char));
+
+    if (op->type == AST_VAR)
+        sprintf(src, "dword %s", sym_find(AST_ASSIGN, op->scope_def, op->var.name)->assign.rbp);
+    else if (strcmp(type, "float") == 0)
+        sprintf(src, "dword [__f%zu]", float_init(32, op->data.digit));
+    else
+        sprintf(src, "%d", (int)op->data.digit);
+
+    return src;
+}
+
+char *emit_for_vec(AST *ast) {
+    AST *init = ast->for_.init;
+    AST **cond = ast->for_.cond;
+    AST *math = ast->for_.math;
+
+    if (!optimize || ast->for_.body_cnt != 1 || ast->for_.cond_cnt != 3)
+        return NULL;
+    else if (init->assign.type == NULL || strcmp(init->assign.type, "int") != 0 || init->assign.value == NULL || init->assign.value->type != AST_INT)
+        return NULL;
+    else if (cond[0]->type != AST_VAR || sym_find(AST_ASSIGN, cond[0]->scope_def, cond[0]->var.name) != init)
+        return NULL;
+    else if (cond[2]->type != AST_INT || (cond[1]->oper.kind != TOK_LT && cond[1]->oper.kind != TOK_LTE))
+        return NULL;
+    else if (math->assign.type != NULL || math->assign.value == NULL || math->assign.value->type != AST_MATH || math->assign.value->math.expr_cnt != 3)
+        return NULL;
+
+    AST **step = math->assign.value->math.expr;
+    if (sym_find(AST_ASSIGN, math->scope_def, math->assign.name) != init || step[0]->type != AST_VAR || sym_find(AST_ASSIGN, step[0]->scope_def, step[0]->var.name) != init)
+        return NULL;
+    else if (step[1]->oper.kind != TOK_PLUS || step[2]->type != AST_INT || (int)step[2]->data.digit != 1)
+        return NULL;
+
+    int start = (int)init->assign.value->data.digit;
+    int end = (int)cond[2]->data.digit + (cond[1]->oper.kind == TOK_LTE ? 1 : 0);
+    size_t lanes = march == ARCH_AVX2 ? 8 : 4;
+
+    if (end - start < (int)lanes)
+        return NULL;
+
+    AST *stmt = ast->for_.body[0];
+    AST *dst = NULL;
+    AST *acc = NULL;
+    TokType acc_op = TOK_PLUS;
+    AST **e;
+    size_t e_cnt;
+    char *type;
+
+    if (stmt->type == AST_SUBSCR) {
+        if (stmt->subscr.index->type != AST_VAR || sym_find(AST_ASSIGN, stmt->scope_def, stmt->subscr.index->var.name) != init)
+            return NULL;
+
+        dst = sym_find(AST_ASSIGN, stmt->scope_def, stmt->subscr.name);
+
+        if (dst->assign.arr_cap == 0)
+            return NULL;
+        else if (strcmp(dst->assign.type, "int*") == 0)
+            type = "int";
+        else if (strcmp(dst->assign.type, "float*") == 0)
+            type = "float";
+        else
+            return NULL;
+
+        if (stmt->subscr.value->type == AST_MATH) {
+            e = stmt->subscr.value->math.expr;
+            e_cnt = stmt->subscr.value->math.expr_cnt;
+        } else {
+            e = &stmt->subscr.value;
+            e_cnt = 1;
+        }
+    } else if (stmt->type == AST_ASSIGN && stmt->assign.type == NULL && stmt->assign.value->type == AST_MATH) {
+        AST **expr = stmt->assign.value->math.expr;
+        acc = sym_find(AST_ASSIGN, stmt->scope_def, stmt->assign.name);
+
+        if (acc == init || acc->assign.arr_cap > 0)
+            return NULL;
+        else if (strcmp(acc->assign.type, "int") == 0)
+            type = "int";
+        else if (strcmp(acc->assign.type, "float") == 0 && fast_math)
+            type = "float";
+        else
+            return NULL;
+
+        if (expr[0]->type != AST_VAR || sym_find(AST_ASSIGN, expr[0]->scope_def, expr[0]->var.name) != acc)
+            return NULL;
+
+        acc_op = expr[1]->oper.kind;
+        e = expr + 2;
+        e_cnt = stmt->assign.value->math.expr_cnt - 2;
+
+        // acc + a - b == acc + (a - b), but acc - a - b != acc - (a - b)
+        if (acc_op != TOK_PLUS && acc_op != TOK_MINUS)
+            return NULL;
+        else if (e_cnt == 3 && acc_op == TOK_MINUS && e[1]->oper.kind != TOK_STAR && e[1]->oper.kind != TOK_SLASH)
+            return NULL;
+        else if (!vec_is_elem(e[0], init, type) && (e_cnt == 1 || !vec_is_elem(e[2], init, type)))
+            return NULL;
+    } else
+        return NULL;
+
+    if (!vec_expr_ok(e, e_cnt, init, acc, dst, type))
+        return NULL;
+
+    bool is_float = strcmp(type, "float") == 0;
+    bool avx = march == ARCH_AVX2;
+    char v = avx ? 'y' : 'x';
+    const char *vmov = is_float ? (avx ? "vmovups" : "movups") : (avx ? "vmovdqu" : "movdqu");
+    int vec_end = start + (end - start) / (int)lanes * (int)lanes;
+    char *label = label_init();
+    char *srcs[3] = { NULL, NULL, NULL };
+    char *code = calloc(1, sizeof(char));
+
+    append(&code, "    mov r10, %d\n", start);
+
+    for (size_t i = 0; i < e_cnt; i += 2) {
+        if (vec_is_elem(e[i], init, type))
+            continue;
+
+        size_t reg = i == 0 ? 2 : 3;
+        srcs[i] = vec_src(e[i], type);
+
+        if (is_float && avx)
+            append(&code, "    vbroadcastss ymm%zu, %s\n", reg, srcs[i]);
+        else if (is_float)
+            append(&code, "    movss xmm%zu, %s\n"
+                          "    shufps xmm%zu, xmm%zu, 0\n", reg, srcs[i], reg, reg);
+        else if (e[i]->type == AST_INT && avx)
+            append(&code, "    mov eax, %s\n"
+                          "    vmovd xmm%zu, eax\n"
+                          "    vpbroadcastd ymm%zu, xmm%zu\n", srcs[i], reg, reg, reg);
+        else if (avx)
+            append(&code, "    vpbroadcastd ymm%zu, %s\n", reg, srcs[i]);
+        else {
+            if (e[i]->type == AST_INT)
+                append(&code, "    mov eax, %s\n"
+                              "    movd xmm%zu, eax\n", srcs[i], reg);
+            else
+                append(&code, "    movd xmm%zu, %s\n", reg, srcs[i]);
+
+            append(&code, "    pshufd xmm%zu, xmm%zu, 0\n", reg, reg);
+        }
+    }
+
+    if (acc != NULL) {
+        if (avx)
+            append(&code, "    %s ymm4, ymm4, ymm4\n", is_float ? "vxorps" : "vpxor");
+        else
+            append(&code, "    %s xmm4, xmm4\n", is_float ? "xorps" : "pxor");
+    }
+
+    append(&code, "%s:\n", label);
+
+    size_t res = 0;
+    char *addr;
+
+    if (vec_is_elem(e[0], init, type)) {
+        addr = vec_addr(sym_find(AST_ASSIGN, e[0]->scope_def, e[0]->subscr.name), 0);
+        append(&code, "    %s %cmm0, %s\n", vmov, v, addr);
+        free(addr);
+    } else if (e_cnt == 1)
+        res = 2;
+    else
+        append(&code, "    %s %cmm0, %cmm2\n", avx ? "vmovaps" : "movaps", v, v);
+
+    if (e_cnt == 3) {
+        const char *instr = vec_instr(e[1]->oper.kind, is_float, false);
+
+        if (!vec_is_elem(e[2], init, type)) {
+            if (avx)
+                append(&code, "    v%s ymm0, ymm0, ymm3\n", instr);
+            else
+                append(&code, "    %s xmm0, xmm3\n", instr);
+        } else {
+            addr = vec_addr(sym_find(AST_ASSIGN, e[2]->scope_def, e[2]->subscr.name), 0);
+
+            if (avx)
+                append(&code, "    v%s ymm0, ymm0, %s\n", instr, addr);
+            else
+                append(&code, "    %s xmm1, %s\n"
+                              "    %s xmm0, xmm1\n", vmov, addr, instr);
+
+            free(addr);
+        }
+    }
+
+    if (dst != NULL) {
+        addr = vec_addr(dst, 0);
+        append(&code, "    %s %s, %cmm%zu\n", vmov, addr, v, res);
+        free(addr);
+    } else if (avx)
+        append(&code, "    %s ymm4, ymm4, ymm%zu\n", is_float ? "vaddps" : "vpaddd", res);
+    else
+        append(&code, "    %s xmm4, xmm%zu\n", is_float ? "addps" : "paddd", res);
+
+    append(&code, "    add r10, %zu\n"
+                  "    cmp r10, %d\n"
+                  "    jl %s\n", lanes, vec_end, label);
+
+    if (avx) {
+        if (acc != NULL && is_float)
+            append(&code, "    vextractf128 xmm0, ymm4, 1\n"
+                          "    vaddps xmm4, xmm4, xmm0\n");
+        else if (acc != NULL)
+            append(&code, "    vextracti128 xmm0, ymm4, 1\n"
+                          "    vpaddd xmm4, xmm4, xmm0\n");
+
+        append(&code, "    vzeroupper\n");
+    }
+
+    if (acc != NULL && is_float)
+        append(&code, "    movhlps xmm0, xmm4\n"
+                      "    addps xmm4, xmm0\n"
+                      "    movaps xmm0, xmm4\n"
+                      "    shufps xmm0, xmm0, 0x55\n"
+                      "    addss xmm4, xmm0\n");
+    else if (acc != NULL)
+        append(&code, "    pshufd xmm0, xmm4, 0x4e\n"
+                      "    paddd xmm4, xmm0\n"
+                      "    pshufd xmm0, xmm4, 0xb1\n"
+                      "    paddd xmm4, xmm0\n"
+                      "    movd ecx, xmm4\n");
+
+    // Scalar epilogue, r10 is left at the first remaining element
+    for (int i = 0; i < end - vec_end; i++) {
+        char *ops[3] = { NULL, NULL, NULL };
+
+        for (size_t j = 0; j < e_cnt; j += 2) {
+            if (srcs[j] != NULL)
+                ops[j] = strdup(srcs[j]);
+            else {
+                addr = vec_addr(sym_find(AST_ASSIGN, e[j]->scope_def, e[j]->subscr.name), i * 4);
+                ops[j] = calloc(strlen(addr) + 8, sizeof(char));
+                sprintf(ops[j], "dword %s", addr);
+                free(addr);
+            }
+        }
+
+        append(&code, "    %s %s, %s\n", is_float ? "movss" : "mov", is_float ? "xmm0" : "eax", ops[0]);
+
+        if (e_cnt == 3)
+            append(&code, "    %s %s, %s\n", vec_instr(e[1]->oper.kind, is_float, true), is_float ? "xmm0" : "eax", ops[2]);
+
+        if (dst != NULL) {
+            addr = vec_addr(dst, i * 4);
+
+            if (is_float)
+                append(&code, "    movss dword %s, xmm0\n", addr);
+            else
+                append(&code, "    mov dword %s, eax\n", addr);
+
+            free(addr);
+        } else if (is_float)
+            append(&code, "    addss xmm4, xmm0\n");
+        else
+            append(&code, "    add ecx, eax\n");
+
+        free(ops[0]);
+        free(ops[2]);
+    }
+
+    if (acc != NULL && is_float)
+        append(&code, "    movss xmm0, dword %s\n"
+                      "    %s xmm0, xmm4\n"
+                      "    movss dword %s, xmm0\n", acc->assign.rbp, acc_op == TOK_PLUS ? "addss" : "subss", acc->assign.rbp);
+    else if (acc != NULL)
+        append(&code, "    %s dword %s, ecx\n", acc_op == TOK_PLUS ? "add" : "sub", acc->assign.rbp);
+
+    free(srcs[0]);
+    free(srcs[2]);
+    free(label);
+    return code;
+}
+
 char *emit_for(AST *ast) {
+    char *vec = emit_for_vec(ast);
+    if (vec != NULL)
+        return vec;
+
     char *cond_label = label_init();
     char *body_label = label_init();
     char *end_label = label_init();
@@ -2353,7 +3504,8 @@ char *emit_subscr(AST *ast) {
             else
                 strcat(code, "    mov r10, rax\n");
             break;
-        default: assert(false);
+        default:
+            fatal("steelc: error: %zu:%zu: unsupported index '%s'\n", index->ln, index->col, ast_types[index->type]);
     }
 
     return code;
@@ -2390,7 +3542,6 @@ char *emit_ast(AST *ast) {
         case AST_SUBSCR: return ast->subscr.value == NULL ? emit_subscr(ast) : emit_assign(ast);
         case AST_DEREF: return emit_deref_as_subscr(ast);
         default:
-            fprintf(stderr, "steelc: error: missing backend for '%s'\n", ast_types[ast->type]);
-            exit(EXIT_FAILURE);
+            fatal("steelc: error: missing backend for '%s'\n", ast_types[ast->type]);
     }
 }
@@ -2,7 +2,21 @@
 #define EMIT_H
 
 #include "ast.h"
+#include "state.h"
 
+typedef enum {
+    ARCH_X86_64,
+    ARCH_SSE4_1,
+    ARCH_AVX2
+} Arch;
+
+extern THREAD_LOCAL Arch march;
+extern THREAD_LOCAL bool fast_math;
+extern THREAD_LOCAL bool link_libc;
+extern THREAD_LOCAL char *stack_usage;
+
+void append(char **code, const char *fmt, ...);
 char *emit_ast(AST *ast);
+void emit_reset(void);
 
 #endif
\ No newline at end of file
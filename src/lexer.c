@@ -1,47 +1,76 @@
 #include "lexer.h"
 #include "token.h"
+#include "state.h"
+#include "report.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 extern char *tok_types[];
 
-char *read_file(char *file) {
-    FILE *f = fopen(file, "r");
-    if (f == NULL) {
-        fprintf(stderr, "%s: error: no such file exists\n", file);
-        exit(EXIT_FAILURE);
+/* Files are mapped rather than read. The bytes after the end of a file up
+ * to the end of its last page read as zero, which ends the source, so a
+ * file whose size is a multiple of the page size is read instead. */
+Lex *lex_init(char *file) {
+    phase_push(PHASE_READ);
+    int fd = open(file, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fatal("%s: error: no such file exists\n", file);
     }
 
-    char *src = calloc(1, sizeof(char));
-    char c;
-    size_t len = 0;
+    size_t len = st.st_size;
+    char *src;
 
-    while ((c = fgetc(f)) != EOF) {
-        src[len++] = c;
-        src = realloc(src, (len + 1) * sizeof(char));
+    if (len % (size_t)sysconf(_SC_PAGESIZE) != 0 && (src = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+        close(fd);
+        phase_pop();
+
+        Lex *lex = lex_init_src(file, src, 1, 1);
+        lex->map_len = len;
+        return lex;
     }
 
-    src[len] = '\0';
-    fclose(f);
-    return src;
+    src = malloc(len + 1);
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len && (n = read(fd, src + got, len - got)) > 0)
+        got += n;
+
+    src[got] = '\0';
+    close(fd);
+    phase_pop();
+    return lex_init_src(file, src, 1, 1);
 }
 
-Lex *lex_init(char *file) {
+// Lexes src, which the lexer owns, as if it started at ln:col of file
+Lex *lex_init_src(char *file, char *src, size_t ln, size_t col) {
     Lex *lex = malloc(sizeof(Lex));
     lex->file = file;
-    lex->src = read_file(file);
+    lex->src = src;
     lex->src_len = strlen(lex->src);
     lex->ch = lex->src[0];
     lex->pos = 0;
-    lex->ln = lex->col = 1;
+    lex->ln = ln;
+    lex->col = col;
+    lex->map_len = 0;
     return lex;
 }
 
 void lex_del(Lex *lex) {
-    free(lex->src);
+    if (lex->map_len > 0)
+        munmap(lex->src, lex->map_len);
+    else
+        free(lex->src);
+
     free(lex);
 }
 
@@ -67,6 +96,81 @@ char lex_peek(Lex *lex, int offset) {
     return lex->src[lex->pos + offset];
 }
 
+/* Conditional directives are read by the parser, but the lines they leave
+ * out are skipped here as plain text so they're never tokenized. A
+ * directive is a '#' starting a line, only blanks before it. */
+const char *cond_directives[] = { "if", "ifdef", "ifndef", "elif", "else", "endif" };
+
+// Whether src starts with the whole word, blanks before it
+bool word_at(char *src, const char *word) {
+    size_t len = strlen(word);
+
+    while (*src == ' ' || *src == '\t')
+        src++;
+
+    return strncmp(src, word, len) == 0 && !isalnum(src[len]) && src[len] != '_';
+}
+
+// The conditional directive at src just after a '#', NULL if there is none
+const char *directive_at(char *src) {
+    for (size_t i = 0; i < sizeof(cond_directives) / sizeof(cond_directives[0]); i++) {
+        if (word_at(src, cond_directives[i]))
+            return cond_directives[i];
+    }
+
+    return NULL;
+}
+
+const char *lex_directive(Lex *lex) {
+    return directive_at(lex->src + lex->pos);
+}
+
+bool lex_at(Lex *lex, const char *word) {
+    return word_at(lex->src + lex->pos, word);
+}
+
+// Returns the rest of the current line, the lexer stops at its newline
+char *lex_line(Lex *lex) {
+    size_t beg = lex->pos;
+
+    while (lex->ch != '\0' && lex->ch != '\n')
+        lex_step(lex);
+
+    char *line = calloc(lex->pos - beg + 1, sizeof(char));
+    memcpy(line, lex->src + beg, lex->pos - beg);
+    return line;
+}
+
+// Skips to the '#' of the next #elif, #else or #endif not inside another #if, false if the source ends first
+bool lex_skip(Lex *lex) {
+    size_t depth = 0;
+    bool line_beg = false;
+
+    while (lex->ch != '\0') {
+        if (lex->ch == '\n')
+            line_beg = true;
+        else if (lex->ch == '#' && line_beg) {
+            const char *dir = directive_at(lex->src + lex->pos + 1);
+
+            if (dir == NULL)
+                line_beg = false;
+            else if (strncmp(dir, "if", 2) == 0)
+                depth++;
+            else if (depth == 0)
+                return true;
+            else if (strcmp(dir, "endif") == 0)
+                depth--;
+
+            line_beg = false;
+        } else if (!isspace(lex->ch))
+            line_beg = false;
+
+        lex_step(lex);
+    }
+
+    return false;
+}
+
 Tok *lex_step_with(Lex *lex, TokType type, char *value) {
     Tok *tok = tok_init(type, strdup(value), lex->ln, lex->col);
 
@@ -76,7 +180,7 @@ Tok *lex_step_with(Lex *lex, TokType type, char *value) {
     return tok;
 }
 
-Tok *lex_next(Lex *lex) {
+Tok *lex_scan(Lex *lex) {
     while (isspace(lex->ch))
         lex_step(lex);
 
@@ -89,13 +193,13 @@ Tok *lex_next(Lex *lex) {
 
         lex_step(lex);
         lex_step(lex);
-        return lex_next(lex);
+        return lex_scan(lex);
     } else if (lex->ch == '/' && lex_peek(lex, 1) == '/') {
         while (lex->ch != '\0' && lex->ch != '\n')
             lex_step(lex);
 
         lex_step(lex);
-        return lex_next(lex);
+        return lex_scan(lex);
     }
 
     char *value;
@@ -154,8 +258,7 @@ Tok *lex_next(Lex *lex) {
                     sprintf(value, "%d", (int)lex->ch);
                     break;
                 default:
-                    fprintf(stderr, "%s:%zu:%zu: error: unsupported escape sequence '\\%c'\n", lex->file, lex->ln, col, lex->ch);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: unsupported escape sequence '\\%c'\n", lex->file, lex->ln, col, lex->ch);
             }
         } else
             sprintf(value, "%d", (int)lex->ch);
@@ -163,8 +266,7 @@ Tok *lex_next(Lex *lex) {
         lex_step(lex);
 
         if (lex->ch != '\'') {
-            fprintf(stderr, "%s:%zu:%zu: error: unclosed character constant\n", lex->file, lex->ln, col);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: unclosed character constant\n", lex->file, lex->ln, col);
         }
 
         lex_step(lex);
@@ -182,11 +284,9 @@ Tok *lex_next(Lex *lex) {
         value[len] = '\0';
 
         if (lex->ch != '"') {
-            fprintf(stderr, "%s:%zu:%zu: error: unclosed string literal\n", lex->file, lex->ln, lex->col - len - 1);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: unclosed string literal\n", lex->file, lex->ln, lex->col - len - 1);
         } else if (len < 1) {
-            fprintf(stderr, "%s:%zu:%zu: error: empty string literal\n", lex->file, lex->ln, lex->col - len - 1);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: empty string literal\n", lex->file, lex->ln, lex->col - len - 1);
         }
 
         lex_step(lex);
@@ -251,6 +351,12 @@ Tok *lex_next(Lex *lex) {
         default: break;
     }
 
-    fprintf(stderr, "%s:%zu:%zu: error: unknown character '%c'\n", lex->file, lex->ln, lex->col, lex->ch);
-    exit(EXIT_FAILURE);
-}
\ No newline at end of file
+    fatal("%s:%zu:%zu: error: unknown character '%c'\n", lex->file, lex->ln, lex->col, lex->ch);
+}
+// Timed as a whole for -ftime-report, lex_scan() calls itself past comments
+Tok *lex_next(Lex *lex) {
+    phase_push(PHASE_LEX);
+    Tok *tok = lex_scan(lex);
+    phase_pop();
+    return tok;
+}
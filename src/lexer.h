@@ -3,6 +3,7 @@
 
 #include "token.h"
 #include <stdio.h>
+#include <stdbool.h>
 
 typedef struct {
     char *file;
@@ -12,11 +13,16 @@ typedef struct {
     size_t pos;
     size_t ln;
     size_t col;
+    size_t map_len;
 } Lex;
 
-char *read_file(char *file);
 Lex *lex_init(char *file);
+Lex *lex_init_src(char *file, char *src, size_t ln, size_t col);
 void lex_del(Lex *lex);
+const char *lex_directive(Lex *lex);
+bool lex_at(Lex *lex, const char *word);
+char *lex_line(Lex *lex);
+bool lex_skip(Lex *lex);
 Tok *lex_next(Lex *lex);
 
 #endif
\ No newline at end of file
@@ -1,35 +1,305 @@
 #include "parser.h"
 #include "ast.h"
 #include "emit.h"
+#include "opt.h"
+#include "module.h"
+#include "server.h"
+#include "test.h"
+#include "report.h"
+#include "command.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include <dirent.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
-extern Const **constants;
-extern char **aliases;
+extern THREAD_LOCAL Const **constants;
+extern THREAD_LOCAL char **aliases;
 
-void test(char *file) {
+// Dependency files for make, written to <base>.d or deps_out naming deps_target or the output
+bool make_deps = false;
+char *deps_out = NULL;
+char *deps_target = NULL;
+
+// The output base of a file, its name without directories or extension
+char *stem(char *file) {
+    char *outbase;
+
+    if (strchr(file, '/') != NULL)
+        outbase = strdup(strrchr(file, '/') + 1);
+    else
+        outbase = strdup(file);
+
+    if (strchr(outbase, '.') != NULL)
+        *strchr(outbase, '.') = '\0';
+
+    return outbase;
+}
+
+void write_deps(char *file, char *outbase, char *ext) {
+    if (!make_deps)
+        return;
+
+    char *target = calloc(strlen(outbase) + strlen(ext) + 1, sizeof(char));
+    char *path = calloc(strlen(outbase) + 3, sizeof(char));
+    sprintf(target, "%s%s", outbase, ext);
+    sprintf(path, "%s.d", outbase);
+
+    if (!deps_write(deps_out != NULL ? deps_out : path, deps_target != NULL ? deps_target : target, file)) {
+        fprintf(stderr, "%s: error: failed to write to file '%s'\n", file, deps_out != NULL ? deps_out : path);
+        exit(EXIT_FAILURE);
+    }
+
+    free(target);
+    free(path);
+}
+
+// Where inputs are compiled to when they're only there to be linked, so parallel builds don't collide
+char obj_tmp[] = "/tmp/steelc-XXXXXX";
+char *obj_dir = NULL;
+pid_t obj_dir_owner;
+
+// The object file a base compiles to
+char *obj_path(char *outbase) {
+    char *path = calloc((obj_dir != NULL ? strlen(obj_dir) : 0) + strlen(outbase) + 4, sizeof(char));
+
+    if (obj_dir != NULL)
+        sprintf(path, "%s/%s.o", obj_dir, outbase);
+    else
+        sprintf(path, "%s.o", outbase);
+
+    return path;
+}
+
+// Also run when compiling or linking fails, but not by the processes compiling each input
+void obj_dir_del(void) {
+    if (obj_dir == NULL || getpid() != obj_dir_owner)
+        return;
+
+    DIR *dr = opendir(obj_dir);
+    struct dirent *de;
+
+    while (dr != NULL && (de = readdir(dr)) != NULL) {
+        char *path = calloc(strlen(obj_dir) + strlen(de->d_name) + 2, sizeof(char));
+        sprintf(path, "%s/%s", obj_dir, de->d_name);
+
+        if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0)
+            remove(path);
+
+        free(path);
+    }
+
+    if (dr != NULL)
+        closedir(dr);
+
+    rmdir(obj_dir);
+    obj_dir = NULL;
+}
+
+// Compiles a file into <base>.asm, or its object file if assembling, and returns the base
+char *compile(char *file, bool assemble) {
+    uint64_t key = 0;
+    char *outbase = stem(file);
+    char *obj = obj_path(outbase);
+    char *outsu = NULL;
+
+    if (stack_usage != NULL) {
+        outsu = calloc(strlen(outbase) + 4, sizeof(char));
+        sprintf(outsu, "%s.su", outbase);
+    }
+
+    if (object_cache != NULL && assemble) {
+        key = object_key(file);
+
+        if (object_load(key, obj, outsu)) {
+            write_deps(file, outbase, ".o");
+            free(obj);
+            free(outsu);
+            return outbase;
+        }
+    }
+
+    phase_push(PHASE_PARSE);
     AST *root = prs_file(file);
-    free(emit_ast(root));
+    phase_pop();
+
+    if (optimize) {
+        phase_push(PHASE_OPT);
+        opt_ast(root);
+        phase_pop();
+    }
+
+    phase_push(PHASE_EMIT);
+    char *code = emit_ast(root);
+    phase_pop();
     ast_del(root);
     free(aliases);
+    free(constants);
+
+    if (stack_usage != NULL) {
+        FILE *f = fopen(outsu, "w");
+        if (f == NULL) {
+            fprintf(stderr, "%s: error: failed to write to file '%s'\n", file, outsu);
+            exit(EXIT_FAILURE);
+        }
+
+        for (char *line = strtok(stack_usage, "\n"); line != NULL; line = strtok(NULL, "\n"))
+            fprintf(f, "%s:%s\n", file, line);
+
+        fclose(f);
+        free(stack_usage);
+        stack_usage = calloc(1, sizeof(char));
+    }
+
+    if (!assemble) {
+        char *outasm = calloc(strlen(outbase) + 5, sizeof(char));
+        sprintf(outasm, "%s.asm", outbase);
+
+        phase_push(PHASE_WRITE);
+
+        FILE *f = fopen(outasm, "w");
+        if (f == NULL) {
+            fprintf(stderr, "%s: error: failed to write to file '%s'\n", file, outasm);
+            exit(EXIT_FAILURE);
+        }
+
+        fputs(code, f);
+        fclose(f);
+        phase_pop();
+
+        write_deps(file, outbase, ".asm");
+        report_print(file, outbase);
+        free(code);
+        free(obj);
+        free(outsu);
+        free(outasm);
+        return outbase;
+    }
+
+    /* The assembly never touches the disk, nasm reads it from a memory file
+     * it inherits through the path of the descriptor in /proc. */
+    phase_push(PHASE_WRITE);
+    int fd = memfd_create(outbase, 0);
+    size_t len = strlen(code);
+    size_t written = 0;
+    ssize_t n;
+
+    while (fd >= 0 && written < len && (n = write(fd, code + written, len - written)) > 0)
+        written += n;
+
+    if (fd < 0 || written < len) {
+        fprintf(stderr, "%s: error: failed to pass the assembly to nasm\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    free(code);
+    phase_pop();
+
+    char src[32];
+    sprintf(src, "/proc/self/fd/%d", fd);
+    char *nasm[] = { "nasm", "-felf64", src, "-o", obj, NULL };
+
+    phase_push(PHASE_ASSEMBLE);
+
+    if (!command_run(nasm)) {
+        fprintf(stderr, "%s: error: failed to assemble\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    phase_pop();
+    close(fd);
+
+    if (object_cache != NULL)
+        object_save(key, obj, outsu);
+
+    write_deps(file, outbase, ".o");
+    report_print(file, outbase);
+    free(obj);
+    free(outsu);
+    return outbase;
 }
 
-int main(int argc, char **argv) {
-    char *file = NULL;
+// Links the object of each base and link_args into out, and removes the objects
+void link_objs(char *file, char **outbases, size_t cnt, char *out, char **link_args, size_t link_args_cnt) {
+    char **cmd = calloc(cnt + link_args_cnt + 8, sizeof(char *));
+    size_t cmd_cnt = 0;
+
+    // With libraries main is entered from the C runtime, so libc is initialized
+    if (link_libc) {
+        cmd[cmd_cnt++] = "gcc";
+        cmd[cmd_cnt++] = "-no-pie";
+    } else {
+        cmd[cmd_cnt++] = "ld";
+        cmd[cmd_cnt++] = "-emain_";
+
+        if (cnt > 1)
+            cmd[cmd_cnt++] = "--require-defined=main_";
+    }
+
+    size_t objs_at = cmd_cnt;
+
+    for (size_t i = 0; i < cnt; i++)
+        cmd[cmd_cnt++] = obj_path(outbases[i]);
+
+    for (size_t i = 0; i < link_args_cnt; i++)
+        cmd[cmd_cnt++] = link_args[i];
+
+    cmd[cmd_cnt++] = "-o";
+    cmd[cmd_cnt++] = out;
+
+    phase_push(PHASE_LINK);
+
+    if (!command_run(cmd)) {
+        fprintf(stderr, "%s: error: failed to link\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    phase_pop();
+    report_print(out, out);
+
+    for (size_t i = 0; i < cnt; i++) {
+        remove(cmd[objs_at + i]);
+        free(cmd[objs_at + i]);
+    }
+
+    free(cmd);
+}
+
+int run(int argc, char **argv) {
+    char **inputs = NULL;
+    size_t inputs_cnt = 0;
+    size_t jobs = 0;
     char *out = "a.out";
     char *test_dir = NULL;
     bool assemble = true;
     bool link = true;
+    char **link_args = NULL;
+    size_t link_args_cnt = 0;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
-            printf("usage: %s [options...] <input file>\n"
+            printf("usage: %s [options...] <input files...>\n"
                    "options:\n"
+                   "  --client=<socket>    (first option) have the server at <socket> run the rest of the command\n"
+                   "  --server=<socket>    (only option) run compiles for clients connecting to <socket>\n"
                    "  -c                   output only object files\n"
+                   "  -fmodule-cache=<dir> keep parsed includes in <dir> to load them next time\n"
+                   "  -fobject-cache=<dir> keep compiled objects in <dir> to reuse them next time\n"
+                   "  -ffast-math          allow float math to be reassociated, so float reductions are vectorized\n"
+                   "  -fmem-report         print the allocations and peak memory of each compiler phase\n"
+                   "  -fstack-usage        write the stack usage of each function to <input base>.su\n"
+                   "  -ftime-report        print the time each compiler phase took\n"
+                   "  -ftime-trace         write the phases as a Chrome trace to <input base>.json\n"
+                   "  -j <jobs>            compile up to <jobs> input files or tests at once\n"
+                   "  -l<library>          link against <library> through the C runtime\n"
+                   "  -march=<arch>        generate code for <arch> (x86-64, sse4.1, avx2)\n"
+                   "  -MD                  write the files each input depends on to <input base>.d for make\n"
+                   "  -MF <file>           write them to <file> instead\n"
                    "  -o <output file>     place the output into <output file>\n"
+                   "  -O0                  disable optimizations\n"
                    "  -t <test directory>  (development only) test each file in <test directory>\n"
                    "  -S                   output only assembly files\n", argv[0]);
             return EXIT_SUCCESS;
@@ -42,6 +312,27 @@ int main(int argc, char **argv) {
             }
 
             out = argv[++i];
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            char *arg = argv[i] + 2;
+
+            if (*arg == '\0') {
+                if (i == argc - 1) {
+                    fprintf(stderr, "steelc: error: missing argument <jobs> to option '-j'\n");
+                    return EXIT_FAILURE;
+                }
+
+                arg = argv[++i];
+            }
+
+            char *end;
+            long n = strtol(arg, &end, 10);
+
+            if (*arg == '\0' || *end != '\0' || n < 1) {
+                fprintf(stderr, "steelc: error: invalid number of jobs '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+
+            jobs = (size_t)n;
         } else if (strcmp(argv[i], "-t") == 0) {
             if (i == argc - 1) {
                 fprintf(stderr, "steelc: error: missing argument <test directory> to option '-t'\n");
@@ -51,123 +342,189 @@ int main(int argc, char **argv) {
             test_dir = argv[++i];
         } else if (strcmp(argv[i], "-S") == 0)
             assemble = link = false;
-        else if (i == argc - 1 && test_dir == NULL)
-            file = argv[i];
-        else {
+        else if (strcmp(argv[i], "-O0") == 0)
+            optimize = false;
+        else if (strcmp(argv[i], "-fmodule-cache") == 0)
+            module_cache = ".steelc-cache";
+        else if (strncmp(argv[i], "-fmodule-cache=", 15) == 0)
+            module_cache = argv[i] + 15;
+        else if (strcmp(argv[i], "-fobject-cache") == 0)
+            object_cache = ".steelc-cache";
+        else if (strncmp(argv[i], "-fobject-cache=", 15) == 0)
+            object_cache = argv[i] + 15;
+        else if (strcmp(argv[i], "-MD") == 0)
+            make_deps = true;
+        else if (strcmp(argv[i], "-MF") == 0) {
+            if (i == argc - 1) {
+                fprintf(stderr, "steelc: error: missing argument <file> to option '-MF'\n");
+                return EXIT_FAILURE;
+            }
+
+            deps_out = argv[++i];
+            make_deps = true;
+        } else if (strcmp(argv[i], "-ffast-math") == 0)
+            fast_math = true;
+        else if (strcmp(argv[i], "-ftime-report") == 0)
+            time_report = true;
+        else if (strcmp(argv[i], "-fmem-report") == 0)
+            mem_report = true;
+        else if (strcmp(argv[i], "-ftime-trace") == 0)
+            time_trace = true;
+        else if (strcmp(argv[i], "-fstack-usage") == 0)
+            stack_usage = calloc(1, sizeof(char));
+        else if (strncmp(argv[i], "-march=", 7) == 0) {
+            if (strcmp(argv[i] + 7, "x86-64") == 0)
+                march = ARCH_X86_64;
+            else if (strcmp(argv[i] + 7, "sse4.1") == 0)
+                march = ARCH_SSE4_1;
+            else if (strcmp(argv[i] + 7, "avx2") == 0)
+                march = ARCH_AVX2;
+            else {
+                fprintf(stderr, "steelc: error: unknown architecture '%s'\n", argv[i] + 7);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(argv[i], "-l", 2) == 0 && strlen(argv[i]) > 2) {
+            link_args = realloc(link_args, (link_args_cnt + 1) * sizeof(char *));
+            link_args[link_args_cnt++] = argv[i];
+            link_libc = true;
+        } else if (strlen(argv[i]) > 2 && (strcmp(argv[i] + strlen(argv[i]) - 2, ".o") == 0 || strcmp(argv[i] + strlen(argv[i]) - 2, ".a") == 0)) {
+            // Other objects to link with
+            link_args = realloc(link_args, (link_args_cnt + 1) * sizeof(char *));
+            link_args[link_args_cnt++] = argv[i];
+        } else if (argv[i][0] != '-' && test_dir == NULL) {
+            inputs = realloc(inputs, (inputs_cnt + 1) * sizeof(char *));
+            inputs[inputs_cnt++] = argv[i];
+        } else {
             fprintf(stderr, "steelc: error: unknown argument '%s'\n", argv[i]);
             return EXIT_FAILURE;
         }
     }
 
-    if (file == NULL && test_dir == NULL) {
+    if (inputs_cnt == 0 && test_dir == NULL) {
         fprintf(stderr, "steelc: error: missing argument <input file>\n");
         return EXIT_FAILURE;
-    } else if (test_dir != NULL) {
-        if (test_dir[strlen(test_dir) - 1] == '/')
-            test_dir[strlen(test_dir) - 1] = '\0';
+    } else if (test_dir != NULL)
+        return tests_run(test_dir, jobs > 0 ? jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN));
+    else if (jobs == 0)
+        jobs = 1;
 
-        DIR *dr = opendir(test_dir);
-        if (dr == NULL) {
-            fprintf(stderr, "steelc: error: failed to open test directory '%s'\n", test_dir);
-            return EXIT_FAILURE;
-        }
+    if (deps_out != NULL && inputs_cnt > 1) {
+        fprintf(stderr, "steelc: error: cannot write the dependencies of multiple input files to '%s'\n", deps_out);
+        return EXIT_FAILURE;
+    }
 
-        struct dirent *de;
-        char *path = calloc(1, sizeof(char));
+    // Not linked, so it may hold only exported functions for C or other files to call
+    if (!link)
+        require_main = false;
 
-        while ((de = readdir(dr)) != NULL) {
-            if (strcmp(de->d_name, "..") == 0 || strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "include.sc") == 0)
-                continue;
+    // Only then do parses keep the files they read
+    track_deps = make_deps || object_cache != NULL;
 
-            path = realloc(path, (strlen(test_dir) + strlen(de->d_name) + 2) * sizeof(char));
-            sprintf(path, "%s/%s", test_dir, de->d_name);
+    // Make rebuilds the executable when any file of any input changes
+    if (link)
+        deps_target = out;
 
-            printf("testing '%s'...\n", path);
-            test(path);
-            printf("test passed\n");
+    if (link && assemble) {
+        if (mkdtemp(obj_tmp) == NULL) {
+            fprintf(stderr, "steelc: error: failed to make a temporary directory\n");
+            return EXIT_FAILURE;
         }
 
-        free(path);
-        closedir(dr);
-        free(constants);
-        return EXIT_SUCCESS;
+        obj_dir = obj_tmp;
+        obj_dir_owner = getpid();
+        atexit(obj_dir_del);
     }
 
-    AST *root = prs_file(file);
-    char *code = emit_ast(root);
-    ast_del(root);
-    free(aliases);
-    free(constants);
+    if (inputs_cnt == 1) {
+        char *outbase = compile(inputs[0], assemble);
 
-    char *outasm;
-    char *outbase;
+        if (link)
+            link_objs(inputs[0], &outbase, 1, out, link_args, link_args_cnt);
+
+        free(outbase);
+        free(inputs);
+        free(link_args);
+        return EXIT_SUCCESS;
+    }
 
-    if (strchr(file, '/') != NULL) {
-        char *filecpy = strdup(file);
-        char *tok = strtok(filecpy, "/");
-        char *prev_tok = tok;
+    /* Multiple inputs
+     * Every input is compiled in its own process, so the parser and emitter
+     * globals start out fresh for each one, and at most jobs of them run at
+     * once. The objects are then linked together in a single step. */
+    char **outbases = malloc(inputs_cnt * sizeof(char *));
 
-        while (tok != NULL) {
-            prev_tok = tok;
-            tok = strtok(NULL, "/");
+    for (size_t i = 0; i < inputs_cnt; i++) {
+        outbases[i] = stem(inputs[i]);
+
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(outbases[i], outbases[j]) == 0) {
+                fprintf(stderr, "steelc: error: input files '%s' and '%s' would both write to '%s.o'\n", inputs[j], inputs[i], outbases[i]);
+                return EXIT_FAILURE;
+            }
         }
+    }
 
-        outbase = strdup(prev_tok);
-        free(filecpy);
-    } else
-        outbase = strdup(file);
+    // Link the objects only once they're all there
+    require_main = false;
+    size_t running = 0;
+    bool failed = false;
+    int status;
 
-    if (strchr(outbase, '.') != NULL) {
-        char *tok = strtok(outbase, ".");
+    for (size_t i = 0; i < inputs_cnt && !failed; i++) {
+        if (running == jobs) {
+            wait(&status);
+            running--;
+            failed = !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS;
 
-        outasm = calloc(strlen(tok) + 5, sizeof(char));
-        sprintf(outasm, "%s.asm", tok);
-    } else {
-        outasm = calloc(strlen(file) + 5, sizeof(char));
-        sprintf(outasm, "%s.asm", outbase);
-    }
+            if (failed)
+                break;
+        }
 
-    FILE *f = fopen(outasm, "w");
-    if (f == NULL) {
-        fprintf(stderr, "%s: error: failed to write to file '%s'\n", file, outasm);
-        return EXIT_FAILURE;
-    }
+        fflush(NULL);
+        pid_t pid = fork();
 
-    fputs(code, f);
-    fclose(f);
-    free(code);
+        if (pid < 0) {
+            fprintf(stderr, "steelc: error: failed to start compiling '%s'\n", inputs[i]);
+            failed = true;
+            break;
+        } else if (pid == 0) {
+            free(compile(inputs[i], assemble));
+            exit(EXIT_SUCCESS);
+        }
 
-    if (!assemble) {
-        free(outasm);
-        free(outbase);
-        return EXIT_SUCCESS;
+        running++;
     }
 
-    char *nasm = calloc((strlen(outasm) * 2) + strlen(outbase) + 64, sizeof(char));
-    sprintf(nasm, "nasm -felf64 %s -o %s.o && rm %s", outasm, outbase, outasm);
+    for (; running > 0; running--) {
+        wait(&status);
 
-    if (system(nasm) != 0) {
-        fprintf(stderr, "%s: error: failed to assemble\n", file);
-        exit(EXIT_FAILURE);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            failed = true;
     }
 
-    if (!link) {
-        free(nasm);
-        free(outasm);
-        free(outbase);
-        return EXIT_SUCCESS;
-    }
+    if (!failed && link)
+        link_objs("steelc", outbases, inputs_cnt, out, link_args, link_args_cnt);
 
-    nasm = realloc(nasm, ((strlen(outbase) * 2) + strlen(out) + 64) * sizeof(char));
-    sprintf(nasm, "ld -emain_ %s.o -o %s && rm %s.o", outbase, out, outbase);
+    for (size_t i = 0; i < inputs_cnt; i++)
+        free(outbases[i]);
 
-    if (system(nasm) != 0) {
-        fprintf(stderr, "%s: error: failed to link\n", file);
-        exit(EXIT_FAILURE);
+    free(outbases);
+    free(inputs);
+    free(link_args);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    char *sock = argc > 1 && strchr(argv[1], '=') != NULL ? strchr(argv[1], '=') + 1 : NULL;
+
+    if (argc > 1 && (strcmp(argv[1], "--server") == 0 || strncmp(argv[1], "--server=", 9) == 0))
+        return server_run(sock);
+    else if (argc > 1 && (strcmp(argv[1], "--client") == 0 || strncmp(argv[1], "--client=", 9) == 0)) {
+        // The server runs the command as if it were typed without the option
+        argv[1] = argv[0];
+        return client_run(sock, argc - 1, argv + 1);
     }
 
-    free(nasm);
-    free(outasm);
-    free(outbase);
-    return EXIT_SUCCESS;
+    return run(argc, argv);
 }
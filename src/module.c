@@ -0,0 +1,895 @@
+#include "module.h"
+#include "parser.h"
+#include "lexer.h"
+#include "ast.h"
+#include "emit.h"
+#include "opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define MODULE_MAGIC "SCM1"
+#define MODULE_NULL 0xff
+#define OBJECT_MAGIC "SCO1"
+
+/* A file included at the top level is parsed once and its functions,
+ * globals, constants and aliases are written to <module cache>/<key>.scm.
+ * Later includes of the same file load them from there instead of parsing
+ * it again. Parsing a file depends on what was defined before it, so the
+ * key hashes the file together with every constant, alias, global and
+ * include seen so far. A module also lists the files it includes in turn
+ * with a hash of each, and is only loaded while they still match. */
+typedef struct {
+    char *path;
+    uint64_t hash;
+} Dep;
+
+// A module file read into memory ahead of time by module_warm()
+typedef struct {
+    uint64_t key;
+    char *data;
+    size_t len;
+} Warm;
+
+extern THREAD_LOCAL AST **sym_tab;
+extern THREAD_LOCAL size_t sym_cnt;
+extern THREAD_LOCAL char **included;
+extern THREAD_LOCAL size_t included_cnt;
+extern THREAD_LOCAL Const **constants;
+extern THREAD_LOCAL size_t constants_cnt;
+extern THREAD_LOCAL Alias **aliases;
+extern THREAD_LOCAL size_t aliases_cnt;
+
+THREAD_LOCAL char *module_cache = NULL;
+
+THREAD_LOCAL char *object_cache = NULL;
+THREAD_LOCAL bool track_deps = false;
+
+THREAD_LOCAL Dep *deps = NULL;
+THREAD_LOCAL size_t deps_cnt = 0;
+THREAD_LOCAL Dep *read_deps = NULL;
+THREAD_LOCAL size_t read_deps_cnt = 0;
+THREAD_LOCAL Warm *warm = NULL;
+THREAD_LOCAL size_t warm_cnt = 0;
+
+// FNV-1a
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
+
+uint64_t hash_str(uint64_t hash, const char *str) {
+    return str == NULL ? hash_bytes(hash, "", 1) : hash_bytes(hash, str, strlen(str) + 1);
+}
+
+// Records a file that was read and returns the hash of its source
+uint64_t module_dep(char *path, Lex *lex) {
+    uint64_t hash = hash_bytes(0xcbf29ce484222325, lex->src, lex->src_len);
+
+    deps = realloc(deps, (deps_cnt + 1) * sizeof(Dep));
+    deps[deps_cnt++] = (Dep){ strdup(path), hash };
+    return hash;
+}
+
+uint64_t module_key(uint64_t hash) {
+    for (size_t i = 0; i < constants_cnt; i++) {
+        AST *value = constants[i]->value;
+        hash = hash_str(hash, constants[i]->name);
+        hash = value->type == AST_STR ? hash_str(hash, value->data.str) : hash_bytes(hash, &value->data.digit, sizeof(value->data.digit));
+    }
+
+    for (size_t i = 0; i < aliases_cnt; i++) {
+        hash = hash_str(hash, aliases[i]->name);
+        hash = hash_str(hash, aliases[i]->value);
+    }
+
+    for (size_t i = 0; i < sym_cnt; i++) {
+        AST *sym = sym_tab[i];
+
+        if (strcmp(sym->scope_def, "<global>") != 0)
+            continue;
+        else if (sym->type == AST_ASSIGN) {
+            hash = hash_str(hash, sym->assign.name);
+            hash = hash_str(hash, sym->assign.type);
+            continue;
+        }
+
+        hash = hash_str(hash, sym->func.name);
+        hash = hash_str(hash, sym->func.type);
+
+        for (size_t j = 0; j < sym->func.params_cnt; j++)
+            hash = hash_str(hash, sym->func.params[j]->assign.type);
+    }
+
+    for (size_t i = 0; i < included_cnt; i++)
+        hash = hash_str(hash, included[i]);
+
+    // What is parsed depends on them too, vector types and builtins check march
+    hash = hash_bytes(hash, &optimize, sizeof(optimize));
+    return hash_bytes(hash, &march, sizeof(march));
+}
+
+size_t module_mark(void) {
+    return deps_cnt;
+}
+
+char *module_path(uint64_t key) {
+    char *path = calloc(strlen(module_cache) + 32, sizeof(char));
+    sprintf(path, "%s/%016lx.scm", module_cache, (unsigned long)key);
+    return path;
+}
+
+void put_size(FILE *f, size_t size) {
+    uint64_t n = size;
+    fwrite(&n, sizeof(n), 1, f);
+}
+
+void put_str(FILE *f, char *str) {
+    put_size(f, str == NULL ? SIZE_MAX : strlen(str));
+
+    if (str != NULL)
+        fwrite(str, 1, strlen(str), f);
+}
+
+bool is_sym(AST *ast) {
+    for (size_t i = 0; i < sym_cnt; i++) {
+        if (sym_tab[i] == ast)
+            return true;
+    }
+
+    return false;
+}
+
+void put_ast(FILE *f, AST *ast);
+
+void put_arr(FILE *f, AST **arr, size_t cnt) {
+    put_size(f, cnt);
+
+    for (size_t i = 0; i < cnt; i++)
+        put_ast(f, arr[i]);
+}
+
+void put_ast(FILE *f, AST *ast) {
+    if (ast == NULL) {
+        fputc(MODULE_NULL, f);
+        return;
+    }
+
+    fputc(ast->type, f);
+    put_str(f, ast->scope_def);
+    put_str(f, ast->func_def);
+    put_size(f, ast->ln);
+    put_size(f, ast->col);
+    fputc(ast->active, f);
+
+    switch (ast->type) {
+        case AST_INT:
+        case AST_FLOAT: fwrite(&ast->data.digit, sizeof(ast->data.digit), 1, f); break;
+        case AST_STR: put_str(f, ast->data.str); break;
+        case AST_VAR: put_str(f, ast->var.name); break;
+        case AST_FUNC:
+            put_str(f, ast->func.name);
+            put_str(f, ast->func.type);
+            put_arr(f, ast->func.params, ast->func.params_cnt);
+            put_arr(f, ast->func.body, ast->func.body_cnt);
+            fputc(ast->func.ret != NULL, f);
+            fputc(ast->func.ext, f);
+            fputc(ast->func.exported, f);
+            break;
+        case AST_CALL:
+            put_str(f, ast->call.name);
+            put_arr(f, ast->call.args, ast->call.args_cnt);
+            break;
+        case AST_ASSIGN:
+            put_str(f, ast->assign.name);
+            put_str(f, ast->assign.type);
+            put_ast(f, ast->assign.value);
+            fputc(ast->assign.mut, f);
+            put_size(f, ast->assign.arr_cap);
+            fputc(is_sym(ast), f);
+            break;
+        case AST_RET: put_ast(f, ast->ret.value); break;
+        case AST_MATH: put_arr(f, ast->math.expr, ast->math.expr_cnt); break;
+        case AST_OPER: put_size(f, ast->oper.kind); break;
+        case AST_IF_ELSE:
+            put_arr(f, ast->if_else.exprs, ast->if_else.exprs_cnt);
+            put_arr(f, ast->if_else.body, ast->if_else.body_cnt);
+            fputc(ast->if_else.else_body != NULL, f);
+
+            if (ast->if_else.else_body != NULL)
+                put_arr(f, ast->if_else.else_body, ast->if_else.else_body_cnt);
+            break;
+        case AST_WHILE:
+            put_arr(f, ast->while_.exprs, ast->while_.exprs_cnt);
+            put_arr(f, ast->while_.body, ast->while_.body_cnt);
+            fputc(ast->while_.do_first, f);
+            break;
+        case AST_FOR:
+            put_ast(f, ast->for_.init);
+            put_arr(f, ast->for_.cond, ast->for_.cond_cnt);
+            put_ast(f, ast->for_.math);
+            put_arr(f, ast->for_.body, ast->for_.body_cnt);
+            break;
+        case AST_SUBSCR:
+            put_str(f, ast->subscr.name);
+            put_ast(f, ast->subscr.index);
+            put_ast(f, ast->subscr.value);
+            break;
+        case AST_ARR_LST: put_arr(f, ast->arr_lst.items, ast->arr_lst.items_cnt); break;
+        case AST_DEREF:
+            put_str(f, ast->deref.name);
+            put_ast(f, ast->deref.value);
+            break;
+        case AST_REF: put_str(f, ast->ref.name); break;
+        case AST_INC: put_str(f, ast->inc.name); break;
+        case AST_EXPR: put_ast(f, ast->expr.value); break;
+        case AST_HREDUCE:
+            put_str(f, ast->hreduce.name);
+            put_ast(f, ast->hreduce.value);
+            break;
+        default: break;
+    }
+}
+
+// Written next to the module and renamed over it, so a module is never seen half written
+void module_save(uint64_t key, size_t mark, AST **asts, size_t asts_cnt, size_t constants_beg, size_t aliases_beg, size_t included_beg) {
+    mkdir(module_cache, 0755);
+
+    char *path = module_path(key);
+    char *tmp = calloc(strlen(path) + 32, sizeof(char));
+    // deps has one address per thread, which tells threads of a process apart
+    sprintf(tmp, "%s.%d.%p", path, (int)getpid(), (void *)&deps);
+
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        free(path);
+        free(tmp);
+        return;
+    }
+
+    fwrite(MODULE_MAGIC, 1, 4, f);
+    put_size(f, deps_cnt - mark);
+
+    for (size_t i = mark; i < deps_cnt; i++) {
+        put_str(f, deps[i].path);
+        fwrite(&deps[i].hash, sizeof(deps[i].hash), 1, f);
+    }
+
+    put_size(f, included_cnt - included_beg);
+
+    for (size_t i = included_beg; i < included_cnt; i++)
+        put_str(f, included[i]);
+
+    put_size(f, constants_cnt - constants_beg);
+
+    for (size_t i = constants_beg; i < constants_cnt; i++) {
+        put_str(f, constants[i]->name);
+        put_ast(f, constants[i]->value);
+    }
+
+    put_size(f, aliases_cnt - aliases_beg);
+
+    for (size_t i = aliases_beg; i < aliases_cnt; i++) {
+        put_str(f, aliases[i]->name);
+        put_str(f, aliases[i]->value);
+    }
+
+    put_arr(f, asts, asts_cnt);
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+        remove(tmp);
+
+    free(path);
+    free(tmp);
+}
+
+/* Reading stops at the first thing that doesn't fit, the module is then
+ * thrown away and the file parsed as if there were none. Declarations go
+ * to syms in the order they were parsed and are only added to the symbol
+ * table once the whole module is read. */
+typedef struct {
+    FILE *f;
+    bool ok;
+    AST **syms;
+    size_t syms_cnt;
+} Reader;
+
+size_t get_size(Reader *rd) {
+    uint64_t n = 0;
+
+    if (rd->ok && fread(&n, sizeof(n), 1, rd->f) != 1)
+        rd->ok = false;
+
+    return rd->ok ? n : 0;
+}
+
+// A count, anything past what a module could hold means it's corrupt
+size_t get_cnt(Reader *rd) {
+    size_t cnt = get_size(rd);
+
+    if (cnt > (1 << 24))
+        rd->ok = false;
+
+    return rd->ok ? cnt : 0;
+}
+
+bool get_bool(Reader *rd) {
+    int c = rd->ok ? fgetc(rd->f) : EOF;
+
+    if (c == EOF)
+        rd->ok = false;
+
+    return c == 1;
+}
+
+char *get_str(Reader *rd) {
+    size_t len = get_size(rd);
+
+    if (len == SIZE_MAX)
+        return NULL;
+    else if (len > (1 << 24))
+        rd->ok = false;
+
+    if (!rd->ok)
+        return NULL;
+
+    char *str = calloc(len + 1, sizeof(char));
+
+    if (fread(str, 1, len, rd->f) != len)
+        rd->ok = false;
+
+    return str;
+}
+
+char *get_name(Reader *rd) {
+    char *str = get_str(rd);
+    return str != NULL ? str : strdup("");
+}
+
+AST *get_ast(Reader *rd);
+
+AST **get_arr(Reader *rd, size_t *cnt) {
+    *cnt = get_cnt(rd);
+    AST **arr = calloc(*cnt + 1, sizeof(AST *));
+
+    for (size_t i = 0; i < *cnt; i++)
+        arr[i] = get_ast(rd);
+
+    return arr;
+}
+
+AST *get_ast(Reader *rd) {
+    int type = rd->ok ? fgetc(rd->f) : EOF;
+
+    if (type == EOF || type == MODULE_NULL || type > AST_HREDUCE) {
+        rd->ok = rd->ok && type == MODULE_NULL;
+        return NULL;
+    }
+
+    // Zeroed, so a node cut short can still be deleted
+    AST *ast = calloc(1, sizeof(AST));
+    ast->type = type;
+    ast->scope_def = get_name(rd);
+    ast->func_def = get_name(rd);
+    ast->ln = get_size(rd);
+    ast->col = get_size(rd);
+    ast->active = get_bool(rd);
+
+    switch (ast->type) {
+        case AST_INT:
+        case AST_FLOAT:
+            if (rd->ok && fread(&ast->data.digit, sizeof(ast->data.digit), 1, rd->f) != 1)
+                rd->ok = false;
+            break;
+        case AST_STR: ast->data.str = get_name(rd); break;
+        case AST_VAR: ast->var.name = get_name(rd); break;
+        case AST_FUNC:
+            ast->func.name = get_name(rd);
+            ast->func.type = get_name(rd);
+            ast->func.params = get_arr(rd, &ast->func.params_cnt);
+
+            // Functions are declared after their parameters
+            rd->syms = realloc(rd->syms, (rd->syms_cnt + 1) * sizeof(AST *));
+            rd->syms[rd->syms_cnt++] = ast;
+
+            ast->func.body = get_arr(rd, &ast->func.body_cnt);
+            ast->func.ret = get_bool(rd) && ast->func.body_cnt > 0 ? ast->func.body[ast->func.body_cnt - 1] : NULL;
+            ast->func.ext = get_bool(rd);
+            ast->func.exported = get_bool(rd);
+            break;
+        case AST_CALL:
+            ast->call.name = get_name(rd);
+            ast->call.args = get_arr(rd, &ast->call.args_cnt);
+            break;
+        case AST_ASSIGN:
+            ast->assign.name = get_name(rd);
+            ast->assign.type = get_str(rd);
+            ast->assign.rbp = NULL;
+            ast->assign.value = get_ast(rd);
+            ast->assign.mut = get_bool(rd);
+            ast->assign.arr_cap = get_size(rd);
+
+            if (get_bool(rd)) {
+                rd->syms = realloc(rd->syms, (rd->syms_cnt + 1) * sizeof(AST *));
+                rd->syms[rd->syms_cnt++] = ast;
+            }
+            break;
+        case AST_RET: ast->ret.value = get_ast(rd); break;
+        case AST_MATH: ast->math.expr = get_arr(rd, &ast->math.expr_cnt); break;
+        case AST_OPER: ast->oper.kind = get_size(rd); break;
+        case AST_MATH_VAR:
+            ast->math_var.stack_rbp = NULL;
+            ast->math_var.reg_name = NULL;
+            ast->math_var.is_float = false;
+            break;
+        case AST_IF_ELSE:
+            ast->if_else.exprs = get_arr(rd, &ast->if_else.exprs_cnt);
+            ast->if_else.body = get_arr(rd, &ast->if_else.body_cnt);
+            ast->if_else.else_body = NULL;
+            ast->if_else.else_body_cnt = 0;
+
+            if (get_bool(rd))
+                ast->if_else.else_body = get_arr(rd, &ast->if_else.else_body_cnt);
+            break;
+        case AST_WHILE:
+            ast->while_.exprs = get_arr(rd, &ast->while_.exprs_cnt);
+            ast->while_.body = get_arr(rd, &ast->while_.body_cnt);
+            ast->while_.do_first = get_bool(rd);
+            break;
+        case AST_FOR:
+            ast->for_.init = get_ast(rd);
+            ast->for_.cond = get_arr(rd, &ast->for_.cond_cnt);
+            ast->for_.math = get_ast(rd);
+            ast->for_.body = get_arr(rd, &ast->for_.body_cnt);
+            break;
+        case AST_SUBSCR:
+            ast->subscr.name = get_name(rd);
+            ast->subscr.index = get_ast(rd);
+            ast->subscr.value = get_ast(rd);
+            break;
+        case AST_ARR_LST: ast->arr_lst.items = get_arr(rd, &ast->arr_lst.items_cnt); break;
+        case AST_DEREF:
+            ast->deref.name = get_name(rd);
+            ast->deref.value = get_ast(rd);
+            break;
+        case AST_REF: ast->ref.name = get_name(rd); break;
+        case AST_INC: ast->inc.name = get_name(rd); break;
+        case AST_EXPR: ast->expr.value = get_ast(rd); break;
+        case AST_HREDUCE:
+            ast->hreduce.name = get_name(rd);
+            ast->hreduce.value = get_ast(rd);
+            break;
+        default: break;
+    }
+
+    return ast;
+}
+
+// Whether the file still hashes to what it did when the module was written
+bool dep_matches(char *path, uint64_t hash) {
+    if (access(path, R_OK) != 0)
+        return false;
+
+    Lex *lex = lex_init(path);
+    bool matches = hash_bytes(0xcbf29ce484222325, lex->src, lex->src_len) == hash;
+    lex_del(lex);
+    return matches;
+}
+
+/* The compile server keeps the modules in its cache directory in memory
+ * and reads the ones written since before forking each request, so every
+ * request starts with all of them without opening a file. Modules are
+ * still checked against the files they list when they're loaded. */
+void module_warm(char *dir) {
+    DIR *dr = opendir(dir);
+    if (dr == NULL)
+        return;
+
+    struct dirent *de;
+
+    while ((de = readdir(dr)) != NULL) {
+        char *end;
+        uint64_t key = strtoull(de->d_name, &end, 16);
+
+        if (end != de->d_name + 16 || strcmp(end, ".scm") != 0)
+            continue;
+
+        bool have = false;
+
+        for (size_t i = 0; i < warm_cnt && !have; i++)
+            have = warm[i].key == key;
+
+        char *path = calloc(strlen(dir) + strlen(de->d_name) + 2, sizeof(char));
+        sprintf(path, "%s/%s", dir, de->d_name);
+
+        FILE *f = have ? NULL : fopen(path, "rb");
+        free(path);
+
+        if (f == NULL)
+            continue;
+
+        fseek(f, 0, SEEK_END);
+        long len = ftell(f);
+        rewind(f);
+
+        char *data = malloc(len > 0 ? len : 1);
+
+        if (len <= 0 || fread(data, 1, len, f) != (size_t)len)
+            free(data);
+        else {
+            warm = realloc(warm, (warm_cnt + 1) * sizeof(Warm));
+            warm[warm_cnt++] = (Warm){ key, data, len };
+        }
+
+        fclose(f);
+    }
+
+    closedir(dr);
+}
+
+// Adds the module for key to the parse, false if there is none that can be used
+bool module_load(uint64_t key, AST ***asts, size_t *asts_cnt) {
+    FILE *f = NULL;
+
+    for (size_t i = 0; i < warm_cnt && f == NULL; i++) {
+        if (warm[i].key == key)
+            f = fmemopen(warm[i].data, warm[i].len, "rb");
+    }
+
+    if (f == NULL) {
+        char *path = module_path(key);
+        f = fopen(path, "rb");
+        free(path);
+    }
+
+    if (f == NULL)
+        return false;
+
+    Reader rd = { f, true, calloc(1, sizeof(AST *)), 0 };
+    char magic[4];
+
+    rd.ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, MODULE_MAGIC, 4) == 0;
+
+    size_t mod_deps_cnt = get_cnt(&rd);
+    size_t deps_beg = deps_cnt;
+
+    for (size_t i = 0; rd.ok && i < mod_deps_cnt; i++) {
+        char *dep = get_name(&rd);
+        uint64_t hash = 0;
+
+        if (rd.ok && fread(&hash, sizeof(hash), 1, f) != 1)
+            rd.ok = false;
+
+        rd.ok = rd.ok && dep_matches(dep, hash);
+        deps = realloc(deps, (deps_cnt + 1) * sizeof(Dep));
+        deps[deps_cnt++] = (Dep){ dep, hash };
+    }
+
+    size_t names_cnt = get_cnt(&rd);
+    char **names = calloc(names_cnt + 1, sizeof(char *));
+
+    for (size_t i = 0; rd.ok && i < names_cnt; i++)
+        names[i] = get_name(&rd);
+
+    size_t consts_cnt = get_cnt(&rd);
+    Const **consts = calloc(consts_cnt + 1, sizeof(Const *));
+
+    for (size_t i = 0; rd.ok && i < consts_cnt; i++) {
+        consts[i] = malloc(sizeof(Const));
+        consts[i]->name = get_name(&rd);
+        consts[i]->value = get_ast(&rd);
+        rd.ok = rd.ok && consts[i]->value != NULL;
+    }
+
+    size_t als_cnt = get_cnt(&rd);
+    Alias **als = calloc(als_cnt + 1, sizeof(Alias *));
+
+    for (size_t i = 0; rd.ok && i < als_cnt; i++) {
+        als[i] = malloc(sizeof(Alias));
+        als[i]->name = get_name(&rd);
+        als[i]->value = get_name(&rd);
+    }
+
+    size_t mod_cnt = 0;
+    AST **mod = rd.ok ? get_arr(&rd, &mod_cnt) : calloc(1, sizeof(AST *));
+    fclose(f);
+
+    if (!rd.ok) {
+        for (size_t i = deps_beg; i < deps_cnt; i++)
+            free(deps[i].path);
+        deps_cnt = deps_beg;
+
+        for (size_t i = 0; i < names_cnt; i++)
+            free(names[i]);
+
+        for (size_t i = 0; i < consts_cnt && consts[i] != NULL; i++) {
+            free(consts[i]->name);
+
+            if (consts[i]->value != NULL)
+                ast_del(consts[i]->value);
+            free(consts[i]);
+        }
+
+        for (size_t i = 0; i < als_cnt && als[i] != NULL; i++) {
+            free(als[i]->name);
+            free(als[i]->value);
+            free(als[i]);
+        }
+
+        for (size_t i = 0; i < mod_cnt; i++) {
+            if (mod[i] != NULL)
+                ast_del(mod[i]);
+        }
+
+        free(names);
+        free(consts);
+        free(als);
+        free(mod);
+        free(rd.syms);
+        return false;
+    }
+
+    for (size_t i = 0; i < names_cnt; i++) {
+        included = realloc(included, (included_cnt + 1) * sizeof(char *));
+        included[included_cnt++] = names[i];
+    }
+
+    for (size_t i = 0; i < consts_cnt; i++) {
+        constants = realloc(constants, (constants_cnt + 1) * sizeof(Const *));
+        constants[constants_cnt++] = consts[i];
+    }
+
+    for (size_t i = 0; i < als_cnt; i++) {
+        aliases = realloc(aliases, (aliases_cnt + 1) * sizeof(Alias *));
+        aliases[aliases_cnt++] = als[i];
+    }
+
+    for (size_t i = 0; i < rd.syms_cnt; i++)
+        sym_append(rd.syms[i]);
+
+    *asts = realloc(*asts, (*asts_cnt + mod_cnt + 1) * sizeof(AST *));
+    memcpy(*asts + *asts_cnt, mod, mod_cnt * sizeof(AST *));
+    *asts_cnt += mod_cnt;
+
+    free(names);
+    free(consts);
+    free(als);
+    free(mod);
+    free(rd.syms);
+    return true;
+}
+
+void deps_del(Dep *list, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++)
+        free(list[i].path);
+
+    free(list);
+}
+
+void module_reset(void) {
+    deps_del(read_deps, read_deps_cnt);
+    read_deps = NULL;
+    read_deps_cnt = 0;
+
+    // The object cache and dependency files list the files a parse read once it's over
+    if (track_deps) {
+        read_deps = deps;
+        read_deps_cnt = deps_cnt;
+    } else
+        deps_del(deps, deps_cnt);
+
+    deps = NULL;
+    deps_cnt = 0;
+}
+
+/* An input compiled to an object is kept in <object cache>/<key>.sco, and
+ * compiling it again copies the object out instead. The key hashes the
+ * compiler, the working directory, the input and the options. Which files
+ * it includes is only known once it's parsed, so the entry lists them with
+ * a hash of each like a module does, and is only used while they match. */
+uint64_t object_key(char *file) {
+    uint64_t hash = 0xcbf29ce484222325;
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) == 0) {
+        hash = hash_bytes(hash, &st.st_size, sizeof(st.st_size));
+        hash = hash_bytes(hash, &st.st_mtime, sizeof(st.st_mtime));
+    }
+
+    char *cwd = getcwd(NULL, 0);
+    hash = hash_str(hash, cwd);
+    hash = hash_str(hash, file);
+    free(cwd);
+
+    Lex *lex = lex_init(file);
+    hash = hash_bytes(hash, lex->src, lex->src_len);
+    lex_del(lex);
+
+    bool flags[] = { optimize, fast_math, link_libc, require_main, stack_usage != NULL };
+    hash = hash_bytes(hash, flags, sizeof(flags));
+    return hash_bytes(hash, &march, sizeof(march));
+}
+
+char *object_path(uint64_t key) {
+    char *path = calloc(strlen(object_cache) + 32, sizeof(char));
+    sprintf(path, "%s/%016lx.sco", object_cache, (unsigned long)key);
+    return path;
+}
+
+size_t object_outs_cnt(void) {
+    return stack_usage != NULL ? 2 : 1;
+}
+
+// Copies the object to obj, and stack usage to su if asked for, out of the entry for key
+bool object_load(uint64_t key, char *obj, char *su) {
+    char *path = object_path(key);
+    FILE *f = fopen(path, "rb");
+    free(path);
+
+    if (f == NULL)
+        return false;
+
+    Reader rd = { f, true, NULL, 0 };
+    char magic[4];
+
+    rd.ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, OBJECT_MAGIC, 4) == 0;
+
+    size_t entry_deps_cnt = get_cnt(&rd);
+    Dep *entry_deps = calloc(entry_deps_cnt + 1, sizeof(Dep));
+
+    for (size_t i = 0; rd.ok && i < entry_deps_cnt; i++) {
+        char *dep = get_name(&rd);
+        uint64_t hash = 0;
+
+        if (rd.ok && fread(&hash, sizeof(hash), 1, f) != 1)
+            rd.ok = false;
+
+        rd.ok = rd.ok && dep_matches(dep, hash);
+        entry_deps[i] = (Dep){ dep, hash };
+    }
+
+    size_t outs_cnt = object_outs_cnt();
+    char *outs[2] = { NULL, NULL };
+    size_t lens[2] = { 0, 0 };
+
+    for (size_t i = 0; rd.ok && i < outs_cnt; i++) {
+        lens[i] = get_size(&rd);
+
+        if (lens[i] > ((size_t)1 << 31))
+            rd.ok = false;
+
+        if (!rd.ok)
+            break;
+
+        outs[i] = malloc(lens[i] + 1);
+        rd.ok = fread(outs[i], 1, lens[i], f) == lens[i];
+    }
+
+    fclose(f);
+
+    char *paths[2] = { obj, su };
+
+    for (size_t i = 0; rd.ok && i < outs_cnt; i++) {
+        FILE *o = fopen(paths[i], "wb");
+
+        rd.ok = o != NULL && fwrite(outs[i], 1, lens[i], o) == lens[i];
+
+        if (o != NULL && fclose(o) != 0)
+            rd.ok = false;
+    }
+
+    free(outs[0]);
+    free(outs[1]);
+
+    // The files the input includes are the ones it did when it was compiled
+    if (rd.ok) {
+        deps_del(read_deps, read_deps_cnt);
+        read_deps = entry_deps;
+        read_deps_cnt = entry_deps_cnt;
+    } else
+        deps_del(entry_deps, entry_deps_cnt);
+
+    return rd.ok;
+}
+
+// Keeps the object and stack usage compiling an input wrote, with the files its parse read
+void object_save(uint64_t key, char *obj, char *su) {
+    mkdir(object_cache, 0755);
+
+    char *path = object_path(key);
+    char *tmp = calloc(strlen(path) + 32, sizeof(char));
+    sprintf(tmp, "%s.%d.%p", path, (int)getpid(), (void *)&deps);
+
+    FILE *f = fopen(tmp, "wb");
+    bool ok = f != NULL;
+
+    if (ok) {
+        fwrite(OBJECT_MAGIC, 1, 4, f);
+        put_size(f, read_deps_cnt);
+
+        for (size_t i = 0; i < read_deps_cnt; i++) {
+            put_str(f, read_deps[i].path);
+            fwrite(&read_deps[i].hash, sizeof(read_deps[i].hash), 1, f);
+        }
+    }
+
+    char *paths[2] = { obj, su };
+
+    for (size_t i = 0; ok && i < object_outs_cnt(); i++) {
+        FILE *o = fopen(paths[i], "rb");
+        struct stat st;
+
+        if (o == NULL || fstat(fileno(o), &st) != 0) {
+            ok = false;
+
+            if (o != NULL)
+                fclose(o);
+            break;
+        }
+
+        char *buf = malloc(st.st_size + 1);
+        ok = fread(buf, 1, st.st_size, o) == (size_t)st.st_size;
+        put_size(f, st.st_size);
+        fwrite(buf, 1, st.st_size, f);
+        fclose(o);
+        free(buf);
+    }
+
+    if (f != NULL && (fclose(f) != 0 || !ok || rename(tmp, path) != 0))
+        remove(tmp);
+
+    free(path);
+    free(tmp);
+}
+
+// Writes the characters make treats specially in a file name escaped
+void deps_put(FILE *f, char *name) {
+    for (char *c = name; *c != '\0'; c++) {
+        if (*c == ' ' || *c == '#')
+            fputc('\\', f);
+        else if (*c == '$')
+            fputc('$', f);
+
+        fputc(*c, f);
+    }
+}
+
+/* Writes a make rule saying target depends on file and every file its
+ * parse read, the resolved path of each include. Nested includes of a
+ * file loaded from a cache are listed too, the cache keeps them. */
+bool deps_write(char *path, char *target, char *file) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return false;
+
+    deps_put(f, target);
+    fputs(": ", f);
+    deps_put(f, file);
+
+    for (size_t i = 0; i < read_deps_cnt; i++) {
+        bool listed = strcmp(read_deps[i].path, file) == 0;
+
+        for (size_t j = 0; j < i && !listed; j++)
+            listed = strcmp(read_deps[i].path, read_deps[j].path) == 0;
+
+        if (listed)
+            continue;
+
+        fputs(" \\\n  ", f);
+        deps_put(f, read_deps[i].path);
+    }
+
+    fputs("\n", f);
+    return fclose(f) == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "ast.h"
+#include "lexer.h"
+#include "state.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+extern THREAD_LOCAL char *module_cache;
+extern THREAD_LOCAL char *object_cache;
+extern THREAD_LOCAL bool track_deps;
+
+uint64_t module_dep(char *path, Lex *lex);
+uint64_t module_key(uint64_t hash);
+size_t module_mark(void);
+void module_warm(char *dir);
+bool module_load(uint64_t key, AST ***asts, size_t *asts_cnt);
+void module_save(uint64_t key, size_t mark, AST **asts, size_t asts_cnt, size_t constants_beg, size_t aliases_beg, size_t included_beg);
+void module_reset(void);
+uint64_t object_key(char *file);
+bool object_load(uint64_t key, char *obj, char *su);
+void object_save(uint64_t key, char *obj, char *su);
+bool deps_write(char *path, char *target, char *file);
+
+#endif
@@ -0,0 +1,1534 @@
+#include "opt.h"
+#include "parser.h"
+#include "ast.h"
+#include "emit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#define EVAL_STEPS 1000000
+#define EVAL_DEPTH 64
+
+/* Local value numbering over each block of statements.
+ *
+ * A math expression is a flat list of operands and operators, so the
+ * subexpressions emit_math() computes are the prefixes of each chain of
+ * '*', '/' and '%' and the prefixes of the chain of terms. Every one made
+ * only of literals and scalar variables gets a key naming its value; a
+ * mutable variable's key changes whenever it may have been written, an
+ * immutable one never does. When a key occurs twice in a block, the first
+ * occurrence is moved into a new immutable variable declared before its
+ * statement and every occurrence loads that variable instead, or the
+ * variable an earlier declaration already holds the value in. An int
+ * variable converted to float more than once is converted once the same
+ * way. */
+typedef struct {
+    char *key;
+    AST **slot;
+    size_t start;
+    size_t end;
+    size_t stmt;
+    size_t group;
+    size_t opers;
+    bool is_float;
+    AST *reuse;
+} Occur;
+
+typedef struct {
+    AST *sym;
+    size_t gen;
+} Gen;
+
+THREAD_LOCAL bool optimize = true;
+
+THREAD_LOCAL Occur *occurs = NULL;
+THREAD_LOCAL size_t occurs_cnt = 0;
+THREAD_LOCAL Gen *gens = NULL;
+THREAD_LOCAL size_t gens_cnt = 0;
+THREAD_LOCAL size_t gen_cnt = 0;
+THREAD_LOCAL size_t epoch = 0;
+THREAD_LOCAL size_t cse_cnt = 0;
+
+Gen *gen_find(AST *sym) {
+    for (size_t i = 0; i < gens_cnt; i++) {
+        if (gens[i].sym == sym)
+            return &gens[i];
+    }
+
+    return NULL;
+}
+
+void gen_bump(AST *sym) {
+    Gen *gen = gen_find(sym);
+
+    if (gen == NULL) {
+        gens = realloc(gens, (gens_cnt + 1) * sizeof(Gen));
+        gen = &gens[gens_cnt++];
+        gen->sym = sym;
+    }
+
+    gen->gen = ++gen_cnt;
+}
+
+bool is_scalar(char *type) {
+    return strcmp(type, "char") == 0 || strcmp(type, "int") == 0 || strcmp(type, "float") == 0;
+}
+
+bool has_call(AST *ast) {
+    if (ast == NULL)
+        return false;
+
+    switch (ast->type) {
+        case AST_CALL: return true;
+        case AST_MATH:
+            for (size_t i = 0; i < ast->math.expr_cnt; i += 2) {
+                if (has_call(ast->math.expr[i]))
+                    return true;
+            }
+            break;
+        case AST_EXPR: return has_call(ast->expr.value);
+        case AST_SUBSCR: return has_call(ast->subscr.index) || has_call(ast->subscr.value);
+        case AST_DEREF: return has_call(ast->deref.value);
+        case AST_HREDUCE: return has_call(ast->hreduce.value);
+        case AST_ARR_LST:
+            for (size_t i = 0; i < ast->arr_lst.items_cnt; i++) {
+                if (has_call(ast->arr_lst.items[i]))
+                    return true;
+            }
+            break;
+        default: break;
+    }
+
+    return false;
+}
+
+bool math_key(AST *math, size_t start, size_t end, char **key, size_t *opers, bool *is_float, bool *mut);
+
+// Appends the key of a pure operand, false if it isn't one
+bool opnd_key(AST *ast, char **key, size_t *opers, bool *is_float, bool *mut) {
+    switch (ast->type) {
+        case AST_INT:
+            append(key, "%d", (int)ast->data.digit);
+            return true;
+        case AST_FLOAT:
+            append(key, "%La", ast->data.digit);
+            *is_float = true;
+            return true;
+        case AST_VAR: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
+
+            if (sym == NULL || sym->assign.arr_cap > 0 || !is_scalar(sym->assign.type))
+                return false;
+
+            append(key, "v%p", (void *)sym);
+
+            if (sym->assign.mut) {
+                Gen *gen = gen_find(sym);
+                append(key, ":%zu:%zu", gen == NULL ? 0 : gen->gen, epoch);
+                *mut = true;
+            }
+
+            if (strcmp(sym->assign.type, "float") == 0)
+                *is_float = true;
+            return true;
+        }
+        case AST_EXPR: {
+            if (ast->expr.value->type != AST_MATH) {
+                append(key, "(");
+                bool pure = opnd_key(ast->expr.value, key, opers, is_float, mut);
+                append(key, ")");
+                return pure;
+            }
+
+            ast = ast->expr.value;
+        }
+        // fall through
+        case AST_MATH: {
+            append(key, "(");
+            bool pure = math_key(ast, 0, ast->math.expr_cnt - 1, key, opers, is_float, mut);
+            append(key, ")");
+            return pure;
+        }
+        default: return false;
+    }
+}
+
+bool math_key(AST *math, size_t start, size_t end, char **key, size_t *opers, bool *is_float, bool *mut) {
+    for (size_t i = start; i <= end; i++) {
+        if (i % 2 == 0) {
+            if (!opnd_key(math->math.expr[i], key, opers, is_float, mut))
+                return false;
+            continue;
+        }
+
+        switch (math->math.expr[i]->oper.kind) {
+            case TOK_PLUS: append(key, "+"); break;
+            case TOK_MINUS: append(key, "-"); break;
+            case TOK_STAR: append(key, "*"); break;
+            case TOK_SLASH: append(key, "/"); break;
+            default: append(key, "%%"); break;
+        }
+
+        (*opers)++;
+    }
+
+    return true;
+}
+
+bool opnd_is_float(AST *ast) {
+    switch (ast->type) {
+        case AST_EXPR: return opnd_is_float(ast->expr.value);
+        case AST_MATH:
+            for (size_t i = 0; i < ast->math.expr_cnt; i += 2) {
+                if (opnd_is_float(ast->math.expr[i]))
+                    return true;
+            }
+            return false;
+        case AST_DEREF: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->deref.name);
+            return strcmp(sym->assign.type, "float*") == 0;
+        }
+        default: return ast_is_float(ast);
+    }
+}
+
+void occur_add(char *key, AST **slot, size_t start, size_t end, size_t stmt, size_t opers, bool is_float, AST *reuse) {
+    // Occurrences in one math are added together, after those nested in it
+    size_t group = occurs_cnt > 0 && occurs[occurs_cnt - 1].slot == slot ? occurs[occurs_cnt - 1].group : occurs_cnt;
+
+    occurs = realloc(occurs, (occurs_cnt + 1) * sizeof(Occur));
+    occurs[occurs_cnt++] = (Occur){ key, slot, start, end, stmt, group, opers, is_float, reuse };
+}
+
+void occur_range(AST **slot, size_t start, size_t end, size_t stmt, bool impure, AST *decl) {
+    AST *math = *slot;
+    char *key = calloc(1, sizeof(char));
+    size_t opers = 0;
+    bool is_float = false;
+    bool mut = false;
+
+    // Values the statement reads after a call may differ from before it
+    if (!math_key(math, start, end, &key, &opers, &is_float, &mut) || (mut && impure)) {
+        free(key);
+        return;
+    }
+
+    // The whole value of an immutable declaration of the same type stays in it
+    AST *reuse = NULL;
+    if (decl != NULL && start == 0 && end == math->math.expr_cnt - 1 && strcmp(decl->assign.type, is_float ? "float" : "int") == 0)
+        reuse = decl;
+
+    occur_add(key, slot, start, end, stmt, opers, is_float, reuse);
+}
+
+// An int variable operand that emit_math() converts to float
+void occur_cvt(AST **slot, size_t pos, size_t stmt, bool impure) {
+    AST *var = (*slot)->math.expr[pos];
+
+    if (var->type != AST_VAR || ast_is_float(var))
+        return;
+
+    char *key = calloc(2, sizeof(char));
+    size_t opers = 0;
+    bool is_float = false;
+    bool mut = false;
+    key[0] = 'c';
+
+    if (!opnd_key(var, &key, &opers, &is_float, &mut) || (mut && impure)) {
+        free(key);
+        return;
+    }
+
+    occur_add(key, slot, pos, pos, stmt, 0, true, NULL);
+}
+
+void occur_value(AST **slot, size_t stmt, bool impure, AST *decl);
+
+void occur_math(AST **slot, size_t stmt, bool impure, AST *decl) {
+    AST *math = *slot;
+    AST **expr = math->math.expr;
+    size_t expr_cnt = math->math.expr_cnt;
+
+    for (size_t i = 0; i < expr_cnt; i += 2)
+        occur_value(&expr[i], stmt, impure, NULL);
+
+    size_t term = 0;
+    bool term_float = opnd_is_float(expr[0]);
+    bool sum_float = false;
+
+    for (size_t i = 1; i <= expr_cnt; i += 2) {
+        if (i < expr_cnt && expr[i]->oper.kind != TOK_PLUS && expr[i]->oper.kind != TOK_MINUS) {
+            bool is_float = opnd_is_float(expr[i + 1]);
+
+            if (term_float && !is_float)
+                occur_cvt(slot, i + 1, stmt, impure);
+            else if (!term_float && is_float && i == term + 1)
+                occur_cvt(slot, term, stmt, impure);
+
+            term_float = term_float || is_float;
+            occur_range(slot, term, i + 1, stmt, impure, decl);
+            continue;
+        }
+
+        // expr[term..i-1] is a whole term, added to the terms before it
+        if (term > 0) {
+            if (sum_float && !term_float && i == term + 1)
+                occur_cvt(slot, term, stmt, impure);
+            else if (!sum_float && term_float && term == 2)
+                occur_cvt(slot, 0, stmt, impure);
+
+            occur_range(slot, 0, i - 1, stmt, impure, decl);
+        }
+
+        sum_float = sum_float || term_float;
+
+        if (i < expr_cnt) {
+            term = i + 1;
+            term_float = opnd_is_float(expr[term]);
+        }
+    }
+}
+
+void occur_value(AST **slot, size_t stmt, bool impure, AST *decl) {
+    AST *ast = *slot;
+
+    if (ast == NULL)
+        return;
+
+    switch (ast->type) {
+        case AST_MATH:
+            if (ast_vec_type(ast) == NULL)
+                occur_math(slot, stmt, impure, decl);
+            break;
+        case AST_EXPR: occur_value(&ast->expr.value, stmt, impure, NULL); break;
+        case AST_CALL:
+            for (size_t i = 0; i < ast->call.args_cnt; i++)
+                occur_value(&ast->call.args[i], stmt, impure, NULL);
+            break;
+        case AST_SUBSCR:
+            occur_value(&ast->subscr.index, stmt, impure, NULL);
+            occur_value(&ast->subscr.value, stmt, impure, NULL);
+            break;
+        case AST_DEREF: occur_value(&ast->deref.value, stmt, impure, NULL); break;
+        default: break;
+    }
+}
+
+void occur_block(AST **body, size_t body_cnt) {
+    gens_cnt = 0;
+    epoch = ++gen_cnt;
+
+    for (size_t i = 0; i < body_cnt; i++) {
+        AST *stmt = body[i];
+
+        switch (stmt->type) {
+            case AST_ASSIGN: {
+                AST *sym = sym_find(AST_ASSIGN, stmt->scope_def, stmt->assign.name);
+                bool impure = has_call(stmt->assign.value);
+
+                if (sym->assign.arr_cap == 0 && !is_vec_type(sym->assign.type)) {
+                    bool decl = stmt->assign.type != NULL && !stmt->assign.mut && is_scalar(stmt->assign.type);
+                    occur_value(&stmt->assign.value, i, impure, decl ? stmt : NULL);
+                }
+
+                if (sym->assign.mut)
+                    gen_bump(sym);
+
+                if (impure)
+                    epoch = ++gen_cnt;
+                break;
+            }
+            case AST_RET: occur_value(&stmt->ret.value, i, has_call(stmt->ret.value), NULL); break;
+            default:
+                // Calls, stores through pointers and nested blocks may write any mutable variable
+                occur_value(&body[i], i, true, NULL);
+                epoch = ++gen_cnt;
+                break;
+        }
+    }
+}
+
+AST *var_init(AST *at, char *name) {
+    AST *var = ast_init(AST_VAR, at->scope_def, at->func_def, at->ln, at->col);
+    var->var.name = strdup(name);
+    return var;
+}
+
+// Replaces expr[start..end] of the math in slot with one operand, returns what was replaced if kept
+AST *math_splice(AST **slot, size_t start, size_t end, AST *with, bool keep) {
+    AST *math = *slot;
+    AST *kept = NULL;
+
+    if (start == 0 && end == math->math.expr_cnt - 1) {
+        *slot = with;
+
+        if (keep)
+            return math;
+
+        ast_del(math);
+        return NULL;
+    }
+
+    if (keep && start == end)
+        kept = math->math.expr[start];
+    else if (keep) {
+        kept = ast_init(AST_MATH, math->scope_def, math->func_def, math->ln, math->col);
+        kept->math.expr_cnt = end - start + 1;
+        kept->math.expr = malloc(kept->math.expr_cnt * sizeof(AST *));
+        memcpy(kept->math.expr, math->math.expr + start, kept->math.expr_cnt * sizeof(AST *));
+    } else {
+        for (size_t i = start; i <= end; i++)
+            ast_del(math->math.expr[i]);
+    }
+
+    math->math.expr[start] = with;
+    memmove(math->math.expr + start + 1, math->math.expr + end + 1, (math->math.expr_cnt - end - 1) * sizeof(AST *));
+    math->math.expr_cnt -= end - start;
+    return kept;
+}
+
+int occur_cmp(const void *a, const void *b) {
+    const Occur *x = a;
+    const Occur *y = b;
+
+    // Nested maths before the math holding them and later ranges of a math
+    // before earlier ones, so every slot and position is still valid
+    if (x->stmt != y->stmt)
+        return x->stmt < y->stmt ? -1 : 1;
+    else if (x->group != y->group)
+        return x->group < y->group ? -1 : 1;
+
+    return x->start < y->start ? 1 : -1;
+}
+
+// Rewrites the largest value computed twice, false once there is none
+bool opt_cse(AST ***body, size_t *body_cnt) {
+    occurs_cnt = 0;
+    occur_block(*body, *body_cnt);
+
+    Occur *best = NULL;
+    size_t best_cnt = 0;
+
+    for (size_t i = 0; i < occurs_cnt; i++) {
+        size_t cnt = 0;
+
+        for (size_t j = 0; j < occurs_cnt; j++) {
+            if (strcmp(occurs[i].key, occurs[j].key) == 0)
+                cnt++;
+        }
+
+        if (cnt > 1 && (best == NULL || occurs[i].opers > best->opers)) {
+            best = &occurs[i];
+            best_cnt = cnt;
+        }
+    }
+
+    if (best == NULL) {
+        for (size_t i = 0; i < occurs_cnt; i++)
+            free(occurs[i].key);
+        return false;
+    }
+
+    Occur *same = malloc(best_cnt * sizeof(Occur));
+    size_t same_cnt = 0;
+    Occur *first = NULL;
+
+    for (size_t i = 0; i < occurs_cnt; i++) {
+        if (strcmp(occurs[i].key, best->key) != 0)
+            continue;
+
+        same[same_cnt++] = occurs[i];
+
+        if (first == NULL || occurs[i].stmt < first->stmt)
+            first = &occurs[i];
+    }
+
+    AST *stmt = (*body)[first->stmt];
+    AST *decl = first->reuse;
+
+    if (decl == NULL) {
+        decl = ast_init(AST_ASSIGN, stmt->scope_def, stmt->func_def, stmt->ln, stmt->col);
+        decl->assign.name = calloc(32, sizeof(char));
+        sprintf(decl->assign.name, "cse.%zu", cse_cnt++);
+        decl->assign.type = strdup(first->is_float ? "float" : "int");
+        decl->assign.rbp = NULL;
+        decl->assign.value = NULL;
+        decl->assign.mut = false;
+        decl->assign.arr_cap = 0;
+        sym_append(decl);
+    }
+
+    qsort(same, same_cnt, sizeof(Occur), occur_cmp);
+
+    for (size_t i = 0; i < same_cnt; i++) {
+        if (same[i].slot == first->slot && same[i].start == first->start) {
+            if (first->reuse == NULL)
+                decl->assign.value = math_splice(same[i].slot, same[i].start, same[i].end, var_init(*same[i].slot, decl->assign.name), true);
+            continue;
+        }
+
+        math_splice(same[i].slot, same[i].start, same[i].end, var_init(*same[i].slot, decl->assign.name), false);
+    }
+
+    if (first->reuse == NULL) {
+        *body = realloc(*body, (*body_cnt + 1) * sizeof(AST *));
+        memmove(*body + first->stmt + 1, *body + first->stmt, (*body_cnt - first->stmt) * sizeof(AST *));
+        (*body)[first->stmt] = decl;
+        (*body_cnt)++;
+    }
+
+    for (size_t i = 0; i < occurs_cnt; i++)
+        free(occurs[i].key);
+
+    free(same);
+    return true;
+}
+
+void opt_block(AST ***body, size_t *body_cnt) {
+    for (size_t i = 0; i < *body_cnt; i++) {
+        AST *stmt = (*body)[i];
+
+        switch (stmt->type) {
+            case AST_IF_ELSE:
+                opt_block(&stmt->if_else.body, &stmt->if_else.body_cnt);
+
+                if (stmt->if_else.else_body != NULL)
+                    opt_block(&stmt->if_else.else_body, &stmt->if_else.else_body_cnt);
+                break;
+            case AST_WHILE: opt_block(&stmt->while_.body, &stmt->while_.body_cnt); break;
+            case AST_FOR: opt_block(&stmt->for_.body, &stmt->for_.body_cnt); break;
+            default: break;
+        }
+    }
+
+    while (opt_cse(body, body_cnt));
+}
+
+/* Calls to pure functions with constant arguments are evaluated by the
+ * compiler and replaced by their result. A function is pure if its
+ * parameters and result are scalars and its body only reads and writes its
+ * own scalar locals and calls pure functions. The interpreter follows the
+ * code emit_math() and emit_cond() generate, so a folded call gives the
+ * same value it would at runtime; anything it can't do the same way, such
+ * as dividing by zero, a loop running longer than EVAL_STEPS or recursing
+ * deeper than EVAL_DEPTH, leaves the call in place. */
+typedef struct {
+    AST *func;
+    bool pure;
+} Purity;
+
+typedef struct {
+    bool is_float;
+    int i;
+    float f;
+} Val;
+
+typedef struct {
+    AST *sym;
+    Val val;
+} Local;
+
+typedef struct {
+    AST *func;
+    Local *locals;
+    size_t locals_cnt;
+    Val ret;
+} Frame;
+
+typedef enum {
+    EXEC_NEXT,
+    EXEC_RET,
+    EXEC_FAIL
+} Exec;
+
+THREAD_LOCAL Purity *purity = NULL;
+THREAD_LOCAL size_t purity_cnt = 0;
+THREAD_LOCAL size_t eval_steps = 0;
+THREAD_LOCAL size_t eval_depth = 0;
+
+bool is_pure_func(AST *func);
+
+bool is_local(AST *ast, AST *func) {
+    AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->type == AST_VAR ? ast->var.name : ast->assign.name);
+    return sym != NULL && strcmp(sym->func_def, func->func.name) == 0 && sym->assign.arr_cap == 0 && is_scalar(sym->assign.type);
+}
+
+bool is_pure_arr(AST **arr, size_t cnt, AST *func);
+
+bool is_pure(AST *ast, AST *func) {
+    if (ast == NULL)
+        return true;
+
+    switch (ast->type) {
+        case AST_INT:
+        case AST_FLOAT:
+        case AST_OPER: return true;
+        case AST_VAR: return is_local(ast, func);
+        case AST_ASSIGN: return is_local(ast, func) && is_pure(ast->assign.value, func);
+        case AST_RET: return is_pure(ast->ret.value, func);
+        case AST_MATH: return is_pure_arr(ast->math.expr, ast->math.expr_cnt, func);
+        case AST_EXPR: return is_pure(ast->expr.value, func);
+        case AST_CALL: return is_pure_func(sym_find(AST_FUNC, "<global>", ast->call.name)) && is_pure_arr(ast->call.args, ast->call.args_cnt, func);
+        case AST_IF_ELSE:
+            return is_pure_arr(ast->if_else.exprs, ast->if_else.exprs_cnt, func) && is_pure_arr(ast->if_else.body, ast->if_else.body_cnt, func)
+                && (ast->if_else.else_body == NULL || is_pure_arr(ast->if_else.else_body, ast->if_else.else_body_cnt, func));
+        case AST_WHILE: return is_pure_arr(ast->while_.exprs, ast->while_.exprs_cnt, func) && is_pure_arr(ast->while_.body, ast->while_.body_cnt, func);
+        case AST_FOR:
+            return is_pure(ast->for_.init, func) && is_pure_arr(ast->for_.cond, ast->for_.cond_cnt, func) && is_pure(ast->for_.math, func)
+                && is_pure_arr(ast->for_.body, ast->for_.body_cnt, func);
+        default: return false;
+    }
+}
+
+bool is_pure_arr(AST **arr, size_t cnt, AST *func) {
+    for (size_t i = 0; i < cnt; i++) {
+        if (!is_pure(arr[i], func))
+            return false;
+    }
+
+    return true;
+}
+
+bool is_pure_func(AST *func) {
+    for (size_t i = 0; i < purity_cnt; i++) {
+        if (purity[i].func == func)
+            return purity[i].pure;
+    }
+
+    // Assumed pure while its body is checked so recursion terminates
+    purity = realloc(purity, (purity_cnt + 1) * sizeof(Purity));
+    size_t idx = purity_cnt++;
+    purity[idx] = (Purity){ func, true };
+
+    bool pure = !func->func.ext && (is_scalar(func->func.type) || strcmp(func->func.type, "void") == 0);
+
+    for (size_t i = 0; pure && i < func->func.params_cnt; i++)
+        pure = is_scalar(func->func.params[i]->assign.type);
+
+    purity[idx].pure = pure && is_pure_arr(func->func.body, func->func.body_cnt, func);
+    return purity[idx].pure;
+}
+
+// Same as cvttss2si, which gives INT_MIN for values out of range
+int val_trunc(float f) {
+    if (f != f || f >= 2147483648.0f || f < -2147483648.0f)
+        return INT_MIN;
+
+    return (int)f;
+}
+
+Val val_cast(Val val, char *type) {
+    if (strcmp(type, "float") == 0) {
+        if (!val.is_float)
+            val.f = (float)val.i;
+
+        val.is_float = true;
+        return val;
+    }
+
+    if (val.is_float)
+        val.i = val_trunc(val.f);
+
+    val.is_float = false;
+
+    if (strcmp(type, "char") == 0)
+        val.i = (signed char)val.i;
+
+    return val;
+}
+
+Local *local_find(Frame *frame, AST *sym) {
+    for (size_t i = 0; i < frame->locals_cnt; i++) {
+        if (frame->locals[i].sym == sym)
+            return &frame->locals[i];
+    }
+
+    return NULL;
+}
+
+void local_set(Frame *frame, AST *sym, Val val) {
+    Local *local = local_find(frame, sym);
+
+    if (local == NULL) {
+        frame->locals = realloc(frame->locals, (frame->locals_cnt + 1) * sizeof(Local));
+        local = &frame->locals[frame->locals_cnt++];
+        local->sym = sym;
+    }
+
+    local->val = val;
+}
+
+bool eval_oper(Val left, Val right, AST *right_ast, TokType kind, Val *out) {
+    if (left.is_float || right.is_float) {
+        float a = left.is_float ? left.f : (float)left.i;
+        float b = right.is_float ? right.f : (float)right.i;
+
+        out->is_float = true;
+
+        switch (kind) {
+            case TOK_PLUS: out->f = a + b; break;
+            case TOK_MINUS: out->f = a - b; break;
+            case TOK_STAR: out->f = a * b; break;
+            case TOK_SLASH: out->f = a / b; break;
+            default: return false;
+        }
+
+        return true;
+    }
+
+    unsigned int a = (unsigned int)left.i;
+    unsigned int b = (unsigned int)right.i;
+    // Division and modulus by a power of two literal are emitted as sar and and
+    bool shift = right_ast->type == AST_INT && right_ast->data.digit >= 0 && b != 0 && (b & (b - 1)) == 0;
+
+    out->is_float = false;
+
+    switch (kind) {
+        case TOK_PLUS: out->i = (int)(a + b); break;
+        case TOK_MINUS: out->i = (int)(a - b); break;
+        case TOK_STAR: out->i = (int)(a * b); break;
+        default:
+            if (shift && kind == TOK_SLASH) {
+                int n = 0;
+                while ((b >> n) > 1)
+                    n++;
+
+                out->i = left.i >> n;
+                break;
+            } else if (shift) {
+                out->i = (int)(a & (b - 1));
+                break;
+            } else if (right.i == 0 || (left.i == INT_MIN && right.i == -1))
+                return false;
+
+            out->i = kind == TOK_SLASH ? left.i / right.i : left.i % right.i;
+            break;
+    }
+
+    return true;
+}
+
+bool eval_value(Frame *frame, AST *ast, Val *out);
+
+// Multiplicative operators first, then additive ones, each left to right
+bool eval_math(Frame *frame, AST *ast, Val *out) {
+    AST **expr = ast->math.expr;
+    size_t expr_cnt = ast->math.expr_cnt;
+    Val term;
+    Val sum;
+    Val right;
+    TokType sum_kind = TOK_PLUS;
+    bool has_sum = false;
+
+    if (!eval_value(frame, expr[0], &term))
+        return false;
+
+    for (size_t i = 1; i <= expr_cnt; i += 2) {
+        if (i < expr_cnt && expr[i]->oper.kind != TOK_PLUS && expr[i]->oper.kind != TOK_MINUS) {
+            if (!eval_value(frame, expr[i + 1], &right) || !eval_oper(term, right, expr[i + 1], expr[i]->oper.kind, &term))
+                return false;
+            continue;
+        }
+
+        if (!has_sum)
+            sum = term;
+        else if (!eval_oper(sum, term, expr[i - 1], sum_kind, &sum))
+            return false;
+
+        has_sum = true;
+
+        if (i < expr_cnt) {
+            sum_kind = expr[i]->oper.kind;
+
+            if (!eval_value(frame, expr[i + 1], &term))
+                return false;
+        }
+    }
+
+    *out = sum;
+    return true;
+}
+
+Exec exec_arr(Frame *frame, AST **arr, size_t cnt);
+
+bool eval_call(Frame *frame, AST *ast, Val *out) {
+    AST *func = sym_find(AST_FUNC, "<global>", ast->call.name);
+
+    if (!is_pure_func(func) || eval_depth == EVAL_DEPTH)
+        return false;
+
+    Frame callee = { func, NULL, 0, { false, 0, 0 } };
+    Val arg;
+
+    for (size_t i = 0; i < ast->call.args_cnt; i++) {
+        AST *param = func->func.params[i];
+
+        if (!eval_value(frame, ast->call.args[i], &arg)) {
+            free(callee.locals);
+            return false;
+        }
+
+        local_set(&callee, param, val_cast(arg, param->assign.type));
+    }
+
+    eval_depth++;
+    Exec exec = exec_arr(&callee, func->func.body, func->func.body_cnt);
+    eval_depth--;
+    free(callee.locals);
+
+    // Falling off the end of a function that returns a value leaves garbage
+    if (exec == EXEC_FAIL || (exec == EXEC_NEXT && strcmp(func->func.type, "void") != 0))
+        return false;
+
+    *out = callee.ret;
+    return true;
+}
+
+bool eval_value(Frame *frame, AST *ast, Val *out) {
+    if (++eval_steps > EVAL_STEPS)
+        return false;
+
+    switch (ast->type) {
+        case AST_INT:
+            *out = (Val){ false, (int)ast->data.digit, 0 };
+            return true;
+        case AST_FLOAT:
+            *out = (Val){ true, 0, (float)ast->data.digit };
+            return true;
+        case AST_VAR: {
+            Local *local = local_find(frame, sym_find(AST_ASSIGN, ast->scope_def, ast->var.name));
+
+            if (local == NULL)
+                return false;
+
+            *out = local->val;
+            return true;
+        }
+        case AST_EXPR: return eval_value(frame, ast->expr.value, out);
+        case AST_MATH: return eval_math(frame, ast, out);
+        case AST_CALL: return eval_call(frame, ast, out);
+        default: return false;
+    }
+}
+
+// Comparisons are tested left to right, one followed by && jumps to false if it fails and any other jumps to true if it holds
+bool eval_cond(Frame *frame, AST **expr, size_t expr_cnt, bool *out) {
+    Val left;
+    Val right;
+    bool holds;
+
+    for (size_t i = 1; i < expr_cnt; i += 4) {
+        if (!eval_value(frame, expr[i - 1], &left) || !eval_value(frame, expr[i + 1], &right))
+            return false;
+
+        if (left.is_float || right.is_float) {
+            float a = left.is_float ? left.f : (float)left.i;
+            float b = right.is_float ? right.f : (float)right.i;
+
+            // comiss sets the flags of every comparison for NaN
+            if (a != a || b != b)
+                return false;
+
+            left = (Val){ false, a < b ? -1 : a > b, 0 };
+            right = (Val){ false, 0, 0 };
+        }
+
+        switch (expr[i]->oper.kind) {
+            case TOK_LT: holds = left.i < right.i; break;
+            case TOK_LTE: holds = left.i <= right.i; break;
+            case TOK_GT: holds = left.i > right.i; break;
+            case TOK_GTE: holds = left.i >= right.i; break;
+            case TOK_NOT_EQ: holds = left.i != right.i; break;
+            default: holds = left.i == right.i; break;
+        }
+
+        if (i + 2 < expr_cnt && expr[i + 2]->oper.kind == TOK_AND) {
+            if (!holds) {
+                *out = false;
+                return true;
+            }
+        } else if (holds) {
+            *out = true;
+            return true;
+        }
+    }
+
+    *out = false;
+    return true;
+}
+
+Exec exec_node(Frame *frame, AST *ast) {
+    Val val;
+    bool holds;
+    Exec exec;
+
+    if (++eval_steps > EVAL_STEPS)
+        return EXEC_FAIL;
+
+    switch (ast->type) {
+        case AST_ASSIGN: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->assign.name);
+
+            // A declaration without a value may share its slot with anything
+            if (ast->assign.value == NULL) {
+                Local *local = local_find(frame, sym);
+
+                if (local != NULL)
+                    local->sym = NULL;
+                return EXEC_NEXT;
+            } else if (!eval_value(frame, ast->assign.value, &val))
+                return EXEC_FAIL;
+
+            local_set(frame, sym, val_cast(val, sym->assign.type));
+            return EXEC_NEXT;
+        }
+        case AST_RET:
+            if (ast->ret.value == NULL)
+                return EXEC_RET;
+            else if (!eval_value(frame, ast->ret.value, &val))
+                return EXEC_FAIL;
+
+            // A char result is returned in all of eax
+            frame->ret = val_cast(val, strcmp(frame->func->func.type, "float") == 0 ? "float" : "int");
+            return EXEC_RET;
+        case AST_CALL: return eval_call(frame, ast, &val) ? EXEC_NEXT : EXEC_FAIL;
+        case AST_IF_ELSE:
+            if (!eval_cond(frame, ast->if_else.exprs, ast->if_else.exprs_cnt, &holds))
+                return EXEC_FAIL;
+            else if (holds)
+                return exec_arr(frame, ast->if_else.body, ast->if_else.body_cnt);
+            else if (ast->if_else.else_body != NULL)
+                return exec_arr(frame, ast->if_else.else_body, ast->if_else.else_body_cnt);
+            return EXEC_NEXT;
+        case AST_WHILE:
+            if (!ast->while_.do_first && !eval_cond(frame, ast->while_.exprs, ast->while_.exprs_cnt, &holds))
+                return EXEC_FAIL;
+
+            while (ast->while_.do_first || holds) {
+                if ((exec = exec_arr(frame, ast->while_.body, ast->while_.body_cnt)) != EXEC_NEXT)
+                    return exec;
+                else if (!eval_cond(frame, ast->while_.exprs, ast->while_.exprs_cnt, &holds))
+                    return EXEC_FAIL;
+                else if (!holds)
+                    break;
+            }
+            return EXEC_NEXT;
+        case AST_FOR:
+            if (exec_node(frame, ast->for_.init) != EXEC_NEXT)
+                return EXEC_FAIL;
+
+            while (true) {
+                if (!eval_cond(frame, ast->for_.cond, ast->for_.cond_cnt, &holds))
+                    return EXEC_FAIL;
+                else if (!holds)
+                    break;
+                else if ((exec = exec_arr(frame, ast->for_.body, ast->for_.body_cnt)) != EXEC_NEXT)
+                    return exec;
+                else if (exec_node(frame, ast->for_.math) != EXEC_NEXT)
+                    return EXEC_FAIL;
+            }
+            return EXEC_NEXT;
+        default: return EXEC_FAIL;
+    }
+}
+
+Exec exec_arr(Frame *frame, AST **arr, size_t cnt) {
+    Exec exec;
+
+    for (size_t i = 0; i < cnt; i++) {
+        if ((exec = exec_node(frame, arr[i])) != EXEC_NEXT)
+            return exec;
+    }
+
+    return EXEC_NEXT;
+}
+
+bool is_const(AST *ast) {
+    return ast->type == AST_INT || ast->type == AST_FLOAT || (ast->type == AST_EXPR && is_const(ast->expr.value));
+}
+
+// Evaluates a call or math with constant operands, true if it could
+bool fold_eval(AST *ast, Val *val) {
+    Frame frame = { NULL, NULL, 0, { false, 0, 0 } };
+
+    eval_steps = eval_depth = 0;
+    return ast->type == AST_CALL ? eval_call(&frame, ast, val) : eval_math(&frame, ast, val);
+}
+
+// Replaces the value in slot with a literal of type, or of its own type if NULL
+void fold_lit(AST **slot, Val val, char *type) {
+    AST *ast = *slot;
+
+    if (type != NULL)
+        val = val_cast(val, strcmp(type, "float") == 0 ? "float" : "int");
+
+    AST *lit = ast_init(val.is_float ? AST_FLOAT : AST_INT, ast->scope_def, ast->func_def, ast->ln, ast->col);
+
+    // Not a conditional, that would make the int a float too and round it
+    if (val.is_float)
+        lit->data.digit = val.f;
+    else
+        lit->data.digit = val.i;
+
+    *slot = lit;
+    ast_del(ast);
+}
+
+char *base_type(char *type) {
+    static THREAD_LOCAL char base[32];
+    snprintf(base, sizeof(base), "%s", type);
+    base[strlen(base) - 1] = '\0';
+    return is_scalar(base) ? base : NULL;
+}
+
+void fold_value(AST **slot, char *type);
+
+void fold_args(AST *call) {
+    AST *func = sym_find(AST_FUNC, "<global>", call->call.name);
+
+    for (size_t i = 0; i < call->call.args_cnt; i++) {
+        char *type = func->func.params[i]->assign.type;
+        fold_value(&call->call.args[i], is_scalar(type) ? type : NULL);
+    }
+}
+
+void fold_value(AST **slot, char *type) {
+    AST *ast = *slot;
+    Val val;
+
+    if (ast == NULL)
+        return;
+
+    switch (ast->type) {
+        case AST_CALL: {
+            fold_args(ast);
+
+            for (size_t i = 0; i < ast->call.args_cnt; i++) {
+                if (!is_const(ast->call.args[i]))
+                    return;
+            }
+
+            if (fold_eval(ast, &val))
+                fold_lit(slot, val, type);
+            break;
+        }
+        case AST_MATH: {
+            if (ast_vec_type(ast) != NULL)
+                return;
+
+            bool folds = true;
+
+            for (size_t i = 0; i < ast->math.expr_cnt; i += 2) {
+                fold_value(&ast->math.expr[i], NULL);
+                folds = folds && is_const(ast->math.expr[i]);
+            }
+
+            if (folds && fold_eval(ast, &val))
+                fold_lit(slot, val, type);
+            break;
+        }
+        case AST_EXPR: fold_value(&ast->expr.value, NULL); break;
+        case AST_SUBSCR: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->subscr.name);
+            fold_value(&ast->subscr.index, "int");
+            fold_value(&ast->subscr.value, base_type(sym->assign.type));
+            break;
+        }
+        case AST_DEREF: {
+            AST *sym = sym_find(AST_ASSIGN, ast->scope_def, ast->deref.name);
+            fold_value(&ast->deref.value, base_type(sym->assign.type));
+            break;
+        }
+        default: break;
+    }
+}
+
+void fold_cond(AST **expr, size_t expr_cnt) {
+    for (size_t i = 0; i < expr_cnt; i++) {
+        if (expr[i]->type != AST_OPER)
+            fold_value(&expr[i], NULL);
+    }
+}
+
+void fold_block(AST ***body, size_t *body_cnt, AST *func);
+
+void fold_stmt(AST *stmt, AST *func) {
+    switch (stmt->type) {
+        case AST_ASSIGN: {
+            AST *sym = sym_find(AST_ASSIGN, stmt->scope_def, stmt->assign.name);
+
+            if (sym->assign.arr_cap == 0 && is_scalar(sym->assign.type))
+                fold_value(&stmt->assign.value, sym->assign.type);
+            break;
+        }
+        case AST_RET:
+            if (is_scalar(func->func.type))
+                fold_value(&stmt->ret.value, func->func.type);
+            break;
+        case AST_CALL: fold_args(stmt); break;
+        case AST_SUBSCR:
+        case AST_DEREF: {
+            AST *value = stmt;
+            fold_value(&value, NULL);
+            break;
+        }
+        case AST_IF_ELSE:
+            fold_cond(stmt->if_else.exprs, stmt->if_else.exprs_cnt);
+            fold_block(&stmt->if_else.body, &stmt->if_else.body_cnt, func);
+
+            if (stmt->if_else.else_body != NULL)
+                fold_block(&stmt->if_else.else_body, &stmt->if_else.else_body_cnt, func);
+            break;
+        case AST_WHILE:
+            fold_cond(stmt->while_.exprs, stmt->while_.exprs_cnt);
+            fold_block(&stmt->while_.body, &stmt->while_.body_cnt, func);
+            break;
+        case AST_FOR:
+            fold_stmt(stmt->for_.init, func);
+            fold_cond(stmt->for_.cond, stmt->for_.cond_cnt);
+            fold_stmt(stmt->for_.math, func);
+            fold_block(&stmt->for_.body, &stmt->for_.body_cnt, func);
+            break;
+        default: break;
+    }
+}
+
+void fold_block(AST ***body, size_t *body_cnt, AST *func) {
+    Val val;
+
+    for (size_t i = 0; i < *body_cnt; i++) {
+        AST *stmt = (*body)[i];
+        fold_stmt(stmt, func);
+
+        if (stmt->type != AST_CALL)
+            continue;
+
+        for (size_t j = 0; j < stmt->call.args_cnt; j++) {
+            if (!is_const(stmt->call.args[j]))
+                goto fold_block_next;
+        }
+
+        // A pure call whose value isn't used does nothing once it's known to finish
+        if (fold_eval(stmt, &val)) {
+            ast_del(stmt);
+            memmove(*body + i, *body + i + 1, (*body_cnt - i - 1) * sizeof(AST *));
+            (*body_cnt)--;
+            i--;
+        }
+
+fold_block_next:;
+    }
+}
+
+/* Dead code elimination. A function is only kept if main, an exported
+ * function or a global initializer reaches it through calls. Within a
+ * function, statements after a return are dropped, an if or while whose
+ * condition compares only literals is replaced by the body it would run,
+ * and a local scalar that is never read loses its declaration and every
+ * assignment to it, as long as the values assigned have no side effects. */
+THREAD_LOCAL AST **reached = NULL;
+THREAD_LOCAL size_t reached_cnt = 0;
+
+void syms_unlink_arr(AST **arr, size_t cnt);
+
+// Removes the variables and functions declared in ast from the symbol table
+void syms_unlink(AST *ast) {
+    if (ast == NULL)
+        return;
+
+    switch (ast->type) {
+        case AST_ASSIGN: sym_remove(ast); break;
+        case AST_FUNC:
+            sym_remove(ast);
+            syms_unlink_arr(ast->func.params, ast->func.params_cnt);
+            syms_unlink_arr(ast->func.body, ast->func.body_cnt);
+            break;
+        case AST_IF_ELSE:
+            syms_unlink_arr(ast->if_else.body, ast->if_else.body_cnt);
+
+            if (ast->if_else.else_body != NULL)
+                syms_unlink_arr(ast->if_else.else_body, ast->if_else.else_body_cnt);
+            break;
+        case AST_WHILE: syms_unlink_arr(ast->while_.body, ast->while_.body_cnt); break;
+        case AST_FOR:
+            syms_unlink(ast->for_.init);
+            syms_unlink_arr(ast->for_.body, ast->for_.body_cnt);
+            break;
+        default: break;
+    }
+}
+
+void syms_unlink_arr(AST **arr, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++)
+        syms_unlink(arr[i]);
+}
+
+void stmt_del(AST *stmt) {
+    syms_unlink(stmt);
+    ast_del(stmt);
+}
+
+void reach(AST *ast);
+
+void reach_arr(AST **arr, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++)
+        reach(arr[i]);
+}
+
+// Marks every function ast may call
+void reach(AST *ast) {
+    if (ast == NULL)
+        return;
+
+    switch (ast->type) {
+        case AST_FUNC:
+            for (size_t i = 0; i < reached_cnt; i++) {
+                if (reached[i] == ast)
+                    return;
+            }
+
+            reached = realloc(reached, (reached_cnt + 1) * sizeof(AST *));
+            reached[reached_cnt++] = ast;
+            reach_arr(ast->func.body, ast->func.body_cnt);
+            break;
+        case AST_CALL:
+            reach(sym_find(AST_FUNC, "<global>", ast->call.name));
+            reach_arr(ast->call.args, ast->call.args_cnt);
+            break;
+        case AST_ASSIGN: reach(ast->assign.value); break;
+        case AST_RET: reach(ast->ret.value); break;
+        case AST_MATH: reach_arr(ast->math.expr, ast->math.expr_cnt); break;
+        case AST_IF_ELSE:
+            reach_arr(ast->if_else.exprs, ast->if_else.exprs_cnt);
+            reach_arr(ast->if_else.body, ast->if_else.body_cnt);
+
+            if (ast->if_else.else_body != NULL)
+                reach_arr(ast->if_else.else_body, ast->if_else.else_body_cnt);
+            break;
+        case AST_WHILE:
+            reach_arr(ast->while_.exprs, ast->while_.exprs_cnt);
+            reach_arr(ast->while_.body, ast->while_.body_cnt);
+            break;
+        case AST_FOR:
+            reach(ast->for_.init);
+            reach_arr(ast->for_.cond, ast->for_.cond_cnt);
+            reach(ast->for_.math);
+            reach_arr(ast->for_.body, ast->for_.body_cnt);
+            break;
+        case AST_SUBSCR:
+            reach(ast->subscr.index);
+            reach(ast->subscr.value);
+            break;
+        case AST_ARR_LST: reach_arr(ast->arr_lst.items, ast->arr_lst.items_cnt); break;
+        case AST_DEREF: reach(ast->deref.value); break;
+        case AST_EXPR: reach(ast->expr.value); break;
+        case AST_HREDUCE: reach(ast->hreduce.value); break;
+        default: break;
+    }
+}
+
+bool names(AST *ast, char *name, AST *sym) {
+    return strcmp(name, sym->assign.name) == 0 && sym_find(AST_ASSIGN, ast->scope_def, name) == sym;
+}
+
+bool is_used_arr(AST **arr, size_t cnt, AST *sym);
+
+bool is_store(AST *ast, AST *sym);
+
+// True if ast reads sym or takes its address, neither assigning it nor reading it to assign it is a use
+bool is_used(AST *ast, AST *sym) {
+    if (ast == NULL)
+        return false;
+
+    switch (ast->type) {
+        case AST_VAR: return names(ast, ast->var.name, sym);
+        case AST_REF: return names(ast, ast->ref.name, sym);
+        case AST_CALL: return is_used_arr(ast->call.args, ast->call.args_cnt, sym);
+        case AST_ASSIGN: return !is_store(ast, sym) && is_used(ast->assign.value, sym);
+        case AST_RET: return is_used(ast->ret.value, sym);
+        case AST_MATH: return is_used_arr(ast->math.expr, ast->math.expr_cnt, sym);
+        case AST_IF_ELSE:
+            return is_used_arr(ast->if_else.exprs, ast->if_else.exprs_cnt, sym) || is_used_arr(ast->if_else.body, ast->if_else.body_cnt, sym)
+                || (ast->if_else.else_body != NULL && is_used_arr(ast->if_else.else_body, ast->if_else.else_body_cnt, sym));
+        case AST_WHILE: return is_used_arr(ast->while_.exprs, ast->while_.exprs_cnt, sym) || is_used_arr(ast->while_.body, ast->while_.body_cnt, sym);
+        case AST_FOR:
+            return is_used(ast->for_.init, sym) || is_used_arr(ast->for_.cond, ast->for_.cond_cnt, sym) || is_used(ast->for_.math, sym)
+                || is_used_arr(ast->for_.body, ast->for_.body_cnt, sym);
+        case AST_SUBSCR: return names(ast, ast->subscr.name, sym) || is_used(ast->subscr.index, sym) || is_used(ast->subscr.value, sym);
+        case AST_ARR_LST: return is_used_arr(ast->arr_lst.items, ast->arr_lst.items_cnt, sym);
+        case AST_DEREF: return names(ast, ast->deref.name, sym) || is_used(ast->deref.value, sym);
+        case AST_EXPR: return is_used(ast->expr.value, sym);
+        case AST_HREDUCE: return names(ast, ast->hreduce.name, sym) || is_used(ast->hreduce.value, sym);
+        default: return false;
+    }
+}
+
+bool is_used_arr(AST **arr, size_t cnt, AST *sym) {
+    for (size_t i = 0; i < cnt; i++) {
+        if (is_used(arr[i], sym))
+            return true;
+    }
+
+    return false;
+}
+
+bool is_store(AST *ast, AST *sym) {
+    return ast != NULL && ast->type == AST_ASSIGN && (ast == sym || (ast->assign.type == NULL && names(ast, ast->assign.name, sym)));
+}
+
+// True if every store to sym is a statement of a block whose value can be dropped
+bool stores_dead(AST **body, size_t body_cnt, AST *sym, AST *func) {
+    for (size_t i = 0; i < body_cnt; i++) {
+        AST *stmt = body[i];
+
+        switch (stmt->type) {
+            case AST_ASSIGN:
+                if (is_store(stmt, sym) && (has_call(stmt->assign.value) || !is_pure(stmt->assign.value, func)))
+                    return false;
+                break;
+            case AST_IF_ELSE:
+                if (!stores_dead(stmt->if_else.body, stmt->if_else.body_cnt, sym, func)
+                    || (stmt->if_else.else_body != NULL && !stores_dead(stmt->if_else.else_body, stmt->if_else.else_body_cnt, sym, func)))
+                    return false;
+                break;
+            case AST_WHILE:
+                if (!stores_dead(stmt->while_.body, stmt->while_.body_cnt, sym, func))
+                    return false;
+                break;
+            case AST_FOR:
+                if (is_store(stmt->for_.init, sym) || is_store(stmt->for_.math, sym) || !stores_dead(stmt->for_.body, stmt->for_.body_cnt, sym, func))
+                    return false;
+                break;
+            default: break;
+        }
+    }
+
+    return true;
+}
+
+// Drops the stores to sym except its declaration, which the caller deletes last
+void stores_del(AST ***body, size_t *body_cnt, AST *sym) {
+    for (size_t i = 0; i < *body_cnt; i++) {
+        AST *stmt = (*body)[i];
+
+        switch (stmt->type) {
+            case AST_ASSIGN:
+                if (!is_store(stmt, sym))
+                    continue;
+
+                if (stmt != sym)
+                    ast_del(stmt);
+
+                memmove(*body + i, *body + i + 1, (*body_cnt - i - 1) * sizeof(AST *));
+                (*body_cnt)--;
+                i--;
+                break;
+            case AST_IF_ELSE:
+                stores_del(&stmt->if_else.body, &stmt->if_else.body_cnt, sym);
+
+                if (stmt->if_else.else_body != NULL)
+                    stores_del(&stmt->if_else.else_body, &stmt->if_else.else_body_cnt, sym);
+                break;
+            case AST_WHILE: stores_del(&stmt->while_.body, &stmt->while_.body_cnt, sym); break;
+            case AST_FOR: stores_del(&stmt->for_.body, &stmt->for_.body_cnt, sym); break;
+            default: break;
+        }
+    }
+}
+
+// Deletes one unread local declared in body or a block inside it, false if there is none
+bool dead_store(AST ***body, size_t *body_cnt, AST *func) {
+    for (size_t i = 0; i < *body_cnt; i++) {
+        AST *stmt = (*body)[i];
+
+        switch (stmt->type) {
+            case AST_ASSIGN:
+                if (stmt->assign.type == NULL || stmt->assign.arr_cap > 0 || !is_scalar(stmt->assign.type))
+                    break;
+                else if (is_used_arr(func->func.body, func->func.body_cnt, stmt) || !stores_dead(func->func.body, func->func.body_cnt, stmt, func))
+                    break;
+
+                stores_del(&func->func.body, &func->func.body_cnt, stmt);
+                stmt_del(stmt);
+                return true;
+            case AST_IF_ELSE:
+                if (dead_store(&stmt->if_else.body, &stmt->if_else.body_cnt, func)
+                    || (stmt->if_else.else_body != NULL && dead_store(&stmt->if_else.else_body, &stmt->if_else.else_body_cnt, func)))
+                    return true;
+                break;
+            case AST_WHILE:
+                if (dead_store(&stmt->while_.body, &stmt->while_.body_cnt, func))
+                    return true;
+                break;
+            case AST_FOR:
+                if (dead_store(&stmt->for_.body, &stmt->for_.body_cnt, func))
+                    return true;
+                break;
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+// True if the condition only compares literals, with holds set to its result
+bool cond_const(AST **expr, size_t expr_cnt, bool *holds) {
+    Frame frame = { NULL, NULL, 0, { false, 0, 0 } };
+
+    if (expr_cnt < 3)
+        return false;
+
+    for (size_t i = 0; i < expr_cnt; i++) {
+        if (expr[i]->type != AST_OPER && !is_const(expr[i]))
+            return false;
+    }
+
+    eval_steps = eval_depth = 0;
+    return eval_cond(&frame, expr, expr_cnt, holds);
+}
+
+// True if running stmt always ends in a return
+bool is_exit(AST *stmt) {
+    if (stmt->type == AST_RET)
+        return true;
+    else if (stmt->type != AST_IF_ELSE || stmt->if_else.else_body == NULL)
+        return false;
+
+    return stmt->if_else.body_cnt > 0 && is_exit(stmt->if_else.body[stmt->if_else.body_cnt - 1])
+        && stmt->if_else.else_body_cnt > 0 && is_exit(stmt->if_else.else_body[stmt->if_else.else_body_cnt - 1]);
+}
+
+// Replaces the statement at i with the statements of block
+void block_splice(AST ***body, size_t *body_cnt, size_t i, AST **block, size_t block_cnt) {
+    stmt_del((*body)[i]);
+    *body = realloc(*body, (*body_cnt + block_cnt) * sizeof(AST *));
+    memmove(*body + i + block_cnt, *body + i + 1, (*body_cnt - i - 1) * sizeof(AST *));
+    memcpy(*body + i, block, block_cnt * sizeof(AST *));
+    *body_cnt += block_cnt - 1;
+    free(block);
+}
+
+void dce_block(AST ***body, size_t *body_cnt) {
+    bool holds;
+
+    for (size_t i = 0; i < *body_cnt; i++) {
+        AST *stmt = (*body)[i];
+
+        if (stmt->type == AST_IF_ELSE && cond_const(stmt->if_else.exprs, stmt->if_else.exprs_cnt, &holds)) {
+            AST **block = holds ? stmt->if_else.body : stmt->if_else.else_body;
+            size_t block_cnt = holds ? stmt->if_else.body_cnt : stmt->if_else.else_body_cnt;
+
+            if (holds) {
+                stmt->if_else.body = NULL;
+                stmt->if_else.body_cnt = 0;
+            } else if (block != NULL) {
+                stmt->if_else.else_body = NULL;
+                stmt->if_else.else_body_cnt = 0;
+            } else
+                block_cnt = 0;
+
+            // The statements spliced in are looked at next
+            block_splice(body, body_cnt, i--, block, block_cnt);
+            continue;
+        } else if (stmt->type == AST_WHILE && cond_const(stmt->while_.exprs, stmt->while_.exprs_cnt, &holds) && !holds) {
+            AST **block = NULL;
+            size_t block_cnt = 0;
+
+            // A do while that stops after the first run is just its body
+            if (stmt->while_.do_first) {
+                block = stmt->while_.body;
+                block_cnt = stmt->while_.body_cnt;
+                stmt->while_.body = NULL;
+                stmt->while_.body_cnt = 0;
+            }
+
+            block_splice(body, body_cnt, i--, block, block_cnt);
+            continue;
+        }
+
+        switch (stmt->type) {
+            case AST_IF_ELSE:
+                dce_block(&stmt->if_else.body, &stmt->if_else.body_cnt);
+
+                if (stmt->if_else.else_body != NULL)
+                    dce_block(&stmt->if_else.else_body, &stmt->if_else.else_body_cnt);
+                break;
+            case AST_WHILE: dce_block(&stmt->while_.body, &stmt->while_.body_cnt); break;
+            case AST_FOR: dce_block(&stmt->for_.body, &stmt->for_.body_cnt); break;
+            default: break;
+        }
+
+        if (is_exit(stmt)) {
+            for (size_t j = i + 1; j < *body_cnt; j++)
+                stmt_del((*body)[j]);
+
+            *body_cnt = i + 1;
+        }
+    }
+}
+
+void opt_dce(AST *ast) {
+    for (size_t i = 0; i < ast->root.asts_cnt; i++) {
+        AST *stmt = ast->root.asts[i];
+
+        if (stmt->type == AST_FUNC && !stmt->func.ext) {
+            dce_block(&stmt->func.body, &stmt->func.body_cnt);
+            while (dead_store(&stmt->func.body, &stmt->func.body_cnt, stmt));
+        }
+    }
+
+    for (size_t i = 0; i < ast->root.asts_cnt; i++) {
+        AST *stmt = ast->root.asts[i];
+
+        if (stmt->type == AST_ASSIGN || (stmt->type == AST_FUNC && (stmt->func.exported || strcmp(stmt->func.name, "main") == 0)))
+            reach(stmt);
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < ast->root.asts_cnt; i++) {
+        AST *stmt = ast->root.asts[i];
+        bool live = stmt->type != AST_FUNC;
+
+        for (size_t j = 0; !live && j < reached_cnt; j++)
+            live = reached[j] == stmt;
+
+        if (live)
+            ast->root.asts[kept++] = stmt;
+        else
+            stmt_del(stmt);
+    }
+
+    ast->root.asts_cnt = kept;
+    free(reached);
+    reached = NULL;
+    reached_cnt = 0;
+}
+
+void opt_ast(AST *ast) {
+    for (size_t i = 0; i < ast->root.asts_cnt; i++) {
+        AST *func = ast->root.asts[i];
+
+        if (func->type == AST_FUNC && !func->func.ext)
+            fold_block(&func->func.body, &func->func.body_cnt, func);
+    }
+
+    opt_dce(ast);
+
+    for (size_t i = 0; i < ast->root.asts_cnt; i++) {
+        AST *func = ast->root.asts[i];
+
+        if (func->type == AST_FUNC && !func->func.ext)
+            opt_block(&func->func.body, &func->func.body_cnt);
+    }
+
+    free(purity);
+    free(occurs);
+    free(gens);
+    purity = NULL;
+    occurs = NULL;
+    gens = NULL;
+    purity_cnt = occurs_cnt = gens_cnt = 0;
+}
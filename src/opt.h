@@ -0,0 +1,12 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "ast.h"
+#include "state.h"
+#include <stdbool.h>
+
+extern THREAD_LOCAL bool optimize;
+
+void opt_ast(AST *ast);
+
+#endif
@@ -2,6 +2,8 @@
 #include "token.h"
 #include "lexer.h"
 #include "ast.h"
+#include "emit.h"
+#include "module.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,14 +15,19 @@
 extern const char *tok_types[];
 extern const char *ast_types[];
 
-AST **sym_tab;
-size_t sym_cnt = 0;
-char **included;
-size_t included_cnt = 0;
-Const **constants;
-size_t constants_cnt = 0;
-Alias **aliases;
-size_t aliases_cnt = 0;
+THREAD_LOCAL AST **sym_tab;
+THREAD_LOCAL size_t sym_cnt = 0;
+THREAD_LOCAL char **included;
+THREAD_LOCAL size_t included_cnt = 0;
+THREAD_LOCAL Const **constants;
+THREAD_LOCAL size_t constants_cnt = 0;
+THREAD_LOCAL Alias **aliases;
+THREAD_LOCAL size_t aliases_cnt = 0;
+THREAD_LOCAL bool require_main = true;
+
+// The file being parsed and the statements finished so far, freed if it fails
+THREAD_LOCAL Prs *parsing = NULL;
+THREAD_LOCAL AST *parsed = NULL;
 
 /* Too lazy to explain this
  * Example:
@@ -85,13 +92,56 @@ void sym_append(AST *sym) {
     sym_tab[sym_cnt++] = sym;
 }
 
+void sym_remove(AST *sym) {
+    for (size_t i = 0; i < sym_cnt; i++) {
+        if (sym_tab[i] == sym) {
+            memmove(sym_tab + i, sym_tab + i + 1, (sym_cnt - i - 1) * sizeof(AST *));
+            sym_cnt--;
+            return;
+        }
+    }
+}
+
+bool is_vec_type(char *id) {
+    if (strcmp(id, "float4") == 0 || strcmp(id, "int4") == 0 || strcmp(id, "float8") == 0 || strcmp(id, "int8") == 0)
+        return true;
+
+    return false;
+}
+
+size_t vec_lanes(char *type) {
+    return type[strlen(type) - 1] == '8' ? 8 : 4;
+}
+
 bool is_type(char *id) {
-    if (strcmp(id, "void") == 0 || strcmp(id, "char") == 0 || strcmp(id, "int") == 0 || strcmp(id, "float") == 0)
+    if (strcmp(id, "void") == 0 || strcmp(id, "char") == 0 || strcmp(id, "int") == 0 || strcmp(id, "float") == 0 || is_vec_type(id))
         return true;
 
     return false;
 }
 
+// Vector type of a value, or NULL if it's a scalar
+char *ast_vec_type(AST *ast) {
+    AST *sym;
+    char *type;
+
+    switch (ast->type) {
+        case AST_VAR:
+            sym = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
+            return is_vec_type(sym->assign.type) ? sym->assign.type : NULL;
+        case AST_MATH:
+            for (size_t i = 0; i < ast->math.expr_cnt; i += 2) {
+                if ((type = ast_vec_type(ast->math.expr[i])) != NULL)
+                    return type;
+            }
+            break;
+        case AST_EXPR: return ast_vec_type(ast->expr.value);
+        default: break;
+    }
+
+    return NULL;
+}
+
 bool ast_is_float(AST *ast) {
     AST *sym;
 
@@ -99,7 +149,7 @@ bool ast_is_float(AST *ast) {
         case AST_FLOAT: return true;
         case AST_VAR:
             sym = sym_find(AST_ASSIGN, ast->scope_def, ast->var.name);
-            if (strcmp(sym->assign.type, "float") == 0)
+            if (strcmp(sym->assign.type, "float") == 0 || strcmp(sym->assign.type, "float4") == 0 || strcmp(sym->assign.type, "float8") == 0)
                 return true;
             break;
         case AST_FUNC:
@@ -112,6 +162,12 @@ bool ast_is_float(AST *ast) {
             if (strcmp(sym->func.type, "float") == 0)
                 return true;
             break;
+        case AST_SUBSCR:
+            sym = sym_find(AST_ASSIGN, ast->scope_def, ast->subscr.name);
+            if (strcmp(sym->assign.type, "float*") == 0 || strcmp(sym->assign.type, "float4") == 0 || strcmp(sym->assign.type, "float8") == 0)
+                return true;
+            break;
+        case AST_HREDUCE: return ast_vec_type(ast->hreduce.value)[0] == 'f';
         default: break;
     }
 
@@ -122,13 +178,12 @@ bool digit_is_float(long double digit) {
     char buf[80];
     sprintf(buf, "%Lf", digit);
 
-    char *tok = strtok(buf, ".");
+    // Not strtok, which keeps its place in a static shared by every thread
+    char *tok = strchr(buf, '.');
     if (tok == NULL)
         return false;
 
-    tok = strtok(NULL, ".");
-    assert(tok != NULL);
-
+    tok++;
     char *endptr;
     long long int mantissa = strtoll(tok, &endptr, 10);
 
@@ -180,14 +235,20 @@ Alias *get_alias(char *name) {
     return NULL;
 }
 
-Prs *prs_init(char *file) {
+Tok *prs_next(Prs *prs);
+
+Prs *prs_init(char *file, Lex *lex) {
     Prs *prs = malloc(sizeof(Prs));
     prs->file = file;
-    prs->lex = lex_init(file);
-    prs->tok = lex_next(prs->lex);
+    prs->lex = lex;
     prs->cur_scope = strdup("<global>");
     prs->cur_func = strdup("<global>");
     prs->in_math = false;
+    prs->conds = calloc(1, sizeof(PreCond));
+    prs->conds_cnt = 0;
+    prs->incs = calloc(1, sizeof(Inc));
+    prs->incs_cnt = 0;
+    prs->tok = prs_next(prs);
     return prs;
 }
 
@@ -196,27 +257,222 @@ void prs_del(Prs *prs) {
     lex_del(prs->lex);
     free(prs->cur_scope);
     free(prs->cur_func);
+    free(prs->conds);
+    free(prs->incs);
     free(prs);
 }
 
+/* #if, #ifdef, #ifndef, #elif, #else and #endif are handled as tokens are
+ * read, so they may appear anywhere. An #if compares constants and
+ * literals with the operators of a condition; a name that isn't a
+ * constant is 0 and defined(NAME) is 1 if it is one. The lines of a
+ * branch not taken are skipped by the lexer without being tokenized. */
+Tok *prs_directive_next(Tok *tok, Lex *line) {
+    tok_del(tok);
+    return lex_next(line);
+}
+
+long double prs_directive_value(Prs *prs, Lex *line, Tok **tok) {
+    long double value = 0;
+
+    if ((*tok)->type == TOK_INT || (*tok)->type == TOK_FLOAT)
+        value = strtold((*tok)->value, NULL);
+    else if ((*tok)->type == TOK_ID && strcmp((*tok)->value, "defined") == 0) {
+        *tok = prs_directive_next(*tok, line);
+        bool paren = (*tok)->type == TOK_LPAREN;
+
+        if (paren)
+            *tok = prs_directive_next(*tok, line);
+
+        if ((*tok)->type != TOK_ID) {
+            fatal("%s:%zu:%zu: error: expected constant name but found '%s'\n", prs->file, (*tok)->ln, (*tok)->col, tok_types[(*tok)->type]);
+        }
+
+        value = is_constant((*tok)->value);
+
+        if (paren) {
+            *tok = prs_directive_next(*tok, line);
+
+            if ((*tok)->type != TOK_RPAREN) {
+                fatal("%s:%zu:%zu: error: expected ')' but found '%s'\n", prs->file, (*tok)->ln, (*tok)->col, tok_types[(*tok)->type]);
+            }
+        }
+    } else if ((*tok)->type == TOK_ID) {
+        Const *cons = get_constant((*tok)->value);
+
+        if (cons != NULL && cons->value->type == AST_STR) {
+            fatal("%s:%zu:%zu: error: string constant '%s' in #if\n", prs->file, (*tok)->ln, (*tok)->col, cons->name);
+        } else if (cons != NULL)
+            value = cons->value->data.digit;
+    } else {
+        fatal("%s:%zu:%zu: error: invalid value '%s' in #if\n", prs->file, (*tok)->ln, (*tok)->col, tok_types[(*tok)->type]);
+    }
+
+    *tok = prs_directive_next(*tok, line);
+    return value;
+}
+
+// && binds tighter than ||, a value without a comparison holds if it isn't 0
+bool prs_directive_eval(Prs *prs, Lex *line, Tok **tok) {
+    bool any = false;
+    bool all = true;
+
+    while (true) {
+        long double left = prs_directive_value(prs, line, tok);
+        bool holds = left != 0;
+        TokType kind = (*tok)->type;
+
+        if (kind == TOK_EQ_EQ || kind == TOK_NOT_EQ || kind == TOK_LT || kind == TOK_LTE || kind == TOK_GT || kind == TOK_GTE) {
+            *tok = prs_directive_next(*tok, line);
+            long double right = prs_directive_value(prs, line, tok);
+
+            switch (kind) {
+                case TOK_EQ_EQ: holds = left == right; break;
+                case TOK_NOT_EQ: holds = left != right; break;
+                case TOK_LT: holds = left < right; break;
+                case TOK_LTE: holds = left <= right; break;
+                case TOK_GT: holds = left > right; break;
+                default: holds = left >= right; break;
+            }
+        }
+
+        all = all && holds;
+
+        if ((*tok)->type == TOK_AND) {
+            *tok = prs_directive_next(*tok, line);
+            continue;
+        }
+
+        any = any || all;
+        all = true;
+
+        if ((*tok)->type != TOK_OR)
+            return any;
+
+        *tok = prs_directive_next(*tok, line);
+    }
+}
+
+void prs_directive_skip(Prs *prs) {
+    PreCond *cond = &prs->conds[prs->conds_cnt - 1];
+
+    if (!lex_skip(prs->lex)) {
+        fatal("%s:%zu:%zu: error: unterminated #if\n", prs->file, cond->ln, cond->col);
+    }
+}
+
+// Handles the directive after the '#' at ln:col that was just read
+void prs_directive(Prs *prs, size_t ln, size_t col) {
+    size_t line_ln = prs->lex->ln;
+    size_t line_col = prs->lex->col;
+    Lex *line = lex_init_src(prs->file, lex_line(prs->lex), line_ln, line_col);
+
+    Tok *tok = lex_next(line);
+    char *dir = strdup(tok->value);
+    tok = prs_directive_next(tok, line);
+
+    PreCond *cond = prs->conds_cnt > 0 ? &prs->conds[prs->conds_cnt - 1] : NULL;
+    bool holds = false;
+
+    if (strcmp(dir, "if") != 0 && strcmp(dir, "ifdef") != 0 && strcmp(dir, "ifndef") != 0 && cond == NULL) {
+        fatal("%s:%zu:%zu: error: #%s without #if\n", prs->file, ln, col, dir);
+    } else if ((strcmp(dir, "elif") == 0 || strcmp(dir, "else") == 0) && cond->has_else) {
+        fatal("%s:%zu:%zu: error: #%s after #else\n", prs->file, ln, col, dir);
+    }
+
+    if (strcmp(dir, "ifdef") == 0 || strcmp(dir, "ifndef") == 0) {
+        if (tok->type != TOK_ID) {
+            fatal("%s:%zu:%zu: error: expected constant name but found '%s'\n", prs->file, tok->ln, tok->col, tok_types[tok->type]);
+        }
+
+        holds = is_constant(tok->value) == (strcmp(dir, "ifdef") == 0);
+        tok = prs_directive_next(tok, line);
+    } else if (strcmp(dir, "if") == 0 || (strcmp(dir, "elif") == 0 && !cond->taken))
+        holds = prs_directive_eval(prs, line, &tok);
+    else if (strcmp(dir, "elif") == 0) {
+        // A branch was already taken, the condition is never looked at
+        tok_del(tok);
+        tok = tok_init(TOK_EOF, strdup("<eof>"), ln, col);
+    }
+
+    if (tok->type != TOK_EOF) {
+        fatal("%s:%zu:%zu: error: unexpected '%s' after #%s\n", prs->file, tok->ln, tok->col, tok_types[tok->type], dir);
+    }
+
+    tok_del(tok);
+    lex_del(line);
+
+    if (dir[0] == 'i') {
+        prs->conds = realloc(prs->conds, (prs->conds_cnt + 1) * sizeof(PreCond));
+        prs->conds[prs->conds_cnt++] = (PreCond){ ln, col, holds, false };
+
+        if (!holds)
+            prs_directive_skip(prs);
+    } else if (strcmp(dir, "endif") == 0)
+        prs->conds_cnt--;
+    else {
+        cond->has_else = strcmp(dir, "else") == 0;
+        holds = !cond->taken && (cond->has_else || holds);
+        cond->taken = cond->taken || holds;
+
+        if (!holds)
+            prs_directive_skip(prs);
+    }
+
+    free(dir);
+}
+
+// The next token once conditional directives and the ends of included files are taken care of
+Tok *prs_next(Prs *prs) {
+    Tok *tok = lex_next(prs->lex);
+
+    while (true) {
+        while (tok->type == TOK_HASH && lex_directive(prs->lex) != NULL) {
+            prs_directive(prs, tok->ln, tok->col);
+            tok_del(tok);
+            tok = lex_next(prs->lex);
+        }
+
+        if (tok->type != TOK_EOF)
+            return tok;
+
+        // An #if has to end in the file it started in
+        if (prs->conds_cnt > (prs->incs_cnt > 0 ? prs->incs[prs->incs_cnt - 1].conds_cnt : 0)) {
+            PreCond *cond = &prs->conds[prs->conds_cnt - 1];
+            fatal("%s:%zu:%zu: error: unterminated #if\n", prs->file, cond->ln, cond->col);
+        } else if (prs->incs_cnt == 0)
+            return tok;
+
+        // Back to the file that included this one
+        tok_del(tok);
+        free(prs->lex->file);
+        lex_del(prs->lex);
+        prs->lex = prs->incs[--prs->incs_cnt].lex;
+        prs->file = prs->lex->file;
+        tok = lex_next(prs->lex);
+    }
+}
+
 TokType prs_eat(Prs *prs, TokType type) {
     if (type != prs->tok->type) {
-        fprintf(stderr, "%s:%zu:%zu: error: expected '%s' but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[type], tok_types[prs->tok->type]);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: expected '%s' but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[type], tok_types[prs->tok->type]);
     }
 
     TokType eaten = prs->tok->type;
     if (eaten != TOK_EOF) {
         tok_del(prs->tok);
-        prs->tok = lex_next(prs->lex);
+        // Nothing to free twice if reading the next token fails
+        prs->tok = NULL;
+        prs->tok = prs_next(prs);
     }
     return eaten;
 }
 
-AST **prs_body(Prs *prs, size_t *cnt, bool allow_no_braces) {
-    AST **body = calloc(1, sizeof(AST *));
-    size_t body_cnt = 0;
+// Into the node being built, so what it parsed is freed with it on an error
+void prs_body(Prs *prs, AST ***body, size_t *cnt, bool allow_no_braces) {
     AST *stmt;
+    *body = calloc(1, sizeof(AST *));
+    *cnt = 0;
     bool ate_first = false;
 
     if (!allow_no_braces || prs->tok->type == TOK_LBRACE) {
@@ -230,8 +486,7 @@ AST **prs_body(Prs *prs, size_t *cnt, bool allow_no_braces) {
         switch (stmt->type) {
             case AST_CALL:
                 if (strcmp(prs->cur_scope, prs->cur_func) == 0 && strcmp(prs->cur_func, stmt->call.name) == 0) {
-                    fprintf(stderr, "%s:%zu:%zu: error: call to function '%s' will result in infinite recursion\n", prs->file, stmt->ln, stmt->col, stmt->call.name);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: call to function '%s' will result in infinite recursion\n", prs->file, stmt->ln, stmt->col, stmt->call.name);
                 }
 
                 prs_eat(prs, TOK_SEMI);
@@ -257,12 +512,11 @@ AST **prs_body(Prs *prs, size_t *cnt, bool allow_no_braces) {
                 break;
             default:
 prs_body_invalid_stmt:
-                fprintf(stderr, "%s:%zu:%zu: error: invalid statement '%s' in function '%s'\n", prs->file, stmt->ln, stmt->col, ast_types[stmt->type], prs->cur_func);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: invalid statement '%s' in function '%s'\n", prs->file, stmt->ln, stmt->col, ast_types[stmt->type], prs->cur_func);
         }
 
-        body = realloc(body, (body_cnt + 1) * sizeof(AST *));
-        body[body_cnt++] = stmt;
+        *body = realloc(*body, (*cnt + 1) * sizeof(AST *));
+        (*body)[(*cnt)++] = stmt;
 
         if (allow_no_braces)
             break;
@@ -270,23 +524,110 @@ prs_body_invalid_stmt:
 
     if (!allow_no_braces || (prs->tok->type == TOK_RBRACE && ate_first))
         prs_eat(prs, TOK_RBRACE);
-
-    *cnt = body_cnt;
-    return body;
 }
 
 AST *prs_value(Prs *prs, char *type);
 
+void prs_hreduce_check(Prs *prs, AST *value) {
+    if (value->type == AST_HREDUCE) {
+        fatal("%s:%zu:%zu: error: '%s' can only be used as an assignment or return value\n", prs->file, value->ln, value->col, value->hreduce.name);
+    }
+}
+
+/* Check a value used where a vector of 'type' is expected. Scalars are
+ * broadcast to every lane, and subscripting an array loads as many elements
+ * as the vector has lanes.
+ */
+void prs_vec_value(Prs *prs, AST *value, char *type, bool top) {
+    AST *sym;
+    char base_type[strlen(type) + 1];
+    strcpy(base_type, type);
+    base_type[strlen(base_type) - 1] = '\0';
+
+    switch (value->type) {
+        case AST_INT:
+        case AST_FLOAT: break;
+        case AST_VAR:
+            sym = sym_find(AST_ASSIGN, value->scope_def, value->var.name);
+
+            if (is_vec_type(sym->assign.type) && strcmp(sym->assign.type, type) != 0) {
+                fatal("%s:%zu:%zu: error: invalid value of vector type '%s' to '%s'\n", prs->file, value->ln, value->col, sym->assign.type, type);
+            } else if (strchr(sym->assign.type, '*') != NULL) {
+                fatal("%s:%zu:%zu: error: invalid value from variable '%s' of type '%s' to '%s'\n", prs->file, value->ln, value->col, value->var.name, sym->assign.type, type);
+            }
+            break;
+        case AST_SUBSCR:
+            sym = sym_find(AST_ASSIGN, value->scope_def, value->subscr.name);
+
+            if (value->subscr.index->type != AST_INT && value->subscr.index->type != AST_VAR) {
+                fatal("%s:%zu:%zu: error: invalid index of type '%s' in vector expression\n", prs->file, value->ln, value->col, ast_types[value->subscr.index->type]);
+            } else if (!is_vec_type(sym->assign.type) && (strncmp(sym->assign.type, base_type, strlen(base_type)) != 0 || strcmp(sym->assign.type + strlen(base_type), "*") != 0)) {
+                fatal("%s:%zu:%zu: error: invalid vector load from variable '%s' of type '%s' to '%s'\n", prs->file, value->ln, value->col, value->subscr.name, sym->assign.type, type);
+            }
+            break;
+        case AST_MATH:
+            for (size_t i = 1; i < value->math.expr_cnt; i += 2) {
+                TokType kind = value->math.expr[i]->oper.kind;
+
+                if (kind == TOK_PERCENT || (kind == TOK_SLASH && strcmp(base_type, "int") == 0)) {
+                    fatal("%s:%zu:%zu: error: invalid operator '%s' for vector type '%s'\n", prs->file, value->ln, value->col, tok_types[kind], type);
+                } else if (kind == TOK_STAR && strcmp(base_type, "int") == 0 && march < ARCH_SSE4_1) {
+                    fatal("%s:%zu:%zu: error: multiplying vectors of type '%s' requires -march=sse4.1 or later\n", prs->file, value->ln, value->col, type);
+                }
+            }
+
+            for (size_t i = 0; i < value->math.expr_cnt; i += 2)
+                prs_vec_value(prs, value->math.expr[i], type, false);
+            break;
+        case AST_EXPR:
+            prs_vec_value(prs, value->expr.value, type, false);
+            break;
+        case AST_ARR_LST:
+            if (!top) {
+                fatal("%s:%zu:%zu: error: invalid value '%s' in vector expression\n", prs->file, value->ln, value->col, ast_types[value->type]);
+            } else if (value->arr_lst.items_cnt != vec_lanes(type)) {
+                fatal("%s:%zu:%zu: error: expected %zu values for vector type '%s' but found %zu\n", prs->file, value->ln, value->col, vec_lanes(type), type, value->arr_lst.items_cnt);
+            }
+
+            for (size_t i = 0; i < value->arr_lst.items_cnt; i++) {
+                AST *item = value->arr_lst.items[i];
+
+                if ((item->type != AST_INT && item->type != AST_FLOAT && item->type != AST_VAR) || ast_vec_type(item) != NULL) {
+                    fatal("%s:%zu:%zu: error: invalid value '%s' for lane of vector type '%s'\n", prs->file, item->ln, item->col, ast_types[item->type], type);
+                }
+
+                prs_vec_value(prs, item, type, false);
+            }
+            break;
+        default:
+            fatal("%s:%zu:%zu: error: invalid value '%s' in vector expression\n", prs->file, value->ln, value->col, ast_types[value->type]);
+    }}
+
+// Vectors only mix with vectors, so a vector value where 'type' isn't one is an error
+void prs_vec_check(Prs *prs, AST *value, char *type) {
+    char *vec_type = ast_vec_type(value);
+
+    if (type != NULL && is_vec_type(type))
+        prs_vec_value(prs, value, type, true);
+    else if (vec_type != NULL && type == NULL) {
+        fatal("%s:%zu:%zu: error: invalid use of value of vector type '%s'\n", prs->file, value->ln, value->col, vec_type);
+    } else if (vec_type != NULL) {
+        fatal("%s:%zu:%zu: error: invalid value of vector type '%s' to '%s'\n", prs->file, value->ln, value->col, vec_type, type);
+    }
+}
+
 AST *prs_math(Prs *prs, AST *first) {
-    AST **expr = calloc(1, sizeof(AST *));
-    size_t expr_cnt = 1;
+    // Holds the terms as they're parsed, so an error frees them with it
+    AST *ast = ast_init(AST_MATH, first->scope_def, first->func_def, first->ln, first->col);
+    ast->math.expr = calloc(1, sizeof(AST *));
+    ast->math.expr[0] = first;
+    ast->math.expr_cnt = 1;
     AST *oper;
     AST *value;
     bool is_float = ast_is_float(first);
     bool contains_mod = false;
     bool is_const = first->type == AST_INT || first->type == AST_FLOAT ? true : false;
 
-    expr[0] = first;
     prs->in_math = true;
 
     while (prs->tok->type == TOK_PLUS || prs->tok->type == TOK_MINUS || prs->tok->type == TOK_STAR || prs->tok->type == TOK_SLASH || prs->tok->type == TOK_PERCENT) {
@@ -304,16 +645,20 @@ AST *prs_math(Prs *prs, AST *first) {
         if (!is_float)
             is_float = ast_is_float(value);
 
-        expr = realloc(expr, (expr_cnt + 2) * sizeof(AST *));
-        expr[expr_cnt++] = oper;
-        expr[expr_cnt++] = value;
+        ast->math.expr = realloc(ast->math.expr, (ast->math.expr_cnt + 2) * sizeof(AST *));
+        ast->math.expr[ast->math.expr_cnt++] = oper;
+        ast->math.expr[ast->math.expr_cnt++] = value;
     }
 
+    AST **expr = ast->math.expr;
+    size_t expr_cnt = ast->math.expr_cnt;
     prs->in_math = false;
 
+    for (size_t i = 0; i < expr_cnt; i += 2)
+        prs_hreduce_check(prs, expr[i]);
+
     if (is_float && contains_mod) {
-        fprintf(stderr, "%s:%zu:%zu: error: modulus operator used where a float result may occur; consider using casts\n", prs->file, first->ln, first->col);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: modulus operator used where a float result may occur; consider using casts\n", prs->file, first->ln, first->col);
     }
 
     if (is_const) {
@@ -382,23 +727,12 @@ AST *prs_math(Prs *prs, AST *first) {
             right->active = false;
         }
 
-        // Start at 1 so it doesn't free AST *first yet
-        for (size_t i = 1; i < expr_cnt; i++) {
-            if (expr[i] != NULL)
-                ast_del(expr[i]);
-        }
-
-        free(expr);
-
-        AST *ast = ast_init(digit_is_float(result) ? AST_FLOAT : AST_INT, first->scope_def, first->func_def, first->ln, first->col);
-        ast->data.digit = result;
-        ast_del(first);
-        return ast;
+        AST *lit = ast_init(digit_is_float(result) ? AST_FLOAT : AST_INT, first->scope_def, first->func_def, first->ln, first->col);
+        lit->data.digit = result;
+        ast_del(ast);
+        return lit;
     }
 
-    AST *ast = ast_init(AST_MATH, first->scope_def, first->func_def, first->ln, first->col);
-    ast->math.expr = expr;
-    ast->math.expr_cnt = expr_cnt;
     return ast;
 }
 
@@ -411,7 +745,7 @@ AST *prs_value(Prs *prs, char *type) {
     switch (value->type) {
         case AST_INT:
         case AST_FLOAT:
-            if (value->type == AST_FLOAT && strcmp(type, "float") != 0)
+            if (value->type == AST_FLOAT && strcmp(type, "float") != 0 && strcmp(type, "float4") != 0 && strcmp(type, "float8") != 0)
                 value->type = AST_INT;
 
             if (strcmp(type, "char") == 0 && (value->data.digit > CHAR_MAX || value->data.digit < CHAR_MIN))
@@ -423,47 +757,60 @@ AST *prs_value(Prs *prs, char *type) {
         case AST_CALL: {
             AST *sym = sym_find(AST_FUNC, "<global>", value->call.name);
             if (strcmp(sym->func.type, "void") == 0) {
-                fprintf(stderr, "%s:%zu:%zu: error: function '%s' doesn't return a value\n", prs->file, value->ln, value->col, value->call.name);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: function '%s' doesn't return a value\n", prs->file, value->ln, value->col, value->call.name);
             }
             break;
         }
         case AST_MATH: break;
+        case AST_HREDUCE: break;
         case AST_STR:
-        case AST_ARR_LST:
             if (type == NULL || strchr(type, '*') == NULL) {
-                fprintf(stderr, "%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
+            }
+            break;
+        case AST_ARR_LST:
+            if (type == NULL || (strchr(type, '*') == NULL && !is_vec_type(type))) {
+                fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
             }
             break;
         case AST_DEREF: {
             if (type == NULL) {
-                fprintf(stderr, "%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
             }
 
             AST *sym = sym_find(AST_ASSIGN, value->scope_def, value->var.name);
-            char *base_type = strdup(sym->assign.type);
+            char base_type[strlen(sym->assign.type) + 1];
+            strcpy(base_type, sym->assign.type);
             base_type[strlen(base_type) - 1] = '\0';
 
             if ((strchr(type, '*') == NULL && strchr(base_type, '*') != NULL) || (strchr(type, '*') != NULL && strchr(base_type, '*') == NULL)) {
-                fprintf(stderr, "%s:%zu:%zu: error: invalid value from derefence of variable '%s' from type '%s' to '%s'\n", prs->file, value->ln, value->col, value->var.name, sym->assign.type, base_type);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: invalid value from derefence of variable '%s' from type '%s' to '%s'\n", prs->file, value->ln, value->col, value->var.name, sym->assign.type, base_type);
+            }
+
+            break;
+        }
+        case AST_SUBSCR: {
+            AST *sym = sym_find(AST_ASSIGN, value->scope_def, value->subscr.name);
+            char base_type[strlen(sym->assign.type) + 1];
+            strcpy(base_type, sym->assign.type);
+            base_type[strlen(base_type) - 1] = '\0';
+
+            if (value->subscr.value != NULL) {
+                fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
+            } else if ((strchr(type, '*') == NULL && strchr(base_type, '*') != NULL) || (strchr(type, '*') != NULL && strchr(base_type, '*') == NULL)) {
+                fatal("%s:%zu:%zu: error: invalid value from subscript of variable '%s' from type '%s' to '%s'\n", prs->file, value->ln, value->col, value->subscr.name, base_type, type);
             }
 
-            free(base_type);
             break;
         }
         case AST_REF:
             if (type == NULL || strchr(type, '*') == NULL) {
-                fprintf(stderr, "%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
             }
             break;
         case AST_EXPR: break;
         default:
-            fprintf(stderr, "%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid value '%s'\n", prs->file, value->ln, value->col, ast_types[value->type]);
     }
 
 check_math:
@@ -473,16 +820,23 @@ check_math:
     return value;
 }
 
-AST *prs_id_func(Prs *prs, char *name, char *type, size_t ln, size_t col) {
+AST *prs_id_func(Prs *prs, char *name, char *type, bool ext, bool exported, size_t ln, size_t col) {
+    // Made first, so an error frees what's parsed of it with it
+    AST *ast = ast_init(AST_FUNC, "<global>", "<global>", ln, col);
+    ast->func.name = name;
+    ast->func.type = type;
+    ast->func.ext = ext;
+    ast->func.exported = exported;
+
     AST *sym = sym_find(AST_FUNC, "<global>", name);
     if (sym != NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: redefinition of function '%s'; first defined at %zu:%zu\n", prs->file, ln, col, name, sym->ln, sym->col);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: redefinition of function '%s'; first defined at %zu:%zu\n", prs->file, ln, col, name, sym->ln, sym->col);
     }
 
-    if (strcmp(name, "main") == 0 && strcmp(type, "void") != 0) {
-        fprintf(stderr, "%s:%zu:%zu: error: entrypoint 'main' must have type 'void'\n", prs->file, ln, col);
-        exit(EXIT_FAILURE);
+    if (strcmp(name, "main") == 0 && (ext || exported)) {
+        fatal("%s:%zu:%zu: error: entrypoint 'main' can't be %s\n", prs->file, ln, col, ext ? "extern" : "exported");
+    } else if (strcmp(name, "main") == 0 && strcmp(type, "void") != 0) {
+        fatal("%s:%zu:%zu: error: entrypoint 'main' must have type 'void'\n", prs->file, ln, col);
     }
 
     prs->cur_scope = realloc(prs->cur_scope, (strlen(name) + 1) * sizeof(char));
@@ -490,51 +844,54 @@ AST *prs_id_func(Prs *prs, char *name, char *type, size_t ln, size_t col) {
     prs->cur_func = realloc(prs->cur_func, (strlen(name) + 1) * sizeof(char));
     strcpy(prs->cur_func, name);
 
-    AST **params = calloc(1, sizeof(AST *));
-    size_t params_cnt = 0;
     AST *param;
+    ast->func.params = calloc(1, sizeof(AST *));
     prs_eat(prs, TOK_LPAREN);
 
     while (prs->tok->type != TOK_RPAREN && prs->tok->type != TOK_EOF) {
-        if (params_cnt > 0)
+        if (ast->func.params_cnt > 0)
             prs_eat(prs, TOK_COMMA);
 
         param = prs_stmt(prs);
         if (param->type != AST_ASSIGN) {
-            fprintf(stderr, "%s:%zu:%zu: error: expected parameter definition but found '%s'\n", prs->file, param->ln, param->col, ast_types[param->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: expected parameter definition but found '%s'\n", prs->file, param->ln, param->col, ast_types[param->type]);
+        } else if (is_vec_type(param->assign.type)) {
+            fatal("%s:%zu:%zu: error: parameter '%s' can't have vector type '%s'\n", prs->file, param->ln, param->col, param->assign.name, param->assign.type);
         } else if (param->assign.value != NULL) {
-            fprintf(stderr, "%s:%zu:%zu: error: assigning parameter '%s' outside of function body\n", prs->file, param->ln, param->col, param->assign.name);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: assigning parameter '%s' outside of function body\n", prs->file, param->ln, param->col, param->assign.name);
         }
 
-        params = realloc(params, (params_cnt + 1) * sizeof(AST *));
-        params[params_cnt++] = param;
+        ast->func.params = realloc(ast->func.params, (ast->func.params_cnt + 1) * sizeof(AST *));
+        ast->func.params[ast->func.params_cnt++] = param;
     }
 
     prs_eat(prs, TOK_RPAREN);
-
-    AST *ast = ast_init(AST_FUNC, "<global>", "<global>", ln, col);
-    ast->func.name = name;
-    ast->func.type = type;
-    ast->func.params = params;
-    ast->func.params_cnt = params_cnt;
     sym_append(ast);
 
-    size_t body_cnt;
-    AST **body = prs_body(prs, &body_cnt, false);
+    if (ext) {
+        // Defined in another object or library, only the prototype is known
+        prs_eat(prs, TOK_SEMI);
+        ast->func.body = calloc(1, sizeof(AST *));
+        ast->func.body_cnt = 0;
+        ast->func.ret = NULL;
+
+        prs->cur_scope = realloc(prs->cur_scope, 9 * sizeof(char));
+        strcpy(prs->cur_scope, "<global>");
+        prs->cur_func = realloc(prs->cur_func, 9 * sizeof(char));
+        strcpy(prs->cur_func, "<global>");
+        return ast;
+    }
+
+    prs_body(prs, &ast->func.body, &ast->func.body_cnt, false);
     AST *ret = NULL;
 
-    if (body_cnt > 0 && body[body_cnt - 1]->type == AST_RET)
-        ret = body[body_cnt - 1];
+    if (ast->func.body_cnt > 0 && ast->func.body[ast->func.body_cnt - 1]->type == AST_RET)
+        ret = ast->func.body[ast->func.body_cnt - 1];
 
     if (strcmp(type, "void") != 0 && ret == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: missing return statement in function '%s' of type '%s'\n", prs->file, ln, col, name, type);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: missing return statement in function '%s' of type '%s'\n", prs->file, ln, col, name, type);
     }
 
-    ast->func.body = body;
-    ast->func.body_cnt = body_cnt;
     ast->func.ret = ret;
 
     prs->cur_scope = realloc(prs->cur_scope, 9 * sizeof(char));
@@ -546,22 +903,23 @@ AST *prs_id_func(Prs *prs, char *name, char *type, size_t ln, size_t col) {
 }
 
 AST *prs_id_assign(Prs *prs, char *name, char *type, bool mut, size_t ln, size_t col) {
+    AST *ast = ast_init(AST_ASSIGN, prs->cur_scope, prs->cur_func, ln, col);
+    ast->assign.name = name;
+    ast->assign.type = type;
+    ast->assign.rbp = NULL;
+
     AST *sym = sym_find(AST_ASSIGN, prs->cur_scope, name);
     if (type != NULL && sym != NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: redefinition of variable '%s'; first defined at %zu:%zu\n", prs->file, ln, col, name, sym->ln, sym->col);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: redefinition of variable '%s'; first defined at %zu:%zu\n", prs->file, ln, col, name, sym->ln, sym->col);
     }
 
-    if (sym != NULL && type == NULL && !sym->assign.mut) {
-        fprintf(stderr, "%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+    if (sym == NULL && type == NULL) {
+        fatal("%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
+    } else if (sym != NULL && type == NULL && !sym->assign.mut) {
+        fatal("%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
     } else if (sym != NULL && type != NULL)
         mut = sym->assign.mut;
 
-    AST *ast = ast_init(AST_ASSIGN, prs->cur_scope, prs->cur_func, ln, col);
-    ast->assign.name = name;
-    ast->assign.type = type;
-    ast->assign.rbp = NULL;
     ast->assign.mut = mut;
 
     size_t cap = 0;
@@ -570,60 +928,57 @@ AST *prs_id_assign(Prs *prs, char *name, char *type, bool mut, size_t ln, size_t
     if (prs->tok->type == TOK_EQUAL) {
 prs_id_assign_value:
         prs_eat(prs, TOK_EQUAL);
-        value = prs_value(prs, type == NULL ? sym->assign.type : type);
+        value = ast->assign.value = prs_value(prs, type == NULL ? sym->assign.type : type);
 
         char *check_type = type != NULL ? type : sym->assign.type;
         size_t check_cap = type != NULL ? cap : sym->assign.arr_cap;
         bool check_mut = type != NULL ? mut : sym->assign.mut;
 
+        prs_vec_check(prs, value, check_type);
+
         if (strchr(check_type, '*') != NULL) {
             if (check_cap > 0) {
                 if (value->type != AST_STR && value->type != AST_ARR_LST) {
-                    fprintf(stderr, "%s:%zu:%zu: error: invalid value '%s' for array of type '%s'\n", prs->file, ln, col, ast_types[value->type], type);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: invalid value '%s' for array of type '%s'\n", prs->file, ln, col, ast_types[value->type], type);
                 } else if (value->type == AST_STR && strlen(value->data.str) + 1 >= check_cap) {
-                    fprintf(stderr, "%s:%zu:%zu: error: value '%s' exceeds array capacity of size %zu\n", prs->file, ln, col, ast_types[value->type], check_cap);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: value '%s' exceeds array capacity of size %zu\n", prs->file, ln, col, ast_types[value->type], check_cap);
                 } else if (value->type == AST_ARR_LST && value->arr_lst.items_cnt > check_cap) {
-                    fprintf(stderr, "%s:%zu:%zu: error: value '%s' exceeds array capacity of size %zu\n", prs->file, ln, col, ast_types[value->type], check_cap);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: value '%s' exceeds array capacity of size %zu\n", prs->file, ln, col, ast_types[value->type], check_cap);
                 }
+            } else if (value->type == AST_ARR_LST) {
+                fatal("%s:%zu:%zu: error: invalid value '%s' for pointer of type '%s'\n", prs->file, ln, col, ast_types[value->type], check_type);
             } else if (value->type == AST_REF) {
                 AST *ref_sym = sym_find(AST_ASSIGN, value->scope_def, value->ref.name);
 
-                char *base_type = strdup(check_type);
+                char base_type[strlen(check_type) + 1];
+                strcpy(base_type, check_type);
                 base_type[strlen(base_type) - 1] = '\0';
 
                 if (strcmp(ref_sym->assign.type, base_type) != 0) {
-                    fprintf(stderr, "%s:%zu:%zu: error: incompatible pointer conversion; reference to variable '%s' is type '%s*' converting to '%s'\n", prs->file, ln, col, value->ref.name, ref_sym->assign.type, check_type);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: incompatible pointer conversion; reference to variable '%s' is type '%s*' converting to '%s'\n", prs->file, ln, col, value->ref.name, ref_sym->assign.type, check_type);
                 } else if (check_mut && !ref_sym->assign.mut) {
-                    fprintf(stderr, "%s:%zu:%zu: error: conflicting kinds of immutability; converting immutable reference to variable '%s' to a mutable reference\n", prs->file, ln, col, value->ref.name);
-                    exit(EXIT_FAILURE);
+                    fatal("%s:%zu:%zu: error: conflicting kinds of immutability; converting immutable reference to variable '%s' to a mutable reference\n", prs->file, ln, col, value->ref.name);
                 }
 
-                free(base_type);
-
                 // TODO: do we need more checks here?
             }
         }
     } else if (prs->tok->type == TOK_LSQUARE) {
         prs_eat(prs, TOK_LSQUARE);
 
-        if (prs->tok->type != TOK_INT) {
-            fprintf(stderr, "%s:%zu:%zu: error: invalid array capacity, expected an int\n", prs->file, prs->tok->ln, prs->tok->col);
-            exit(EXIT_FAILURE);
+        if (is_vec_type(type)) {
+            fatal("%s:%zu:%zu: error: arrays of vector type '%s' are not supported\n", prs->file, ln, col, type);
+        } else if (prs->tok->type != TOK_INT) {
+            fatal("%s:%zu:%zu: error: invalid array capacity, expected an int\n", prs->file, prs->tok->ln, prs->tok->col);
         }
 
         char *endptr;
         long arr_cap = strtol(prs->tok->value, &endptr, 10);
 
         if (endptr == prs->tok->value || errno == ERANGE) {
-            fprintf(stderr, "%s:%zu:%zu: error: digit conversion failed: %s\n", prs->file, ln, col, strerror(errno));
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: digit conversion failed: %s\n", prs->file, ln, col, strerror(errno));
         } else if (arr_cap < 1) {
-            fprintf(stderr, "%s:%zu:%zu: error: arrays must have a size of at least 1\n", prs->file, ln, col);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: arrays must have a size of at least 1\n", prs->file, ln, col);
         }
 
         cap = (size_t)arr_cap;
@@ -632,6 +987,7 @@ prs_id_assign_value:
 
         ast->assign.type = realloc(ast->assign.type, (strlen(ast->assign.type) + 2) * sizeof(char));
         strcat(ast->assign.type, "*");
+        type = ast->assign.type;
 
         if (prs->tok->type == TOK_EQUAL)
             goto prs_id_assign_value;
@@ -649,158 +1005,172 @@ prs_id_assign_value:
 AST *prs_id_ret(Prs *prs, size_t ln, size_t col) {
     AST *sym = sym_find(AST_FUNC, "<global>", prs->cur_func);
     if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: invalid statement 'Return' outside of a function\n", prs->file, ln, col);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: invalid statement 'Return' outside of a function\n", prs->file, ln, col);
     }
 
     if (strcmp(sym->func.type, "void") == 0 && prs->tok->type != TOK_SEMI) {
-        fprintf(stderr, "%s:%zu:%zu: error: unexpected return value in function '%s' of type 'void'\n", prs->file, prs->tok->ln, prs->tok->col, prs->cur_func);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: unexpected return value in function '%s' of type 'void'\n", prs->file, prs->tok->ln, prs->tok->col, prs->cur_func);
     } else if (strcmp(sym->func.type, "void") != 0 && prs->tok->type == TOK_SEMI) {
-        fprintf(stderr, "%s:%zu:%zu: error: missing return value in function '%s' of type '%s'\n", prs->file, prs->tok->ln, prs->tok->col, prs->cur_func, sym->func.type);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: missing return value in function '%s' of type '%s'\n", prs->file, prs->tok->ln, prs->tok->col, prs->cur_func, sym->func.type);
     }
 
     AST *ast = ast_init(AST_RET, prs->cur_scope, prs->cur_func, ln, col);
     ast->ret.value = prs->tok->type == TOK_SEMI ? NULL : prs_value(prs, sym->func.type);
+
+    if (ast->ret.value != NULL)
+        prs_vec_check(prs, ast->ret.value, sym->func.type);
+
     return ast;
 }
 
 AST *prs_id_call(Prs *prs, char *name, size_t ln, size_t col) {
+    AST *ast = ast_init(AST_CALL, prs->cur_scope, prs->cur_func, ln, col);
+    ast->call.name = name;
+    ast->call.args = calloc(1, sizeof(AST *));
+
     AST *sym = sym_find(AST_FUNC, "<global>", name);
     if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: undefined function '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: undefined function '%s'\n", prs->file, ln, col, name);
     }
 
-    AST **args = calloc(1, sizeof(AST *));
     size_t args_cnt = 0;
     AST *param;
     AST *arg;
     prs_eat(prs, TOK_LPAREN);
 
     while (prs->tok->type != TOK_RPAREN && prs->tok->type != TOK_EOF) {
-        if (args_cnt > sym->func.params_cnt) {
-            fprintf(stderr, "%s:%zu:%zu: error: excessive arguments in call to function '%s'; expected %zu but found %zu\n", prs->file, ln, col, name, sym->func.params_cnt, args_cnt);
-            exit(EXIT_FAILURE);
+        if (args_cnt >= sym->func.params_cnt) {
+            fatal("%s:%zu:%zu: error: excessive arguments in call to function '%s'; expected %zu but found %zu\n", prs->file, ln, col, name, sym->func.params_cnt, args_cnt + 1);
         } else if (args_cnt > 0)
             prs_eat(prs, TOK_COMMA);
 
         param = sym->func.params[args_cnt];
         arg = prs_value(prs, param->assign.type);
+        prs_vec_check(prs, arg, param->assign.type);
+        prs_hreduce_check(prs, arg);
 
         if (arg->type == AST_VAR) {
             AST *arg_sym = sym_find(AST_ASSIGN, arg->scope_def, arg->var.name);
 
             if (param->assign.mut && !arg_sym->assign.mut) {
-                fprintf(stderr, "%s:%zu:%zu: error: conflicting kinds of mutability in argument %zu of call to function '%s'\n", prs->file, arg->ln, arg->col, args_cnt, name);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: conflicting kinds of mutability in argument %zu of call to function '%s'\n", prs->file, arg->ln, arg->col, args_cnt, name);
             }
         } else if (arg->type == AST_REF) {
             AST *arg_sym = sym_find(AST_ASSIGN, arg->scope_def, arg->ref.name);
 
             if (param->assign.mut && !arg_sym->assign.mut) {
-                fprintf(stderr, "%s:%zu:%zu: error: conflicting kinds of mutability in argument %zu of call to function '%s'\n", prs->file, arg->ln, arg->col, args_cnt, name);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: conflicting kinds of mutability in argument %zu of call to function '%s'\n", prs->file, arg->ln, arg->col, args_cnt, name);
             }
         }
 
-        args = realloc(args, (args_cnt + 1) * sizeof(AST *));
-        args[args_cnt++] = arg;
+        ast->call.args = realloc(ast->call.args, (args_cnt + 1) * sizeof(AST *));
+        ast->call.args[args_cnt++] = arg;
+        ast->call.args_cnt = args_cnt;
     }
 
     prs_eat(prs, TOK_RPAREN);
 
     if (args_cnt < sym->func.params_cnt) {
-        fprintf(stderr, "%s:%zu:%zu: error: missing arguments in call to function '%s'; expected %zu but found %zu\n", prs->file, ln, col, name, sym->func.params_cnt, args_cnt);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: missing arguments in call to function '%s'; expected %zu but found %zu\n", prs->file, ln, col, name, sym->func.params_cnt, args_cnt);
     }
 
-    AST *ast = ast_init(AST_CALL, prs->cur_scope, prs->cur_func, ln, col);
-    ast->call.name = name;
-    ast->call.args = args;
-    ast->call.args_cnt = args_cnt;
     return ast;
 }
 
-AST **prs_cond(Prs *prs, size_t *cnt, bool ignore_paren) {
-    AST **exprs = calloc(1, sizeof(AST *));
-    size_t exprs_cnt = 0;
+// Into the node being built like prs_body
+void prs_cond(Prs *prs, AST ***exprs, size_t *cnt, bool ignore_paren) {
     AST *oper;
     AST *left;
     AST *right;
+    *exprs = calloc(1, sizeof(AST *));
+    *cnt = 0;
 
     if (!ignore_paren)
         prs_eat(prs, TOK_LPAREN);
 
     while (prs->tok->type != TOK_RPAREN && prs->tok->type != TOK_SEMI && prs->tok->type != TOK_EOF) {
-        if (exprs_cnt > 0 && (prs->tok->type == TOK_AND || prs->tok->type == TOK_OR)) {
+        if (*cnt > 0 && (prs->tok->type == TOK_AND || prs->tok->type == TOK_OR)) {
             oper = ast_init(AST_OPER, prs->cur_scope, prs->cur_func, prs->tok->ln, prs->tok->col);
             oper->oper.kind = prs_eat(prs, prs->tok->type);
-            exprs = realloc(exprs, (exprs_cnt + 1) * sizeof(AST *));
-            exprs[exprs_cnt++] = oper;
+            *exprs = realloc(*exprs, (*cnt + 1) * sizeof(AST *));
+            (*exprs)[(*cnt)++] = oper;
         }
 
         left = prs_value(prs, NULL);
+        prs_vec_check(prs, left, NULL);
+        prs_hreduce_check(prs, left);
 
         if (prs->tok->type != TOK_LT && prs->tok->type != TOK_LTE && prs->tok->type != TOK_GT && prs->tok->type != TOK_GTE && prs->tok->type != TOK_NOT_EQ && prs->tok->type != TOK_EQ_EQ) {
-            fprintf(stderr, "%s:%zu:%zu: error: invalid logical operator '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid logical operator '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
         }
 
         oper = ast_init(AST_OPER, prs->cur_scope, prs->cur_func, prs->tok->ln, prs->tok->col);
         oper->oper.kind = prs_eat(prs, prs->tok->type);
 
         right = prs_value(prs, NULL);
+        prs_vec_check(prs, right, NULL);
+        prs_hreduce_check(prs, right);
 
-        exprs = realloc(exprs, (exprs_cnt + 3) * sizeof(AST *));
-        exprs[exprs_cnt++] = left;
-        exprs[exprs_cnt++] = oper;
-        exprs[exprs_cnt++] = right;
+        *exprs = realloc(*exprs, (*cnt + 3) * sizeof(AST *));
+        (*exprs)[(*cnt)++] = left;
+        (*exprs)[(*cnt)++] = oper;
+        (*exprs)[(*cnt)++] = right;
     }
 
     if (!ignore_paren)
         prs_eat(prs, TOK_RPAREN);
-
-    *cnt = exprs_cnt;
-    return exprs;
 }
 
 AST *prs_id_if(Prs *prs, size_t ln, size_t col) {
     AST *ast = ast_init(AST_IF_ELSE, prs->cur_scope, prs->cur_func, ln, col);
-    ast->if_else.exprs = prs_cond(prs, &ast->if_else.exprs_cnt, false);
+    prs_cond(prs, &ast->if_else.exprs, &ast->if_else.exprs_cnt, false);
 
-    char *old_scope = strdup(prs->cur_scope);
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(prs->cur_scope) + 64) * sizeof(char));
-    sprintf(prs->cur_scope, "%s-if:%zu:%zu", old_scope, prs->tok->ln, prs->tok->col);
+    // The enclosing scope is kept as the start of the new one, nothing to copy or free
+    size_t old_len = strlen(prs->cur_scope);
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 64) * sizeof(char));
+    sprintf(prs->cur_scope + old_len, "-if:%zu:%zu", prs->tok->ln, prs->tok->col);
 
-    ast->if_else.body = prs_body(prs, &ast->if_else.body_cnt, true);
+    prs_body(prs, &ast->if_else.body, &ast->if_else.body_cnt, true);
 
     if (strcmp(prs->tok->value, "else") == 0) {
         prs_eat(prs, TOK_ID);
-        sprintf(prs->cur_scope, "%s-else:%zu:%zu", old_scope, prs->tok->ln, prs->tok->col);
-        ast->if_else.else_body = prs_body(prs, &ast->if_else.else_body_cnt, true);
-    } else
-        ast->if_else.else_body = NULL;
 
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(old_scope) + 1) * sizeof(char));
-    strcpy(prs->cur_scope, old_scope);
-    free(old_scope);
+        // Whatever nested in the body left the scope only as long as it was
+        prs->cur_scope = realloc(prs->cur_scope, (old_len + 64) * sizeof(char));
+        sprintf(prs->cur_scope + old_len, "-else:%zu:%zu", prs->tok->ln, prs->tok->col);
+        prs_body(prs, &ast->if_else.else_body, &ast->if_else.else_body_cnt, true);
+    }
+
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 1) * sizeof(char));
+    prs->cur_scope[old_len] = '\0';
     return ast;
 }
 
 AST *prs_id_quick_math(Prs *prs, char *name, size_t ln, size_t col, bool is_deref) {
+    AST *ast;
+    AST *value = ast_init(AST_MATH, prs->cur_scope, prs->cur_func, ln, col);
+    AST **expr = value->math.expr = calloc(3, sizeof(AST *));
+    value->math.expr_cnt = 3;
+
+    if (is_deref) {
+        ast = ast_init(AST_DEREF, prs->cur_scope, prs->cur_func, ln, col);
+        ast->deref.name = name;
+        ast->deref.value = value;
+    } else {
+        ast = ast_init(AST_ASSIGN, prs->cur_scope, prs->cur_func, ln, col);
+        ast->assign.name = name;
+        ast->assign.type = NULL;
+        ast->assign.rbp = NULL;
+        ast->assign.value = value;
+    }
+
     AST *sym = sym_find(AST_ASSIGN, prs->cur_scope, name);
     if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
     } else if (!sym->assign.mut) {
-        fprintf(stderr, "%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
     }
 
-    AST **expr = calloc(3, sizeof(AST *));
-
     if (is_deref) {
         expr[0] = ast_init(AST_DEREF, prs->cur_scope, prs->cur_func, ln, col);
         expr[0]->deref.name = strdup(name);
@@ -823,8 +1193,7 @@ AST *prs_id_quick_math(Prs *prs, char *name, size_t ln, size_t col, bool is_dere
         type = TOK_SLASH;
     else {
         if (strcmp(sym->assign.type, "float") == 0) {
-            fprintf(stderr, "%s:%zu:%zu: error: modulus operator used where a float result may occur; consider using casts\n", prs->file, ln, col);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: modulus operator used where a float result may occur; consider using casts\n", prs->file, ln, col);
         }
 
         type = TOK_PERCENT;
@@ -833,24 +1202,12 @@ AST *prs_id_quick_math(Prs *prs, char *name, size_t ln, size_t col, bool is_dere
     expr[1]->oper.kind = type;
     prs_eat(prs, prs->tok->type);
     expr[2] = prs_value(prs, sym->assign.type);
+    prs_hreduce_check(prs, expr[2]);
 
-    AST *value = ast_init(AST_MATH, prs->cur_scope, prs->cur_func, ln, col);
-    value->math.expr = expr;
-    value->math.expr_cnt = 3;
-
-    AST *ast;
-
-    if (is_deref) {
-        ast = ast_init(AST_DEREF, prs->cur_scope, prs->cur_func, ln, col);
-        ast->deref.name = name;
-        ast->deref.value = value;
-    } else {
-        ast = ast_init(AST_ASSIGN, prs->cur_scope, prs->cur_func, ln, col);
-        ast->assign.name = name;
-        ast->assign.type = NULL;
-        ast->assign.rbp = NULL;
-        ast->assign.value = value;
-    }
+    if (!is_deref)
+        prs_vec_check(prs, value, sym->assign.type);
+    else
+        prs_vec_check(prs, expr[2], NULL);
 
     return ast;
 }
@@ -860,97 +1217,76 @@ AST *prs_id_while(Prs *prs, char *id, size_t ln, size_t col) {
     free(id);
 
     AST *ast = ast_init(AST_WHILE, prs->cur_scope, prs->cur_func, ln, col);
-    char *old_scope = strdup(prs->cur_scope);
-
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(prs->cur_scope) + 64) * sizeof(char));
-    sprintf(prs->cur_scope, "%s-while:%zu:%zu", old_scope, prs->tok->ln, prs->tok->col);
+    ast->while_.do_first = do_first;
+    size_t old_len = strlen(prs->cur_scope);
 
-    AST **body;
-    size_t body_cnt;
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 64) * sizeof(char));
+    sprintf(prs->cur_scope + old_len, "-while:%zu:%zu", prs->tok->ln, prs->tok->col);
 
     if (do_first) {
-        body = prs_body(prs, &body_cnt, true);
+        prs_body(prs, &ast->while_.body, &ast->while_.body_cnt, true);
 
         if (prs->tok->type != TOK_ID) {
-            fprintf(stderr, "%s:%zu:%zu: error: expected identifier 'while' following 'do' statement but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: expected identifier 'while' following 'do' statement but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
         } else if (strcmp(prs->tok->value, "while") != 0) {
-            fprintf(stderr, "%s:%zu:%zu: error: expected identifier 'while' following 'do' statement but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, prs->tok->value);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: expected identifier 'while' following 'do' statement but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, prs->tok->value);
         }
 
         prs_eat(prs, TOK_ID);
-        ast->while_.exprs = prs_cond(prs, &ast->while_.exprs_cnt, false);
+        prs_cond(prs, &ast->while_.exprs, &ast->while_.exprs_cnt, false);
         prs_eat(prs, TOK_SEMI);
     } else {
-        ast->while_.exprs = prs_cond(prs, &ast->while_.exprs_cnt, false);
-        body = prs_body(prs, &body_cnt, true);
+        prs_cond(prs, &ast->while_.exprs, &ast->while_.exprs_cnt, false);
+        prs_body(prs, &ast->while_.body, &ast->while_.body_cnt, true);
     }
     
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(old_scope) + 1) * sizeof(char));
-    strcpy(prs->cur_scope, old_scope);
-    free(old_scope);
-
-    ast->while_.body = body;
-    ast->while_.body_cnt = body_cnt;
-    ast->while_.do_first = do_first;
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 1) * sizeof(char));
+    prs->cur_scope[old_len] = '\0';
     return ast;
 }
 
 AST *prs_id_for(Prs *prs, size_t ln, size_t col) {
-    char *old_scope = strdup(prs->cur_scope);
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(prs->cur_scope) + 64) * sizeof(char));
-    sprintf(prs->cur_scope, "%s-for:%zu:%zu", old_scope, prs->tok->ln, prs->tok->col);
+    AST *ast = ast_init(AST_FOR, prs->cur_scope, prs->cur_func, ln, col);
+    size_t old_len = strlen(prs->cur_scope);
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 64) * sizeof(char));
+    sprintf(prs->cur_scope + old_len, "-for:%zu:%zu", prs->tok->ln, prs->tok->col);
 
     prs_eat(prs, TOK_LPAREN);
 
-    AST *init = prs_stmt(prs);
+    AST *init = ast->for_.init = prs_stmt(prs);
     if (init->type != AST_ASSIGN) {
-        fprintf(stderr, "%s:%zu:%zu: error: expected assignment in for loop but found '%s'\n", prs->file, init->ln, init->col, ast_types[init->type]);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: expected assignment in for loop but found '%s'\n", prs->file, init->ln, init->col, ast_types[init->type]);
     }
 
     prs_eat(prs, TOK_SEMI);
-
-    size_t cond_cnt;
-    AST **cond = prs_cond(prs, &cond_cnt, true);
-
+    prs_cond(prs, &ast->for_.cond, &ast->for_.cond_cnt, true);
     prs_eat(prs, TOK_SEMI);
 
-    AST *math = prs_stmt(prs);
+    AST *math = ast->for_.math = prs_stmt(prs);
     if (math->type != AST_ASSIGN) {
-        fprintf(stderr, "%s:%zu:%zu: error: expected assignment in for loop but found '%s'\n", prs->file, math->ln, math->col, ast_types[math->type]);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: expected assignment in for loop but found '%s'\n", prs->file, math->ln, math->col, ast_types[math->type]);
     }
 
     prs_eat(prs, TOK_RPAREN);
+    prs_body(prs, &ast->for_.body, &ast->for_.body_cnt, true);
 
-    size_t body_cnt;
-    AST **body = prs_body(prs, &body_cnt, true);
-
-    prs->cur_scope = realloc(prs->cur_scope, (strlen(old_scope) + 1) * sizeof(char));
-    strcpy(prs->cur_scope, old_scope);
-    free(old_scope);
-
-    AST *ast = ast_init(AST_FOR, prs->cur_scope, prs->cur_func, ln, col);
-    ast->for_.init = init;
-    ast->for_.cond = cond;
-    ast->for_.cond_cnt = cond_cnt;
-    ast->for_.math = math;
-    ast->for_.body = body;
-    ast->for_.body_cnt = body_cnt;
+    prs->cur_scope = realloc(prs->cur_scope, (old_len + 1) * sizeof(char));
+    prs->cur_scope[old_len] = '\0';
     return ast;
 }
 
 AST *prs_id_subscr(Prs *prs, char *name, size_t ln, size_t col) {
+    AST *ast = ast_init(AST_SUBSCR, prs->cur_scope, prs->cur_func, ln, col);
+    ast->subscr.name = name;
+
     AST *sym = sym_find(AST_ASSIGN, prs->cur_scope, name);
     if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
     }
 
     prs_eat(prs, TOK_LSQUARE);
-    AST *index = prs_value(prs, NULL);
+    AST *index = ast->subscr.index = prs_value(prs, NULL);
+    prs_vec_check(prs, index, NULL);
 
     switch (index->type) {
         case AST_INT:
@@ -959,40 +1295,66 @@ AST *prs_id_subscr(Prs *prs, char *name, size_t ln, size_t col) {
         case AST_MATH:
         case AST_SUBSCR: break;
         default:
-            fprintf(stderr, "%s:%zu:%zu: error: invalid array index of type '%s'\n", prs->file, index->ln, index->col, ast_types[index->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid array index of type '%s'\n", prs->file, index->ln, index->col, ast_types[index->type]);
     }
 
     prs_eat(prs, TOK_RSQUARE);
 
-    AST *ast = ast_init(AST_SUBSCR, prs->cur_scope, prs->cur_func, ln, col);
-    ast->subscr.name = name;
-    ast->subscr.index = index;
-
     if (prs->tok->type == TOK_EQUAL) {
         if (!sym->assign.mut) {
-            fprintf(stderr, "%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
         }
 
-        char *base_type = strdup(sym->assign.type);
+        char base_type[strlen(sym->assign.type) + 1];
+        strcpy(base_type, sym->assign.type);
         base_type[strlen(base_type) - 1] = '\0';
 
         prs_eat(prs, TOK_EQUAL);
         ast->subscr.value = prs_value(prs, base_type);
-        free(base_type);
+
+        // Storing a vector into an array writes one element per lane
+        char *vec_type = ast_vec_type(ast->subscr.value);
+
+        if (vec_type != NULL && !is_vec_type(sym->assign.type) && strncmp(vec_type, base_type, strlen(base_type)) == 0 && strlen(vec_type) == strlen(base_type) + 1)
+            prs_vec_value(prs, ast->subscr.value, vec_type, false);
+        else
+            prs_vec_check(prs, ast->subscr.value, base_type);
+
     } else
         ast->subscr.value = NULL;
 
     return ast;
 }
 
+// Horizontal reductions of a vector to a scalar: hsum(v), hmin(v) and hmax(v)
+AST *prs_id_hreduce(Prs *prs, char *name, size_t ln, size_t col) {
+    AST *ast = ast_init(AST_HREDUCE, prs->cur_scope, prs->cur_func, ln, col);
+    ast->hreduce.name = name;
+
+    prs_eat(prs, TOK_LPAREN);
+    AST *value = ast->hreduce.value = prs_value(prs, NULL);
+    prs_eat(prs, TOK_RPAREN);
+
+    char *type = ast_vec_type(value);
+
+    if (type == NULL) {
+        fatal("%s:%zu:%zu: error: expected a vector value in call to '%s'\n", prs->file, ln, col, name);
+    } else if (strcmp(name, "hsum") != 0 && type[0] == 'i' && march < ARCH_SSE4_1) {
+        fatal("%s:%zu:%zu: error: '%s' of vector type '%s' requires -march=sse4.1 or later\n", prs->file, ln, col, name, type);
+    }
+
+    prs_vec_value(prs, value, type, false);
+    return ast;
+}
+
 AST *prs_data(Prs *prs);
 
 AST *prs_id(Prs *prs) {
     size_t ln = prs->tok->ln;
     size_t col = prs->tok->col;
     bool mut = false;
+    bool ext = false;
+    bool exported = false;
 
     char *id = strdup(prs->tok->value);
 
@@ -1026,11 +1388,27 @@ AST *prs_id(Prs *prs) {
         id = realloc(id, (strlen(prs->tok->value) + 1) * sizeof(char));
         strcpy(id, prs->tok->value);
         mut = true;
+    } else if (strcmp(id, "extern") == 0 || strcmp(id, "export") == 0) {
+        if (strcmp(prs->cur_func, "<global>") != 0) {
+            fatal("%s:%zu:%zu: error: %s declaration inside function '%s'\n", prs->file, ln, col, id, prs->cur_func);
+        }
+
+        ext = strcmp(id, "extern") == 0;
+        exported = !ext;
+        prs_eat(prs, TOK_ID);
+        id = realloc(id, (strlen(prs->tok->value) + 1) * sizeof(char));
+        strcpy(id, prs->tok->value);
     }
 
     if (is_type(id)) {
         prs_eat(prs, TOK_ID);
 
+        if (is_vec_type(id) && vec_lanes(id) == 8 && march < ARCH_AVX2) {
+            fatal("%s:%zu:%zu: error: vector type '%s' requires -march=avx2\n", prs->file, ln, col, id);
+        } else if (is_vec_type(id) && prs->tok->type == TOK_STAR) {
+            fatal("%s:%zu:%zu: error: pointers to vector type '%s' are not supported\n", prs->file, ln, col, id);
+        }
+
         while (prs->tok->type == TOK_STAR) {
             id = realloc(id, (strlen(id) + 2) * sizeof(char));
             strcat(id, "*");
@@ -1040,15 +1418,21 @@ AST *prs_id(Prs *prs) {
         char *name = strdup(prs->tok->value);
         prs_eat(prs, TOK_ID);
 
-        if (prs->tok->type == TOK_LPAREN)
-            return prs_id_func(prs, name, id, ln, col);
+        if (prs->tok->type == TOK_LPAREN && is_vec_type(id)) {
+            fatal("%s:%zu:%zu: error: function '%s' can't have vector type '%s'\n", prs->file, ln, col, name, id);
+        } else if (prs->tok->type == TOK_LPAREN)
+            return prs_id_func(prs, name, id, ext, exported, ln, col);
+        else if (ext || exported) {
+            fatal("%s:%zu:%zu: error: expected function declaration following '%s'\n", prs->file, ln, col, ext ? "extern" : "export");
+        }
 
         return prs_id_assign(prs, name, id, mut, ln, col);
     }
 
     if (mut) {
-        fprintf(stderr, "%s:%zu:%zu: error: expected variable declaration following 'mut'\n", prs->file, ln, col);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: expected variable declaration following 'mut'\n", prs->file, ln, col);
+    } else if (ext || exported) {
+        fatal("%s:%zu:%zu: error: expected function declaration following '%s'\n", prs->file, ln, col, ext ? "extern" : "export");
     }
 
     prs_eat(prs, TOK_ID);
@@ -1066,24 +1450,28 @@ AST *prs_id(Prs *prs) {
         return prs_id_for(prs, ln, col);
     } else if (prs->tok->type == TOK_EQUAL)
         return prs_id_assign(prs, id, NULL, mut, ln, col);
+    else if (prs->tok->type == TOK_LPAREN && (strcmp(id, "hsum") == 0 || strcmp(id, "hmin") == 0 || strcmp(id, "hmax") == 0)
+             && sym_find(AST_FUNC, "<global>", id) == NULL) // A function of the same name hides the builtin
+        return prs_id_hreduce(prs, id, ln, col);
     else if (prs->tok->type == TOK_LPAREN)
         return prs_id_call(prs, id, ln, col);
     else if (prs->tok->type == TOK_PLUS_EQ || prs->tok->type == TOK_MINUS_EQ || prs->tok->type == TOK_STAR_EQ || prs->tok->type == TOK_SLASH_EQ || prs->tok->type == TOK_PERCENT_EQ)
         return prs_id_quick_math(prs, id, ln, col, false);
     else if (prs->tok->type == TOK_LSQUARE)
         return prs_id_subscr(prs, id, ln, col);
-    else if (sym_find(AST_ASSIGN, prs->cur_scope, id) != NULL) {
-        AST *ast = ast_init(AST_VAR, prs->cur_scope, prs->cur_func, ln, col);
-        ast->var.name = id;
-        return ast;
-    }
 
+    // Made before knowing it's a variable, so the error frees the name with it
+    AST *ast = ast_init(AST_VAR, prs->cur_scope, prs->cur_func, ln, col);
+    ast->var.name = id;
+
+    if (sym_find(AST_ASSIGN, prs->cur_scope, id) != NULL)
+        return ast;
 
-    fprintf(stderr, "%s:%zu:%zu: error: unknown identifier '%s'\n", prs->file, ln, col, id);
-    exit(EXIT_FAILURE);
+    fatal("%s:%zu:%zu: error: unknown identifier '%s'\n", prs->file, ln, col, id);
 }
 
-AST *prs_data(Prs *prs) {
+// The literal of the current token, which isn't eaten
+AST *prs_lit(Prs *prs) {
     AST *ast;
     
     if (prs->tok->type == TOK_STR) {
@@ -1095,34 +1483,36 @@ AST *prs_data(Prs *prs) {
         ast->data.digit = strtold(prs->tok->value, &endptr);
 
         if (endptr == prs->tok->value || errno == ERANGE) {
-            fprintf(stderr, "%s:%zu:%zu: error: digit conversion failed: %s\n", prs->file, prs->tok->ln, prs->tok->col, strerror(errno));
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: digit conversion failed: %s\n", prs->file, prs->tok->ln, prs->tok->col, strerror(errno));
         }
     }
 
+    return ast;
+}
+
+AST *prs_data(Prs *prs) {
+    AST *ast = prs_lit(prs);
     prs_eat(prs, prs->tok->type);
     return ast;
 }
 
 AST *prs_arr_lst(Prs *prs) {
     AST *ast = ast_init(AST_ARR_LST, prs->cur_scope, prs->cur_func, prs->tok->ln, prs->tok->col);
-    AST **items = calloc(1, sizeof(AST *));
-    size_t items_cnt = 0;
+    AST *item;
+    ast->arr_lst.items = calloc(1, sizeof(AST *));
     prs_eat(prs, TOK_LBRACE);
 
     while (prs->tok->type != TOK_RBRACE && prs->tok->type != TOK_EOF) {
-        if (items_cnt > 0)
+        if (ast->arr_lst.items_cnt > 0)
             prs_eat(prs, TOK_COMMA);
 
-        items = realloc(items, (items_cnt + 1) * sizeof(AST *));
-        items[items_cnt++] = prs_value(prs, NULL);
+        item = prs_value(prs, NULL);
+        ast->arr_lst.items = realloc(ast->arr_lst.items, (ast->arr_lst.items_cnt + 1) * sizeof(AST *));
+        ast->arr_lst.items[ast->arr_lst.items_cnt++] = item;
         // TODO: probably check for pointers here
     }
 
     prs_eat(prs, TOK_RBRACE);
-
-    ast->arr_lst.items = items;
-    ast->arr_lst.items_cnt = items_cnt;
     return ast;
 }
 
@@ -1131,39 +1521,39 @@ AST *prs_deref(Prs *prs) {
     size_t col = prs->tok->col;
     prs_eat(prs, TOK_STAR);
 
-    char *name = strdup(prs->tok->value);
+    AST *ast = ast_init(AST_DEREF, prs->cur_scope, prs->cur_func, ln, col);
+    char *name = ast->deref.name = strdup(prs->tok->value);
     prs_eat(prs, TOK_ID);
 
     AST *sym = sym_find(AST_ASSIGN, prs->cur_scope, name);
     if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
     } else if (strchr(sym->assign.type, '*') == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: dereferencing non pointer variable '%s' of type '%s'\n", prs->file, ln, col, name, sym->assign.type);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: dereferencing non pointer variable '%s' of type '%s'\n", prs->file, ln, col, name, sym->assign.type);
     }
 
-    if (prs->tok->type == TOK_PLUS_EQ || prs->tok->type == TOK_MINUS_EQ || prs->tok->type == TOK_STAR_EQ || prs->tok->type == TOK_SLASH_EQ || prs->tok->type == TOK_PERCENT_EQ)
+    if (prs->tok->type == TOK_PLUS_EQ || prs->tok->type == TOK_MINUS_EQ || prs->tok->type == TOK_STAR_EQ || prs->tok->type == TOK_SLASH_EQ || prs->tok->type == TOK_PERCENT_EQ) {
+        // It makes a node of its own, holding the name
+        ast->deref.name = NULL;
+        ast_del(ast);
         return prs_id_quick_math(prs, name, ln, col, true);
-
-    AST *ast = ast_init(AST_DEREF, prs->cur_scope, prs->cur_func, ln, col);
-    ast->deref.name = name;
+    }
 
     AST *value = NULL;
 
     if (prs->tok->type == TOK_EQUAL) {
         if (!sym->assign.mut) {
-            fprintf(stderr, "%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: reassigning immutable variable '%s'\n", prs->file, ln, col, name);
         }
 
         prs_eat(prs, TOK_EQUAL);
 
-        char *base_type = strdup(sym->assign.type);
+        char base_type[strlen(sym->assign.type) + 1];
+        strcpy(base_type, sym->assign.type);
         base_type[strlen(base_type) - 1] = '\0';
 
         value = prs_value(prs, base_type);
-        free(base_type);
+        prs_vec_check(prs, value, base_type);
     }
 
     ast->deref.value = value;
@@ -1175,20 +1565,34 @@ AST *prs_amp(Prs *prs) {
     size_t col = prs->tok->col;
     prs_eat(prs, TOK_AMP);
 
-    char *name = strdup(prs->tok->value);
+    AST *ast = ast_init(AST_REF, prs->cur_scope, prs->cur_func, ln, col);
+    ast->ref.name = strdup(prs->tok->value);
     prs_eat(prs, TOK_ID);
 
-    AST *sym = sym_find(AST_ASSIGN, prs->cur_scope, name);
-    if (sym == NULL) {
-        fprintf(stderr, "%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, name);
-        exit(EXIT_FAILURE);
+    if (sym_find(AST_ASSIGN, prs->cur_scope, ast->ref.name) == NULL) {
+        fatal("%s:%zu:%zu: error: undefined variable '%s'\n", prs->file, ln, col, ast->ref.name);
     }
 
-    AST *ast = ast_init(AST_REF, prs->cur_scope, prs->cur_func, ln, col);
-    ast->ref.name = name;
     return ast;
 }
 
+// Relative to the working directory, or else to the including file
+char *prs_include_path(Prs *prs) {
+    FILE *check = fopen(prs->tok->value, "r");
+    char *path = strdup(prs->tok->value);
+    char *dir_end = strrchr(prs->file, '/');
+
+    if (check == NULL && dir_end != NULL) {
+        size_t dir_len = dir_end - prs->file + 1;
+        path = realloc(path, (dir_len + strlen(prs->tok->value) + 1) * sizeof(char));
+        memcpy(path, prs->file, dir_len);
+        strcpy(path + dir_len, prs->tok->value);
+    } else if (check != NULL)
+        fclose(check);
+
+    return path;
+}
+
 void prs_preproc(Prs *prs) {
     size_t ln = prs->tok->ln;
     size_t col = prs->tok->col;
@@ -1198,8 +1602,7 @@ void prs_preproc(Prs *prs) {
         prs_eat(prs, TOK_ID);
 
         if (prs->tok->type != TOK_STR) {
-            fprintf(stderr, "%s:%zu:%zu: error: expected filename string to include but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: expected filename string to include but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
         }
 
         if (is_included(prs->tok->value)) {
@@ -1207,53 +1610,16 @@ void prs_preproc(Prs *prs) {
             return;
         }
 
-        FILE *check = fopen(prs->tok->value, "r");
-        char *path = strdup(prs->tok->value);
+        char *path = prs_include_path(prs);
 
-        if (check == NULL && strchr(prs->file, '/') != NULL) {
-            char *cpy = strdup(prs->file);
-            strcpy(path, "\0");
-            char *tok = strtok(cpy, "/");
+        // The included file is read by its own lexer until it ends, then this one carries on
+        prs->incs = realloc(prs->incs, (prs->incs_cnt + 1) * sizeof(Inc));
+        prs->incs[prs->incs_cnt++] = (Inc){ prs->lex, prs->conds_cnt };
+        prs->lex = lex_init(path);
+        prs->file = path;
 
-            while (tok != NULL && strstr(tok, ".sc") == NULL) {
-                path = realloc(path, (strlen(path) + strlen(tok) + 2) * sizeof(char));
-                strcat(path, tok);
-                strcat(path, "/");
-                tok = strtok(NULL, "/");
-            }
-
-            free(cpy);
-            path = realloc(path, (strlen(path) + strlen(prs->tok->value) + 1) * sizeof(char));
-            strcat(path, prs->tok->value);
-        } else if (check != NULL)
-            fclose(check);
-
-        char *to_inc = read_file(path);
-        free(path);
-
-        Lex *lex = prs->lex;
-        char *new = calloc(lex->pos + strlen(to_inc) + 2, sizeof(char));
-        
-        size_t i = 0;
-        for (i = 0; i < lex->pos + 1; i++)
-            new[i] = lex->src[i];
-
-        char *other = calloc(lex->src_len - lex->pos + 1, sizeof(char));
-        size_t j = 0;
-
-        for (i = i; i < lex->src_len; i++)
-            other[j++] = lex->src[i];
-        
-        strcat(new, to_inc);
-        free(to_inc);
-
-        new = realloc(new, (strlen(new) + strlen(other) + 1) * sizeof(char));
-        strcat(new, other);
-        free(other);
-
-        free(lex->src);
-        lex->src = new;
-        lex->src_len = strlen(new);
+        if (module_cache != NULL || track_deps)
+            module_dep(path, prs->lex);
 
         included = realloc(included, (included_cnt + 1) * sizeof(char *));
         included[included_cnt++] = strdup(prs->tok->value);
@@ -1262,8 +1628,7 @@ void prs_preproc(Prs *prs) {
         prs_eat(prs, TOK_ID);
 
         if (is_constant(prs->tok->value)) {
-            fprintf(stderr, "%s:%zu:%zu: error: redefinition of constant '%s'\n", prs->file, ln, col, prs->tok->value);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: redefinition of constant '%s'\n", prs->file, ln, col, prs->tok->value);
         }
 
         Const *cons = malloc(sizeof(Const));
@@ -1271,20 +1636,19 @@ void prs_preproc(Prs *prs) {
         prs_eat(prs, TOK_ID);
 
         if (prs->tok->type != TOK_INT && prs->tok->type != TOK_FLOAT && prs->tok->type != TOK_STR) {
-            fprintf(stderr, "%s:%zu:%zu: error: invalid constant value '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid constant value '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
         }
 
-        cons->value = prs_data(prs);
-
+        // Defined before the next token is read, it may be an #if testing it
+        cons->value = prs_lit(prs);
         constants = realloc(constants, (constants_cnt + 1) * sizeof(Const *));
         constants[constants_cnt++] = cons;
+        prs_eat(prs, prs->tok->type);
     } else if (strcmp(prs->tok->value, "alias") == 0) {
         prs_eat(prs, TOK_ID);
 
         if (is_alias(prs->tok->value)) {
-            fprintf(stderr, "%s:%zu:%zu: error: redefinition of alias '%s'\n", prs->file, ln, col, prs->tok->value);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: redefinition of alias '%s'\n", prs->file, ln, col, prs->tok->value);
         }
 
         Alias *alias = malloc(sizeof(Alias));
@@ -1297,8 +1661,7 @@ void prs_preproc(Prs *prs) {
         aliases = realloc(aliases, (aliases_cnt + 1) * sizeof(Alias *));
         aliases[aliases_cnt++] = alias;
     } else {
-        fprintf(stderr, "%s:%zu:%zu: error: unknown preprocess '%s'\n", prs->file, ln, col, prs->tok->value);
-        exit(EXIT_FAILURE);
+        fatal("%s:%zu:%zu: error: unknown preprocess '%s'\n", prs->file, ln, col, prs->tok->value);
     }
 }
 
@@ -1335,52 +1698,159 @@ AST *prs_stmt(Prs *prs) {
             return prs_stmt(prs);
         case TOK_LPAREN: return prs_expr(prs);
         default:
-            fprintf(stderr, "%s:%zu:%zu: error: invalid statement '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid statement '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
     }
 }
 
-AST *prs_file(char *file) {
-    Prs *prs = prs_init(file);
-    AST **asts = calloc(1, sizeof(AST *));
-    size_t asts_cnt = 0;
-    AST *stmt;
+void prs_top(Prs *prs, AST ***asts, size_t *asts_cnt);
 
-    sym_tab = calloc(1, sizeof(AST *));
-    included = calloc(1, sizeof(Const *));
-    aliases = calloc(1, sizeof(Alias *));
+// A top level #include, loaded from the module cache or else parsed on its own and saved there
+void prs_module(Prs *prs, AST ***asts, size_t *asts_cnt) {
+    prs_eat(prs, TOK_HASH);
+    prs_eat(prs, TOK_ID);
+
+    if (prs->tok->type != TOK_STR) {
+        fatal("%s:%zu:%zu: error: expected filename string to include but found '%s'\n", prs->file, prs->tok->ln, prs->tok->col, tok_types[prs->tok->type]);
+    } else if (is_included(prs->tok->value)) {
+        prs_eat(prs, TOK_STR);
+        return;
+    }
+
+    char *path = prs_include_path(prs);
+    Lex *lex = lex_init(path);
+    uint64_t key = module_key(module_dep(path, lex));
+    lex_del(lex);
+
+    size_t asts_beg = *asts_cnt;
+    size_t constants_beg = constants_cnt;
+    size_t aliases_beg = aliases_cnt;
+
+    included = realloc(included, (included_cnt + 1) * sizeof(char *));
+    included[included_cnt++] = strdup(prs->tok->value);
+    size_t included_beg = included_cnt;
+
+    if (!module_load(key, asts, asts_cnt)) {
+        size_t mark = module_mark();
+        Prs *mod = prs_init(path, lex_init(path));
+        prs_top(mod, asts, asts_cnt);
+        prs_del(mod);
+        module_save(key, mark, *asts + asts_beg, *asts_cnt - asts_beg, constants_beg, aliases_beg, included_beg);
+    }
+
+    free(path);
+
+    // Only now, the token after it may be an #if testing what it defined
+    prs_eat(prs, TOK_STR);
+}
+
+void prs_top(Prs *prs, AST ***asts, size_t *asts_cnt) {
+    AST *stmt;
 
     while (prs->tok->type != TOK_EOF) {
+        if (module_cache != NULL && prs->tok->type == TOK_HASH && lex_at(prs->lex, "include")) {
+            prs_module(prs, asts, asts_cnt);
+            continue;
+        } else if (prs->tok->type == TOK_HASH) {
+            // Nothing has to follow a directive, it may end the file
+            prs_preproc(prs);
+            continue;
+        }
+
         stmt = prs_stmt(prs);
         if (stmt->type != AST_FUNC && stmt->type != AST_ASSIGN) {
-            fprintf(stderr, "%s:%zu:%zu: error: invalid statement '%s' outside of a function\n", prs->file, stmt->ln, stmt->col, ast_types[stmt->type]);
-            exit(EXIT_FAILURE);
+            fatal("%s:%zu:%zu: error: invalid statement '%s' outside of a function\n", prs->file, stmt->ln, stmt->col, ast_types[stmt->type]);
         } else if (stmt->type == AST_ASSIGN) {
             if (stmt->assign.type == NULL) {
-                fprintf(stderr, "%s:%zu:%zu: error: assigning variable '%s' outside of a function\n", prs->file, stmt->ln, stmt->col, stmt->assign.name);
-                exit(EXIT_FAILURE);
+                fatal("%s:%zu:%zu: error: assigning variable '%s' outside of a function\n", prs->file, stmt->ln, stmt->col, stmt->assign.name);
             }
 
             prs_eat(prs, TOK_SEMI);
         }
 
-        asts = realloc(asts, (asts_cnt + 1) * sizeof(AST *));
-        asts[asts_cnt++] = stmt;
+        *asts = realloc(*asts, (*asts_cnt + 1) * sizeof(AST *));
+        (*asts)[(*asts_cnt)++] = stmt;
     }
+}
 
-    if (sym_find(AST_FUNC, "<global>", "main") == NULL) {
-        fprintf(stderr, "%s: error: missing entrypoint 'main'\n", prs->file);
-        exit(EXIT_FAILURE);
-    }
+// Parses the program lex reads from file
+AST *prs_lex(char *file, Lex *lex) {
+    AST *root = ast_init(AST_ROOT, "<internal>", "<internal>", 0, 0);
+    root->root.asts = calloc(1, sizeof(AST *));
+    root->root.asts_cnt = 0;
+
+    sym_tab = calloc(1, sizeof(AST *));
+    included = calloc(1, sizeof(Const *));
+    aliases = calloc(1, sizeof(Alias *));
+    included_cnt = aliases_cnt = 0;
+
+    Prs *prs = prs_init(file, lex);
+    parsing = prs;
+    parsed = root;
+    ast_track();
+    prs_top(prs, &root->root.asts, &root->root.asts_cnt);
+
+    if (require_main && sym_find(AST_FUNC, "<global>", "main") == NULL)
+        fatal("%s: error: missing entrypoint 'main'\n", prs->file);
 
     prs_del(prs);
+    ast_untrack();
+    parsing = NULL;
+    parsed = NULL;
 
     for (size_t i = 0; i < included_cnt; i++)
         free(included[i]);
     free(included);
-
-    AST *root = ast_init(AST_ROOT, "<internal>", "<internal>", 0, 0);
-    root->root.asts = asts;
-    root->root.asts_cnt = asts_cnt;
+    included = NULL;
+    included_cnt = 0;
+    module_reset();
     return root;
 }
+
+AST *prs_file(char *file) {
+    return prs_lex(file, lex_init(file));
+}
+
+// Frees the parser, symbols, constants and aliases left behind by a compilation that failed
+void prs_reset(void) {
+    if (parsing != NULL) {
+        while (parsing->incs_cnt > 0) {
+            free(parsing->lex->file);
+            lex_del(parsing->lex);
+            parsing->lex = parsing->incs[--parsing->incs_cnt].lex;
+        }
+
+        prs_del(parsing);
+        ast_del(parsed);
+        parsing = NULL;
+        parsed = NULL;
+    }
+
+    for (size_t i = 0; i < included_cnt; i++)
+        free(included[i]);
+
+    for (size_t i = 0; i < constants_cnt; i++) {
+        ast_del(constants[i]->value);
+        free(constants[i]->name);
+        free(constants[i]);
+    }
+
+    for (size_t i = 0; i < aliases_cnt; i++) {
+        free(aliases[i]->name);
+        free(aliases[i]->value);
+        free(aliases[i]);
+    }
+
+    // What's left is the statement being parsed, held by no tree yet
+    ast_tracked_del();
+
+    free(included);
+    free(sym_tab);
+    free(constants);
+    free(aliases);
+    included = NULL;
+    sym_tab = NULL;
+    constants = NULL;
+    aliases = NULL;
+    included_cnt = sym_cnt = constants_cnt = aliases_cnt = 0;
+    module_reset();
+}
@@ -4,8 +4,22 @@
 #include "token.h"
 #include "lexer.h"
 #include "ast.h"
+#include "state.h"
 #include <stdbool.h>
 
+typedef struct {
+    size_t ln;
+    size_t col;
+    bool taken;
+    bool has_else;
+} PreCond;
+
+// A file suspended while a file it includes is read
+typedef struct {
+    Lex *lex;
+    size_t conds_cnt;
+} Inc;
+
 typedef struct {
     char *file;
     char *cur_scope;
@@ -13,6 +27,10 @@ typedef struct {
     Lex *lex;
     Tok *tok;
     bool in_math;
+    PreCond *conds;
+    size_t conds_cnt;
+    Inc *incs;
+    size_t incs_cnt;
 } Prs;
 
 typedef struct {
@@ -25,8 +43,18 @@ typedef struct {
     char *value;
 } Alias;
 
+extern THREAD_LOCAL bool require_main;
+
 AST *sym_find(ASTType type, char *scope, char *name);
+void sym_append(AST *sym);
+void sym_remove(AST *sym);
+bool is_vec_type(char *id);
+size_t vec_lanes(char *type);
+char *ast_vec_type(AST *ast);
+bool ast_is_float(AST *ast);
 AST *prs_stmt(Prs *prs);
+AST *prs_lex(char *file, Lex *lex);
 AST *prs_file(char *file);
+void prs_reset(void);
 
 #endif
\ No newline at end of file
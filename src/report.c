@@ -0,0 +1,253 @@
+#include "report.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+/* Phases nest, parsing reads and lexes the files it includes, so the time,
+ * allocations and peak resident size between two pushes or pops are charged
+ * to the innermost phase only and the phases add up to the whole. The peak
+ * is lowered to the current size at each push and pop to measure the next
+ * stretch on its own, but not for lexing, as that would cost more than the
+ * lexing does. The time of commands run
+ * for a phase, nasm and the linker, is charged to it as CPU time too. With
+ * -ftime-trace every phase but lexing, which happens once per token, is
+ * also kept as an event for chrome://tracing or Perfetto. */
+
+typedef struct {
+    size_t cnt;
+    double wall;
+    double cpu;
+    size_t allocs;
+    size_t bytes;
+    long peak_kb;
+} PhaseStat;
+
+const char *phase_names[PHASE_CNT] = {
+    "read file",
+    "lex",
+    "parse",
+    "optimize",
+    "emit",
+    "write file",
+    "assemble",
+    "link"
+};
+
+THREAD_LOCAL bool time_report = false;
+THREAD_LOCAL bool mem_report = false;
+THREAD_LOCAL bool time_trace = false;
+
+THREAD_LOCAL PhaseStat phase_stats[PHASE_CNT];
+THREAD_LOCAL Phase phase_stack[PHASE_CNT];
+THREAD_LOCAL double phase_starts[PHASE_CNT];
+THREAD_LOCAL size_t phase_depth = 0;
+THREAD_LOCAL double wall_mark;
+THREAD_LOCAL double cpu_mark;
+THREAD_LOCAL double trace_origin = -1.0;
+THREAD_LOCAL char *trace;
+THREAD_LOCAL size_t trace_len = 0;
+THREAD_LOCAL size_t trace_cap = 0;
+THREAD_LOCAL long peak_seen = 0;
+
+double clock_secs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// This thread's CPU time and that of every command waited for
+double cpu_secs(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    return clock_secs(CLOCK_THREAD_CPUTIME_ID)
+        + usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+        + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// Unlike ru_maxrss, it doesn't carry over what the parent used before exec
+long peak_kb(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+        return peak_seen;
+
+    char line[256];
+
+    // The kernel only updates it now and then, so it can read lower than before
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "VmHWM:", 6) == 0 && atol(line + 6) > peak_seen)
+            peak_seen = atol(line + 6);
+    }
+
+    fclose(f);
+    return peak_seen;
+}
+
+// Charges the peak since the last push or pop to stat, if any, and lowers it to the current size
+void peak_charge(PhaseStat *stat) {
+    long kb = peak_kb();
+
+    if (stat != NULL && kb > stat->peak_kb)
+        stat->peak_kb = kb;
+
+    // Without it, each peak is the process's so far
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f == NULL)
+        return;
+
+    fputs("5", f);
+    fclose(f);
+    peak_seen = 0;
+}
+
+// Charges the time since the last push or pop to the innermost phase
+void phase_charge(void) {
+    double wall = clock_secs(CLOCK_MONOTONIC);
+    double cpu = cpu_secs();
+
+    if (phase_depth > 0) {
+        PhaseStat *stat = &phase_stats[phase_stack[phase_depth - 1]];
+        stat->wall += wall - wall_mark;
+        stat->cpu += cpu - cpu_mark;
+    }
+
+    wall_mark = wall;
+    cpu_mark = cpu;
+}
+
+void phase_push(Phase phase) {
+    if ((!time_report && !mem_report && !time_trace) || phase_depth == PHASE_CNT)
+        return;
+
+    phase_charge();
+
+    if (trace_origin < 0.0)
+        trace_origin = wall_mark;
+
+    if (mem_report && phase != PHASE_LEX)
+        peak_charge(phase_depth > 0 ? &phase_stats[phase_stack[phase_depth - 1]] : NULL);
+
+    phase_stack[phase_depth] = phase;
+    phase_starts[phase_depth++] = wall_mark;
+    phase_stats[phase].cnt++;
+}
+
+void trace_add(Phase phase, double start, double end) {
+    char event[256];
+    int len = sprintf(event, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":%d,\"tid\":0}",
+                      trace_len > 0 ? ",\n" : "", phase_names[phase],
+                      (start - trace_origin) * 1e6, (end - start) * 1e6, (int)getpid());
+
+    // Grown by doubling, a trace has as many events as there are includes
+    if (trace_len + len + 1 > trace_cap) {
+        trace_cap = (trace_len + len + 1) * 2;
+        trace = realloc(trace, trace_cap * sizeof(char));
+    }
+
+    strcpy(trace + trace_len, event);
+    trace_len += len;
+}
+
+void phase_pop(void) {
+    if ((!time_report && !mem_report && !time_trace) || phase_depth == 0)
+        return;
+
+    phase_charge();
+    Phase phase = phase_stack[--phase_depth];
+
+    if (phase == PHASE_LEX)
+        return;
+
+    if (mem_report)
+        peak_charge(&phase_stats[phase]);
+
+    if (time_trace) {
+        // Its own allocations aren't the phase's
+        bool counting = mem_report;
+        mem_report = false;
+        trace_add(phase, phase_starts[phase_depth], wall_mark);
+        mem_report = counting;
+    }
+}
+
+void phase_alloc(size_t bytes) {
+    if (!mem_report || phase_depth == 0)
+        return;
+
+    PhaseStat *stat = &phase_stats[phase_stack[phase_depth - 1]];
+    stat->allocs++;
+    stat->bytes += bytes;
+}
+
+// Prints what was measured since the last report, naming what, and writes the trace to <trace_base>.json
+void report_print(char *what, char *trace_base) {
+    if (time_report) {
+        double wall = 0.0;
+        double cpu = 0.0;
+
+        fprintf(stderr, "steelc: time report for '%s'\n"
+                        "  %-12s %10s %10s\n", what, "phase", "wall (s)", "cpu (s)");
+
+        for (size_t i = 0; i < PHASE_CNT; i++) {
+            if (phase_stats[i].cnt == 0)
+                continue;
+
+            fprintf(stderr, "  %-12s %10.4f %10.4f\n", phase_names[i], phase_stats[i].wall, phase_stats[i].cpu);
+            wall += phase_stats[i].wall;
+            cpu += phase_stats[i].cpu;
+        }
+
+        fprintf(stderr, "  %-12s %10.4f %10.4f\n", "total", wall, cpu);
+    }
+
+    if (mem_report) {
+        size_t allocs = 0;
+        size_t bytes = 0;
+        long peak = 0;
+
+        fprintf(stderr, "steelc: memory report for '%s'\n"
+                        "  %-12s %12s %14s %10s\n", what, "phase", "allocations", "bytes", "peak kB");
+
+        for (size_t i = 0; i < PHASE_CNT; i++) {
+            if (phase_stats[i].cnt == 0)
+                continue;
+
+            if (i == PHASE_LEX)
+                fprintf(stderr, "  %-12s %12zu %14zu %10s\n", phase_names[i], phase_stats[i].allocs, phase_stats[i].bytes, "-");
+            else
+                fprintf(stderr, "  %-12s %12zu %14zu %10ld\n", phase_names[i], phase_stats[i].allocs, phase_stats[i].bytes, phase_stats[i].peak_kb);
+
+            allocs += phase_stats[i].allocs;
+            bytes += phase_stats[i].bytes;
+
+            if (phase_stats[i].peak_kb > peak)
+                peak = phase_stats[i].peak_kb;
+        }
+
+        fprintf(stderr, "  %-12s %12zu %14zu %10ld\n", "total", allocs, bytes, peak);
+    }
+
+    if (time_trace && trace_len > 0) {
+        char *path = calloc(strlen(trace_base) + 6, sizeof(char));
+        sprintf(path, "%s.json", trace_base);
+
+        FILE *f = fopen(path, "w");
+        if (f == NULL)
+            fprintf(stderr, "steelc: error: failed to write to file '%s'\n", path);
+        else {
+            fprintf(f, "{\"traceEvents\":[\n%s\n]}\n", trace);
+            fclose(f);
+        }
+
+        free(path);
+    }
+
+    memset(phase_stats, 0, sizeof(phase_stats));
+    free(trace);
+    trace = NULL;
+    trace_len = trace_cap = 0;
+    trace_origin = -1.0;
+}
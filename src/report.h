@@ -0,0 +1,29 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "state.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_OPT,
+    PHASE_EMIT,
+    PHASE_WRITE,
+    PHASE_ASSEMBLE,
+    PHASE_LINK,
+    PHASE_CNT
+} Phase;
+
+extern THREAD_LOCAL bool time_report;
+extern THREAD_LOCAL bool mem_report;
+extern THREAD_LOCAL bool time_trace;
+
+void phase_push(Phase phase);
+void phase_pop(void);
+void phase_alloc(size_t bytes);
+void report_print(char *what, char *trace_base);
+
+#endif
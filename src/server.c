@@ -0,0 +1,256 @@
+#include "server.h"
+#include "module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define REQUEST_MAX (1 << 24)
+
+/* A server listens on a Unix socket and runs each request in a process
+ * forked from itself, so a compile starts without loading steelc again
+ * and every request shares the module cache the server keeps. A request
+ * is the client's working directory and arguments, sent along with the
+ * client's stdout and stderr so everything printed goes straight to the
+ * client. The reply is the exit status. Each request is handled by its
+ * own forked process, which forks the compile and waits for it, so a
+ * compile that exits or crashes still gets its status back. */
+char *sock_path(char *sock) {
+    if (sock != NULL)
+        return strdup(sock);
+
+    char *path = calloc(64, sizeof(char));
+    sprintf(path, "/tmp/steelc-%d.sock", (int)getuid());
+    return path;
+}
+
+bool write_all(int fd, const void *data, size_t len) {
+    const char *bytes = data;
+
+    while (len > 0) {
+        ssize_t n = write(fd, bytes, len);
+
+        if (n <= 0)
+            return false;
+
+        bytes += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+bool read_all(int fd, void *data, size_t len) {
+    char *bytes = data;
+
+    while (len > 0) {
+        ssize_t n = read(fd, bytes, len);
+
+        if (n <= 0)
+            return false;
+
+        bytes += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// Reads a request into argv, after changing to its directory and taking its stdout and stderr
+char **request_get(int conn, int *argc) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+
+    // Requests run as the server's user, so only that user may send them
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != getuid())
+        return NULL;
+
+    uint32_t len = 0;
+    int fds[2] = { -1, -1 };
+    char ctrl[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &len, sizeof(len) };
+    struct msghdr msg = { 0 };
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    if (recvmsg(conn, &msg, MSG_WAITALL) != sizeof(len) || len == 0 || len > REQUEST_MAX)
+        return NULL;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return NULL;
+
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    // The directory and each argument end in a null
+    char *data = malloc(len);
+
+    if (!read_all(conn, data, len) || data[len - 1] != '\0' || chdir(data) != 0)
+        return NULL;
+
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+
+    char **argv = calloc(len + 1, sizeof(char *));
+    *argc = 0;
+
+    for (char *arg = data + strlen(data) + 1; arg < data + len; arg += strlen(arg) + 1)
+        argv[(*argc)++] = arg;
+
+    return *argc > 0 ? argv : NULL;
+}
+
+void request_run(int conn, char *cache) {
+    signal(SIGCHLD, SIG_DFL);
+
+    int argc;
+    char **argv = request_get(conn, &argc);
+    int32_t code = EXIT_FAILURE;
+
+    if (argv == NULL) {
+        write_all(conn, &code, sizeof(code));
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(conn);
+
+        if (module_cache == NULL)
+            module_cache = cache;
+
+        exit(run(argc, argv));
+    }
+
+    int status;
+
+    if (pid > 0 && waitpid(pid, &status, 0) == pid)
+        code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    write_all(conn, &code, sizeof(code));
+    exit(EXIT_SUCCESS);
+}
+
+int server_run(char *sock) {
+    char *path = sock_path(sock);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "steelc: error: socket path '%s' is too long\n", path);
+        return EXIT_FAILURE;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    // Requests share the module cache in the directory the server started in
+    char *cwd = getcwd(NULL, 0);
+    char *cache = calloc(strlen(cwd) + 16, sizeof(char));
+    sprintf(cache, "%s/.steelc-cache", cwd);
+    free(cwd);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+
+    // Created private, so no other user can connect before the chmod either
+    mode_t mask = umask(0177);
+    bool bound = fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(mask);
+
+    if (!bound || chmod(path, 0600) != 0 || listen(fd, 128) != 0) {
+        fprintf(stderr, "steelc: error: failed to listen on '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // Requests are never waited for here, their processes are reaped as they end
+    signal(SIGCHLD, SIG_IGN);
+
+    module_warm(cache);
+
+    for (;;) {
+        int conn = accept(fd, NULL, NULL);
+
+        if (conn < 0)
+            continue;
+
+        // Whatever the last requests parsed, the next inherits it in memory
+        module_warm(cache);
+
+        if (fork() == 0) {
+            close(fd);
+            request_run(conn, cache);
+        }
+
+        close(conn);
+    }
+}
+
+int client_run(char *sock, int argc, char **argv) {
+    char *path = sock_path(sock);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (strlen(path) < sizeof(addr.sun_path))
+        strcpy(addr.sun_path, path);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "steelc: error: failed to connect to server at '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char *cwd = getcwd(NULL, 0);
+    size_t len = strlen(cwd) + 1;
+
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+
+    char *data = malloc(len);
+    char *next = stpcpy(data, cwd) + 1;
+
+    for (int i = 0; i < argc; i++)
+        next = stpcpy(next, argv[i]) + 1;
+
+    uint32_t data_len = len;
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char ctrl[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &data_len, sizeof(data_len) };
+    struct msghdr msg = { 0 };
+
+    memset(ctrl, 0, sizeof(ctrl));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    int32_t code = EXIT_FAILURE;
+
+    if (sendmsg(fd, &msg, 0) != sizeof(data_len) || !write_all(fd, data, len) || !read_all(fd, &code, sizeof(code))) {
+        fprintf(stderr, "steelc: error: lost connection to server at '%s'\n", path);
+        code = EXIT_FAILURE;
+    }
+
+    close(fd);
+    free(data);
+    free(cwd);
+    free(path);
+    return code;
+}
@@ -0,0 +1,8 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+int run(int argc, char **argv);
+int server_run(char *sock);
+int client_run(char *sock, int argc, char **argv);
+
+#endif
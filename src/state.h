@@ -0,0 +1,12 @@
+#ifndef STATE_H
+#define STATE_H
+
+/* Everything a compilation keeps between calls lives in globals with one
+ * copy per thread, so threads can compile at the same time. An error ends
+ * the compilation through fatal(), which returns to steelc_compile() when
+ * the library started it and exits otherwise. */
+#define THREAD_LOCAL __thread
+
+void fatal(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,155 @@
+#include "steelc.h"
+#include "state.h"
+#include "parser.h"
+#include "lexer.h"
+#include "ast.h"
+#include "emit.h"
+#include "opt.h"
+#include "module.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+
+extern THREAD_LOCAL Const **constants;
+extern THREAD_LOCAL Alias **aliases;
+
+struct steelc_ctx {
+    bool optimize;
+    Arch march;
+    bool fast_math;
+    bool link_libc;
+    bool require_main;
+    char *module_cache;
+    AST *root;
+    char *code;
+    char *error;
+    jmp_buf fail;
+};
+
+// The context compiling on this thread, if the library started it
+THREAD_LOCAL steelc_ctx *cur_ctx = NULL;
+
+void fatal(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    if (cur_ctx == NULL) {
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    free(cur_ctx->error);
+    cur_ctx->error = malloc((len + 1) * sizeof(char));
+    va_start(args, fmt);
+    vsnprintf(cur_ctx->error, len + 1, fmt, args);
+    va_end(args);
+
+    if (len > 0 && cur_ctx->error[len - 1] == '\n')
+        cur_ctx->error[len - 1] = '\0';
+
+    longjmp(cur_ctx->fail, 1);
+}
+
+steelc_ctx *steelc_ctx_new(void) {
+    steelc_ctx *ctx = calloc(1, sizeof(steelc_ctx));
+    ctx->optimize = true;
+    ctx->march = ARCH_SSE4_1;
+    ctx->require_main = true;
+    return ctx;
+}
+
+void steelc_ctx_del(steelc_ctx *ctx) {
+    free(ctx->module_cache);
+    free(ctx->code);
+    free(ctx->error);
+    free(ctx);
+}
+
+void steelc_set_optimize(steelc_ctx *ctx, bool optimize) {
+    ctx->optimize = optimize;
+}
+
+steelc_status steelc_set_march(steelc_ctx *ctx, const char *arch) {
+    if (strcmp(arch, "x86-64") == 0)
+        ctx->march = ARCH_X86_64;
+    else if (strcmp(arch, "sse4.1") == 0)
+        ctx->march = ARCH_SSE4_1;
+    else if (strcmp(arch, "avx2") == 0)
+        ctx->march = ARCH_AVX2;
+    else
+        return STEELC_ERROR;
+
+    return STEELC_OK;
+}
+
+void steelc_set_fast_math(steelc_ctx *ctx, bool fast_math) {
+    ctx->fast_math = fast_math;
+}
+
+void steelc_set_libc(steelc_ctx *ctx, bool link_libc) {
+    ctx->link_libc = link_libc;
+}
+
+void steelc_set_require_main(steelc_ctx *ctx, bool require_main) {
+    ctx->require_main = require_main;
+}
+
+void steelc_set_module_cache(steelc_ctx *ctx, const char *dir) {
+    free(ctx->module_cache);
+    ctx->module_cache = dir == NULL ? NULL : strdup(dir);
+}
+
+// Compiles src, or the contents of file if src is NULL, naming file in errors
+steelc_status steelc_compile(steelc_ctx *ctx, const char *file, const char *src) {
+    free(ctx->code);
+    free(ctx->error);
+    ctx->code = ctx->error = NULL;
+
+    optimize = ctx->optimize;
+    march = ctx->march;
+    fast_math = ctx->fast_math;
+    link_libc = ctx->link_libc;
+    require_main = ctx->require_main;
+    module_cache = ctx->module_cache;
+    stack_usage = NULL;
+    cur_ctx = ctx;
+
+    if (setjmp(ctx->fail) != 0) {
+        cur_ctx = NULL;
+        prs_reset();
+        emit_reset();
+        ast_del(ctx->root);
+        ctx->root = NULL;
+        return STEELC_ERROR;
+    }
+
+    Lex *lex = src == NULL ? lex_init((char *)file) : lex_init_src((char *)file, strdup(src), 1, 1);
+    ctx->root = prs_lex((char *)file, lex);
+
+    if (optimize)
+        opt_ast(ctx->root);
+
+    ctx->code = emit_ast(ctx->root);
+    ast_del(ctx->root);
+    ctx->root = NULL;
+    free(constants);
+    free(aliases);
+    constants = NULL;
+    aliases = NULL;
+    cur_ctx = NULL;
+    return STEELC_OK;
+}
+
+const char *steelc_asm(steelc_ctx *ctx) {
+    return ctx->code;
+}
+
+const char *steelc_error(steelc_ctx *ctx) {
+    return ctx->error;
+}
@@ -0,0 +1,30 @@
+#ifndef STEELC_H
+#define STEELC_H
+
+#include <stdbool.h>
+
+/* Compiles Steel C to NASM assembly without leaving the calling process.
+ * Each thread compiling needs a context of its own, and a context keeps
+ * the options, the assembly and the error of its last compilation. */
+typedef struct steelc_ctx steelc_ctx;
+
+typedef enum {
+    STEELC_OK,
+    STEELC_ERROR
+} steelc_status;
+
+steelc_ctx *steelc_ctx_new(void);
+void steelc_ctx_del(steelc_ctx *ctx);
+
+void steelc_set_optimize(steelc_ctx *ctx, bool optimize);
+steelc_status steelc_set_march(steelc_ctx *ctx, const char *arch);
+void steelc_set_fast_math(steelc_ctx *ctx, bool fast_math);
+void steelc_set_libc(steelc_ctx *ctx, bool link_libc);
+void steelc_set_require_main(steelc_ctx *ctx, bool require_main);
+void steelc_set_module_cache(steelc_ctx *ctx, const char *dir);
+
+steelc_status steelc_compile(steelc_ctx *ctx, const char *file, const char *src);
+const char *steelc_asm(steelc_ctx *ctx);
+const char *steelc_error(steelc_ctx *ctx);
+
+#endif
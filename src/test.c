@@ -0,0 +1,306 @@
+#include "test.h"
+#include "parser.h"
+#include "ast.h"
+#include "emit.h"
+#include "opt.h"
+#include "command.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TEST_TIMEOUT 10
+
+extern THREAD_LOCAL Alias **aliases;
+
+// Where the test this process runs is built
+char test_tmp[] = "/tmp/steelc-test-XXXXXX";
+
+/* Each test is built as written and optimized, linked with the C runtime
+ * so it may call C, and run. What it should do is read from <test>.expect
+ * beside it, lines of:
+ *   exit <code>     the exit code, 0 if not given
+ *   stdout <line>   the next line it prints, nothing if none are given
+ *   compile-only    only compile and assemble it, it can't be run alone
+ * with blank lines and lines starting with '#' ignored. Every test runs
+ * in a process of its own, as many at once as there are jobs. */
+typedef struct {
+    int exit_code;
+    char *out;
+    bool compile_only;
+} Expect;
+
+Expect expect_read(char *file) {
+    Expect expect = { 0, calloc(1, sizeof(char)), false };
+    char *path = calloc(strlen(file) + 8, sizeof(char));
+    sprintf(path, "%.*s.expect", (int)(strlen(file) - 3), file);
+
+    FILE *f = fopen(path, "r");
+    free(path);
+
+    if (f == NULL)
+        return expect;
+
+    char line[1024];
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "exit ", 5) == 0)
+            expect.exit_code = atoi(line + 5);
+        else if (strncmp(line, "stdout ", 7) == 0) {
+            expect.out = realloc(expect.out, (strlen(expect.out) + strlen(line + 7) + 2) * sizeof(char));
+            strcat(expect.out, line + 7);
+
+            if (expect.out[strlen(expect.out) - 1] != '\n')
+                strcat(expect.out, "\n");
+        } else if (strncmp(line, "compile-only", 12) == 0)
+            expect.compile_only = true;
+    }
+
+    fclose(f);
+    return expect;
+}
+
+char *file_read(char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return NULL;
+
+    char *src = calloc(1, sizeof(char));
+    size_t len = 0;
+    char buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        src = realloc(src, (len + n + 1) * sizeof(char));
+        memcpy(src + len, buf, n);
+        len += n;
+        src[len] = '\0';
+    }
+
+    fclose(f);
+    return src;
+}
+
+// Runs exe with its stdout going to out, the exit code or -1 if it was killed
+int test_exec(char *exe, char *out) {
+    fflush(NULL);
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        if (freopen(out, "w", stdout) == NULL)
+            exit(EXIT_FAILURE);
+
+        alarm(TEST_TIMEOUT);
+        execl(exe, exe, (char *)NULL);
+        exit(EXIT_FAILURE);
+    }
+
+    int status;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+// Builds and runs one variant of file in tmp, false with the reason printed if it doesn't do what's expected
+bool test_variant(char *file, char *tmp, bool opt, Expect *expect) {
+    AST *root = prs_file(file);
+
+    if (opt)
+        opt_ast(root);
+
+    char *code = emit_ast(root);
+    ast_del(root);
+    free(aliases);
+
+    char *base = calloc(strlen(tmp) + 8, sizeof(char));
+    sprintf(base, "%s/t", tmp);
+
+    char *asm_path = calloc(strlen(base) + 8, sizeof(char));
+    char *obj = calloc(strlen(base) + 8, sizeof(char));
+    char *out_path = calloc(strlen(base) + 8, sizeof(char));
+    sprintf(asm_path, "%s.asm", base);
+    sprintf(obj, "%s.o", base);
+    sprintf(out_path, "%s.out", base);
+
+    FILE *f = fopen(asm_path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "%s: error: failed to write to file '%s'\n", file, asm_path);
+        return false;
+    }
+
+    fputs(code, f);
+    fclose(f);
+    free(code);
+
+    const char *variant = opt ? "optimized" : "as written";
+    bool passed = true;
+
+    char *nasm[] = { "nasm", "-felf64", asm_path, "-o", obj, NULL };
+    char *gcc[] = { "gcc", "-no-pie", "-z", "noexecstack", obj, "-o", base, NULL };
+
+    if (!command_run(nasm)) {
+        fprintf(stderr, "%s: error: failed to assemble %s\n", file, variant);
+        passed = false;
+    } else if (!expect->compile_only) {
+        if (!command_run(gcc)) {
+            fprintf(stderr, "%s: error: failed to link %s\n", file, variant);
+            passed = false;
+        }
+    }
+
+    if (passed && !expect->compile_only) {
+        int exit_code = test_exec(base, out_path);
+        char *out = file_read(out_path);
+
+        if (exit_code < 0) {
+            fprintf(stderr, "%s: error: %s was killed or ran longer than %ds\n", file, variant, TEST_TIMEOUT);
+            passed = false;
+        } else if (exit_code != expect->exit_code) {
+            fprintf(stderr, "%s: error: %s exited with %d instead of %d\n", file, variant, exit_code, expect->exit_code);
+            passed = false;
+        } else if (out == NULL || strcmp(out, expect->out) != 0) {
+            fprintf(stderr, "%s: error: %s printed:\n%s" "instead of:\n%s", file, variant, out == NULL ? "" : out, expect->out);
+            passed = false;
+        }
+
+        free(out);
+    }
+
+    free(asm_path);
+    free(obj);
+    free(out_path);
+    free(base);
+    return passed;
+}
+
+// Also run when a test fails to compile
+void test_tmp_del(void) {
+    const char *names[] = { "t.asm", "t.o", "t", "t.out" };
+    char path[sizeof(test_tmp) + 8];
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        sprintf(path, "%s/%s", test_tmp, names[i]);
+        remove(path);
+    }
+
+    rmdir(test_tmp);
+}
+
+void test(char *file) {
+    if (mkdtemp(test_tmp) == NULL) {
+        fprintf(stderr, "%s: error: failed to make a temporary directory\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    atexit(test_tmp_del);
+
+    Expect expect = expect_read(file);
+
+    // Built with the C runtime, so main is also entered as main
+    link_libc = true;
+    bool passed = true;
+
+    for (int i = 0; i < (optimize ? 2 : 1) && passed; i++)
+        passed = test_variant(file, test_tmp, i > 0, &expect);
+
+    exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int names_cmp(const void *a, const void *b) {
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int tests_run(char *dir, size_t jobs) {
+    if (dir[strlen(dir) - 1] == '/')
+        dir[strlen(dir) - 1] = '\0';
+
+    DIR *dr = opendir(dir);
+    if (dr == NULL) {
+        fprintf(stderr, "steelc: error: failed to open test directory '%s'\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    char **files = NULL;
+    size_t files_cnt = 0;
+    struct dirent *de;
+
+    while ((de = readdir(dr)) != NULL) {
+        size_t len = strlen(de->d_name);
+
+        // include.sc is only there for the others to include
+        if (len < 4 || strcmp(de->d_name + len - 3, ".sc") != 0 || strcmp(de->d_name, "include.sc") == 0)
+            continue;
+
+        files = realloc(files, (files_cnt + 1) * sizeof(char *));
+        files[files_cnt] = calloc(strlen(dir) + len + 2, sizeof(char));
+        sprintf(files[files_cnt++], "%s/%s", dir, de->d_name);
+    }
+
+    closedir(dr);
+    qsort(files, files_cnt, sizeof(char *), names_cmp);
+
+    pid_t *pids = calloc(files_cnt + 1, sizeof(pid_t));
+    double *starts = calloc(files_cnt + 1, sizeof(double));
+    size_t running = 0;
+    size_t failed = 0;
+    size_t next = 0;
+    int status;
+
+    while (next < files_cnt || running > 0) {
+        if (next < files_cnt && running < jobs) {
+            fflush(NULL);
+            starts[next] = now();
+            pids[next] = fork();
+
+            if (pids[next] == 0)
+                test(files[next]);
+            else if (pids[next] < 0) {
+                fprintf(stderr, "steelc: error: failed to start testing '%s'\n", files[next]);
+                failed++;
+            } else
+                running++;
+
+            next++;
+            continue;
+        }
+
+        pid_t pid = wait(&status);
+        size_t i = 0;
+
+        while (i < next && pids[i] != pid)
+            i++;
+
+        if (i == next)
+            continue;
+
+        running--;
+        bool passed = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+
+        if (!passed)
+            failed++;
+
+        printf("test %s '%s' (%.3fs)\n", passed ? "passed" : "failed", files[i], now() - starts[i]);
+    }
+
+    printf("%zu of %zu tests passed\n", files_cnt - failed, files_cnt);
+
+    for (size_t i = 0; i < files_cnt; i++)
+        free(files[i]);
+
+    free(files);
+    free(pids);
+    free(starts);
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stddef.h>
+
+int tests_run(char *dir, size_t jobs);
+
+#endif
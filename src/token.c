@@ -49,6 +49,9 @@ Tok *tok_init(TokType type, char *value, size_t ln, size_t col) {
 }
 
 void tok_del(Tok *tok) {
+    if (tok == NULL)
+        return;
+
     free(tok->value);
     free(tok);
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+extern int printf(char *fmt, int a, int b, int c, int d, int e, int f, int g);
+extern float ldexpf(float x, int n);
+
+// Exported, so the System V convention passes g, h and k on the stack
+export int many(int a, int b, int c, int d, int e, int f, int g, int h, float x, char k) {
+    int s = a + h;
+    int t = s + k;
+    int u = t * g;
+    return u;
+}
+
+// a through h are in xmm0-7 and i is on the stack
+export float floats(float a, float b, float c, float d, float e, float f, float g, float h, float i) {
+    float s = a + i;
+    float t = s * h;
+    return t;
+}
+
+void main() {
+    int r = many(1, 2, 3, 4, 5, 6, 7, 8, 1.0, 9);
+    float f = floats(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 0.5, ldexpf(2.5, r - 123));
+    int fi = f;
+    int l = ldexpf(1.5, 3);
+
+    // The seventh argument of printf is on the stack
+    printf("%d %d %d %d %d %d %d\n", r, fi, l, r - fi, 5, 6, 7);
+}
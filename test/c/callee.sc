@@ -0,0 +1,18 @@
+// Called from caller.c, so these have to follow the System V ABI exactly
+
+export int many(int a, int b, int c, int d, int e, int f, int g, int h, float x) {
+    int s = a + h;
+    int t = g * 10;
+    int u = s + t;
+    int q = u / d;
+    float y = x * 2.0;
+    int v = y;
+    int w = q * 100 + v + f - e + c - b;
+    return w;
+}
+
+export float floats(float a, float b, float c, float d, float e, float f, float g, float h, float i) {
+    float s = a + i;
+    float t = s * h - g;
+    return t;
+}
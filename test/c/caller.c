@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Calls the functions callee.sc exports with more arguments than fit in
+ * registers, and checks their results and that they keep rbx and r12-r15
+ * as the System V ABI requires. Built and run with make check. */
+
+int many(int a, int b, int c, int d, int e, int f, int g, int h, float x);
+float floats(float a, float b, float c, float d, float e, float f, float g, float h, float i);
+
+int many_result;
+float floats_result;
+
+// Calls fn with rbx and r12-r15 set to known values, and returns how many of them it changed
+int keeps_regs(void (*fn)(void));
+
+__asm__(
+    "    .intel_syntax noprefix\n"
+    "    .text\n"
+    "keeps_regs:\n"
+    "    push rbx\n"
+    "    push r12\n"
+    "    push r13\n"
+    "    push r14\n"
+    "    push r15\n"
+    "    movabs rbx, 0x1111111111111111\n"
+    "    movabs r12, 0x1212121212121212\n"
+    "    movabs r13, 0x1313131313131313\n"
+    "    movabs r14, 0x1414141414141414\n"
+    "    movabs r15, 0x1515151515151515\n"
+    "    call rdi\n"
+    "    xor eax, eax\n"
+    "    movabs rcx, 0x1111111111111111\n"
+    "    cmp rbx, rcx\n"
+    "    setne al\n"
+    "    movabs rcx, 0x1212121212121212\n"
+    "    cmp r12, rcx\n"
+    "    setne cl\n"
+    "    add al, cl\n"
+    "    movabs rcx, 0x1313131313131313\n"
+    "    cmp r13, rcx\n"
+    "    setne cl\n"
+    "    add al, cl\n"
+    "    movabs rcx, 0x1414141414141414\n"
+    "    cmp r14, rcx\n"
+    "    setne cl\n"
+    "    add al, cl\n"
+    "    movabs rcx, 0x1515151515151515\n"
+    "    cmp r15, rcx\n"
+    "    setne cl\n"
+    "    add al, cl\n"
+    "    pop r15\n"
+    "    pop r14\n"
+    "    pop r13\n"
+    "    pop r12\n"
+    "    pop rbx\n"
+    "    ret\n"
+    "    .att_syntax prefix\n"
+);
+
+// Only a call and a store, so nothing of their own is kept in the registers checked
+void call_many(void) {
+    many_result = many(1, 2, 3, 4, 5, 6, 7, 8, 2.5f);
+}
+
+void call_floats(void) {
+    floats_result = floats(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 0.5f, 9.0f);
+}
+
+int main(void) {
+    int failed = 0;
+
+    if (keeps_regs(call_many) != 0) {
+        fprintf(stderr, "caller: many() didn't keep rbx and r12-r15\n");
+        failed = 1;
+    }
+
+    // (1 + 8 + 70) / 4 * 100 + 2.5 * 2 + 6 - 5 + 3 - 2
+    if (many_result != 1907) {
+        fprintf(stderr, "caller: many() returned %d instead of 1907\n", many_result);
+        failed = 1;
+    }
+
+    if (keeps_regs(call_floats) != 0) {
+        fprintf(stderr, "caller: floats() didn't keep rbx and r12-r15\n");
+        failed = 1;
+    }
+
+    // (1 + 9) * 0.5 - 7
+    if (floats_result != -2.0f) {
+        fprintf(stderr, "caller: floats() returned %g instead of -2\n", floats_result);
+        failed = 1;
+    }
+
+    if (failed)
+        return EXIT_FAILURE;
+
+    printf("caller: C called exported Steel C functions\n");
+    return EXIT_SUCCESS;
+}
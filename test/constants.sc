@@ -0,0 +1,12 @@
+float scale(float x) {
+    return x * 9.9 + 0.1;
+}
+
+void main() {
+    mut float a = 9.9;
+    mut char* s = "pooled";
+    mut char* t = "pooled";
+
+    for (mut int i = 0; i < 4; i += 1)
+        a = a * 9.9 + scale(0.1);
+}
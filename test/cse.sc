@@ -0,0 +1,43 @@
+extern int printf(char *fmt, int x);
+
+float scale(float a, int i) {
+    float x = a / i * 9.9;
+    float y = a / i;
+    float z = x + y * i;
+    return z;
+}
+
+int twice(int a, int b, int c) {
+    int x = a * b + c;
+    int y = a * b + c;
+    int z = (a * b + c) * 2 + x - y;
+    return z;
+}
+
+int killed(int a, int b) {
+    mut int m = a * b;
+    int u = m + a * b;
+    m = m + 1;
+    int v = m + a * b;
+    int w = u + v;
+    return w;
+}
+
+void main() {
+    float s = scale(5.0, 3);
+    int t = twice(2, 3, 4);
+    int k = killed(3, 4) * 100 + t * 10 + 1;
+    int si = s * 2.0;
+    printf("%d\n", si);
+    printf("%d\n", k);
+
+    // An int term kept aside while a float one is computed
+    mut int i = 5;
+    mut float acc = 2.5;
+    float r = i * 3 + 4 * acc;
+    float q = i * 2 + acc * 4 - i * 3;
+    int ri = r;
+    int qi = q;
+    printf("%d\n", ri);
+    printf("%d\n", qi);
+}
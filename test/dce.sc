@@ -0,0 +1,59 @@
+#define DEBUG 0
+
+extern int printf(char *fmt, int x);
+
+int unused(int x) {
+    return x * 2;
+}
+
+int helper(int x) {
+    return x + 1;
+}
+
+int early(int x) {
+    if (x > 2)
+        return 1;
+    else
+        return 0;
+
+    int y = x * 3;
+    return y;
+}
+
+int stores(int x) {
+    mut int t = x * 4;
+    int u = x + 1;
+    t = t + x;
+    t = x - 1;
+    return u;
+}
+
+void main() {
+    mut int r = 0;
+
+    if (DEBUG == 1) {
+        int d = unused(3);
+        r = d;
+    } else if (DEBUG == 0) {
+        int h = helper(5);
+        r = h;
+    }
+
+    while (DEBUG > 0) {
+        int w = unused(4);
+        r = w;
+    }
+
+    do {
+        int once = helper(1);
+        r = r * 10 + once;
+    } while (DEBUG != 0);
+
+    mut int v = 7;
+    v += 1;
+    int e = early(v);
+    int s = stores(e);
+    printf("%d\n", r);
+    printf("%d\n", e);
+    printf("%d\n", s);
+}
@@ -0,0 +1,19 @@
+int madd(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j, int k) {
+    int s = a + k;
+    return s;
+}
+
+float fadd(float a, float b, float c, float d, float e, float f, float g, float h, float i, float j) {
+    float s = a + j;
+    return s;
+}
+
+export int api(int x) {
+    int r = madd(x, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11);
+    float f = fadd(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0);
+    return r;
+}
+
+void main() {
+    int r = api(1);
+}
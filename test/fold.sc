@@ -0,0 +1,62 @@
+#define N 12
+
+extern int printf(char *fmt, int x);
+extern int getpid();
+
+int fact(int n) {
+    mut int r = 1;
+    for (mut int i = 2; i <= n; i += 1)
+        r *= i;
+    return r;
+}
+
+int fib(int n) {
+    if (n < 2)
+        return n;
+
+    int a = fib(n - 1);
+    int b = fib(n - 2);
+    int s = a + b;
+    return s;
+}
+
+float poly(float x, int k) {
+    float y = x * x * 0.5 + k / 3 - x / k;
+    return y;
+}
+
+int spin(int x) {
+    mut int i = 0;
+    while (i < 10)
+        i = i * x;
+    return i;
+}
+
+int square_add(int a, int b) {
+    int r = a + b * b;
+    return r;
+}
+
+void nop(int x) {
+    int y = x * 2;
+}
+
+void main() {
+    int f = fact(N);
+    float p = poly(fact(3), fib(12)) * 2;
+    char c = fib(10);
+    int q = square_add(7, 40000);
+    nop(N);
+
+    // spin(1) never returns, folding it has to give up instead
+    if (getpid() < 0) {
+        int s = spin(1);
+        printf("%d\n", s);
+    }
+
+    int pi = p;
+    printf("%d\n", f);
+    printf("%d\n", pi);
+    printf("%d\n", c);
+    printf("%d\n", q);
+}
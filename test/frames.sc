@@ -0,0 +1,28 @@
+int leaf(int a, int b) {
+    int sum = a + b;
+    int arr[4] = {a, b, sum, 4};
+    int r = arr[2];
+    return r * 2;
+}
+
+int empty_leaf() {
+    return 7;
+}
+
+int big_leaf() {
+    mut int arr[64];
+    arr[63] = 5;
+    int r = arr[63];
+    return r;
+}
+
+int caller(int x) {
+    int y = leaf(x, 2);
+    return y + empty_leaf() + big_leaf();
+}
+
+void main() {
+    if (caller(1) == 18) {
+        int z = 1;
+    }
+}
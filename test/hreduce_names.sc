@@ -0,0 +1,11 @@
+extern void exit(int code);
+
+// A function named like a builtin hides it
+int hsum(int x) {
+    return x * 3;
+}
+
+void main() {
+    int r = hsum(4);
+    exit(r);
+}
@@ -0,0 +1,48 @@
+#define DEBUG 1
+#define LEVEL 3
+
+extern int printf(char *fmt, int x);
+
+#ifndef GUARD
+#define GUARD 1
+
+int trace(int x) {
+    return x * 2;
+}
+#endif
+
+#ifdef GUARD
+int twice() {
+    return 2;
+}
+#else
+int twice() {
+    return oops;
+}
+#endif
+
+void main() {
+    mut int r = 5;
+#if DEBUG && LEVEL > 2
+    r = trace(r);
+#elif defined(GUARD)
+    r = 1 $ junk;
+#else
+    r = 2;
+#endif
+#if 0
+    this is not even tokenized "
+  #if nested
+    neither
+  #endif
+#elif LEVEL == 3 || undefined_name
+    r += 1;
+#endif
+#if 0
+    r = 5;
+#else
+    r += twice();
+#endif
+
+    printf("%d\n", r);
+}
@@ -0,0 +1,37 @@
+extern int printf(char *fmt, int x);
+
+int twice(int x) {
+    return x * 2;
+}
+
+void main() {
+    mut int small[6] = {1, 2, 3};
+    mut float weights[5] = {0.5, 1, 2.25};
+    mut char name[24] = "steel\n";
+    mut int table[64] = {7, twice(21), 9};
+    mut int x = 4;
+    mut int mixed[3] = {x, 5, x + 1};
+
+    name = "c";
+
+    // The elements not given are zeroed
+    int s2 = small[2];
+    int s5 = small[5];
+    printf("%d\n", s2 * 10 + s5);
+
+    float w = weights[2] + weights[4];
+    int wi = w * 4.0;
+    printf("%d\n", wi);
+
+    char c0 = name[0];
+    char c1 = name[1];
+    int n = c0 + c1;
+    printf("%d\n", n);
+
+    int t1 = table[1];
+    int t63 = table[63];
+    printf("%d\n", t1 + t63);
+
+    int m = mixed[2];
+    printf("%d\n", m);
+}
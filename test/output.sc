@@ -0,0 +1,14 @@
+extern int putchar(int c);
+extern void exit(int code);
+
+int digit(int n) {
+    return n + 48;
+}
+
+void main() {
+    for (mut int i = 1; i < 4; i += 1)
+        putchar(digit(i * 2));
+
+    putchar(10);
+    exit(3);
+}
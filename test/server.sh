@@ -0,0 +1,54 @@
+#!/bin/sh
+# Checks that the compile server hands its requests the modules earlier
+# ones parsed from memory: once a module is in memory, a request including
+# its file compiles without parsing it, so nothing is written to the cache
+# even after the cache directory is emptied. Run by make check.
+
+steelc="$(pwd)/steelc"
+dir=$(mktemp -d /tmp/steelc-server-XXXXXX)
+sock="$dir/server.sock"
+trap 'kill $server 2>/dev/null; rm -rf "$dir"' EXIT
+
+cd "$dir" || exit 1
+
+cat > lib.sc <<'SC'
+export int twice(int x) {
+    return x * 2;
+}
+SC
+
+cat > main.sc <<'SC'
+#include "lib.sc"
+
+void main() {
+    int r = twice(21);
+}
+SC
+
+fail() {
+    echo "server: $1" >&2
+    exit 1
+}
+
+"$steelc" --server="$sock" &
+server=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S "$sock" ] && break
+    sleep 0.1
+done
+
+# The first request parses lib.sc and writes its module, the second is forked once the server has read it
+"$steelc" --client="$sock" -S main.sc || fail "first request failed"
+ls .steelc-cache/*.scm > /dev/null 2>&1 || fail "the first request wrote no module"
+"$steelc" --client="$sock" -S main.sc || fail "second request failed"
+
+rm -f .steelc-cache/*.scm main.asm
+"$steelc" --client="$sock" -S main.sc || fail "third request failed"
+grep -q "twice" main.asm || fail "the third request didn't compile lib.sc"
+
+if ls .steelc-cache/*.scm > /dev/null 2>&1; then
+    fail "the third request parsed lib.sc again instead of using the module in memory"
+fi
+
+echo "server: lib.sc was parsed once for 3 requests"
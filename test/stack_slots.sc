@@ -0,0 +1,40 @@
+extern int printf(char *fmt, int x);
+
+int blocks(int n) {
+    mut int total = 0;
+
+    if (n > 0) {
+        int a[16] = {1, 2, 3};
+        int x = a[2];
+        total = total + x;
+    }
+
+    if (n > 1) {
+        int b[16] = {4, 5, 6};
+        int y = b[2];
+        total = total + y;
+    }
+
+    char c = 7;
+    int d = c;
+    total = total + d;
+
+    int big[8];
+    int* p = big;
+    mut int i = 0;
+
+    while (i < 3) {
+        int t = i * 2;
+        total = total + t;
+        i += 1;
+    }
+
+    return total;
+}
+
+void main() {
+    int r = blocks(2);
+    int s = blocks(0);
+    printf("%d\n", r);
+    printf("%d\n", s);
+}
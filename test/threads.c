@@ -0,0 +1,160 @@
+#include "steelc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Compiles the same sources on many threads at once through libsteelc.a
+ * and checks every thread gets what one thread alone does, the assembly
+ * of the good ones and the error of the bad ones. Built and run with
+ * make check. */
+
+#define THREADS 8
+#define ROUNDS 1000
+
+typedef struct {
+    const char *name;
+    const char *src;
+    steelc_status expect;
+} Case;
+
+Case cases[] = {
+    { "floats.sc",
+      "export float mix(float x, int n) {\n"
+      "    float a = x * 1.5 + 2.0;\n"
+      "    float b = a / 0.25 - n;\n"
+      "    float c = 1.5 * 2.25 + 0.5 - 3.125 / 2.5 + 7.0 * 0.75 - 2.5 / 8.0;\n"
+      "    float d = b + c;\n"
+      "    return d;\n"
+      "}\n", STEELC_OK },
+    { "ints.sc",
+      "int twice(int x) {\n"
+      "    return x * 2;\n"
+      "}\n"
+      "\n"
+      "export int sum(int n) {\n"
+      "    mut int s = 0;\n"
+      "    for (mut int i = 0; i < n; i += 1)\n"
+      "        s += twice(i);\n"
+      "    return s;\n"
+      "}\n", STEELC_OK },
+    { "undefined.sc",
+      "export int f() {\n"
+      "    return g(1.5);\n"
+      "}\n", STEELC_ERROR },
+    { "unsupported.sc",
+      "int f(int x) {\n"
+      "    return x;\n"
+      "}\n"
+      "\n"
+      "export int g() {\n"
+      "    int a[2] = {1, 2};\n"
+      "    int r = f(a[0]);\n"
+      "    return r;\n"
+      "}\n", STEELC_ERROR },
+    // Errors deep inside a statement, which must free what was parsed of it
+    { "nested.sc",
+      "export int f(mut int x) {\n"
+      "    for (mut int i = 0; i < 3; i += 1) {\n"
+      "        if (i == x) {\n"
+      "            int b = i * 3 + x;\n"
+      "            x += g(b, 2);\n"
+      "        }\n"
+      "    }\n"
+      "    return x;\n"
+      "}\n", STEELC_ERROR },
+    { "token.sc",
+      "export int f(int x) {\n"
+      "    int a = x + 1;\n"
+      "    while (a < 10) {\n"
+      "        int c = a * (2 + $);\n"
+      "    }\n"
+      "    return a;\n"
+      "}\n", STEELC_ERROR },
+    { "args.sc",
+      "int g(int a, int b) {\n"
+      "    return a + b;\n"
+      "}\n"
+      "\n"
+      "export int f(int x) {\n"
+      "    int r = g(x, 2, 3);\n"
+      "    return r;\n"
+      "}\n", STEELC_ERROR },
+    { "assign.sc",
+      "export int f(int x) {\n"
+      "    if (x > 1)\n"
+      "        y = x * 2;\n"
+      "    return x;\n"
+      "}\n", STEELC_ERROR }
+};
+
+#define CASES (sizeof(cases) / sizeof(cases[0]))
+
+// What compiling each case on one thread gave
+char *outs[CASES];
+
+// The assembly, or the error if it didn't compile as expected
+char *compile(Case *c, bool *ok) {
+    steelc_ctx *ctx = steelc_ctx_new();
+    steelc_set_require_main(ctx, false);
+
+    steelc_status status = steelc_compile(ctx, c->name, c->src);
+    char *out = strdup(status == STEELC_OK ? steelc_asm(ctx) : steelc_error(ctx));
+    *ok = status == c->expect;
+
+    steelc_ctx_del(ctx);
+    return out;
+}
+
+void *worker(void *arg) {
+    size_t *failures = arg;
+
+    for (size_t i = 0; i < ROUNDS; i++) {
+        bool ok;
+        char *out = compile(&cases[i % CASES], &ok);
+
+        if (!ok || strcmp(out, outs[i % CASES]) != 0)
+            (*failures)++;
+
+        free(out);
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    for (size_t i = 0; i < CASES; i++) {
+        bool ok;
+        outs[i] = compile(&cases[i], &ok);
+
+        if (!ok) {
+            fprintf(stderr, "threads: '%s' %s on one thread:\n%s\n", cases[i].name,
+                    cases[i].expect == STEELC_OK ? "failed" : "compiled", outs[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    pthread_t threads[THREADS];
+    size_t failures[THREADS] = { 0 };
+
+    for (size_t i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, worker, &failures[i]);
+
+    size_t total = 0;
+
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += failures[i];
+    }
+
+    for (size_t i = 0; i < CASES; i++)
+        free(outs[i]);
+
+    if (total > 0) {
+        fprintf(stderr, "threads: %zu of %d compiles differed from a single thread's\n", total, THREADS * ROUNDS);
+        return EXIT_FAILURE;
+    }
+
+    printf("threads: %d compiles on %d threads matched\n", THREADS * ROUNDS, THREADS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut int a[19];
+    mut int b[19];
+    mut float x[10];
+    mut float y[10];
+    mut int k = 3;
+    mut int sum = 0;
+    mut float dot = 0.0;
+
+    // 19 and 10 aren't multiples of the vector width, so the scalar remainder runs too
+    for (mut int i = 0; i < 19; i += 1)
+        a[i] = 7;
+
+    for (mut int i = 0; i < 19; i += 1)
+        b[i] = a[i] * k;
+
+    for (mut int i = 2; i <= 18; i += 1)
+        a[i] = b[i] - a[i];
+
+    for (mut int i = 0; i < 19; i += 1)
+        sum = sum + a[i];
+
+    for (mut int i = 0; i < 10; i += 1)
+        x[i] = 1.5;
+
+    for (mut int i = 0; i < 10; i += 1)
+        y[i] = x[i] / 2.0;
+
+    for (mut int i = 0; i < 10; i += 1)
+        dot = dot + x[i] * y[i];
+
+    // The accumulator changes every iteration, so it isn't a loop invariant
+    mut int ones[8];
+    mut int s = 1;
+
+    for (mut int i = 0; i < 8; i += 1)
+        ones[i] = 1;
+
+    for (mut int i = 0; i < 8; i += 1)
+        s = s + ones[i] * s;
+
+    int last = a[18];
+    int first = a[1];
+    int scaled = dot * 4.0;
+
+    printf("%d\n", sum);
+    printf("%d\n", first);
+    printf("%d\n", last);
+    printf("%d\n", scaled);
+    printf("%d\n", s);
+}
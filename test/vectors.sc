@@ -0,0 +1,33 @@
+extern int printf(char *fmt, int x);
+
+void main() {
+    mut float a[8];
+    mut int b[8];
+    mut float4 v = {1.0, 2.0, 3, 4.5};
+    mut int4 w = 3;
+    mut float x = 2.5;
+
+    for (mut int i = 0; i < 8; i += 1)
+        b[i] = i;
+
+    v = v * x + (v - 1.0) / 2.0;
+    v[1] = 8.0;
+    w = b[4] * w - b[0];
+    w += 1;
+    a[0] = v;
+    a[4] = v * v;
+
+    float s = hsum(v);
+    int lo = hmin(w);
+    x = hmax(v);
+    x = x + v[2];
+
+    int si = s * 4.0;
+    int xi = x * 2.0;
+    float a5 = a[5];
+    int a5i = a5;
+    printf("%d\n", si);
+    printf("%d\n", lo);
+    printf("%d\n", xi);
+    printf("%d\n", a5i);
+}